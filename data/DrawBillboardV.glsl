@@ -0,0 +1,22 @@
+
+attribute vec3 aPosition;
+attribute float aCorner;
+attribute vec2 aSize;
+attribute vec2 aAnchor;
+attribute vec4 aColor;
+
+uniform mat4 uProjectionMatrix;
+
+varying vec2 vTexCoord;
+varying vec4 vColor;
+
+void main()
+{
+    // Corners 0..3 are (0, 0), (1, 0), (0, 1), (1, 1); the sprite is expanded in view space, y pointing down
+    vec2 corner = vec2(mod(aCorner, 2.0), floor(aCorner * 0.5));
+    vec2 offset = aSize * (corner - aAnchor);
+    vec4 position = uProjectionMatrix * vec4(aPosition + vec3(offset.x, -offset.y, 0.0), 1.0);
+    vTexCoord = corner;
+    vColor = aColor;
+    gl_Position = position;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "actor.h"
+#include <algorithm>
+#include <cmath>
+
+static const float STEP_HEIGHT = 8.0f;
+static const int COLLISION_ITERATIONS = 3;
+
+void actorPlace(const LevelMap& map, Actor& actor)
+{
+    actor.sector = map.findSector(actor.pos);
+    if (actor.sector != LevelMap::NONE)
+        actor.z = map.floorZ(actor.sector, actor.pos);
+}
+
+// A portal can be passed when the step up is low enough and the opening is tall enough
+static bool isWallSolid(const LevelMap& map, const Actor& actor, uint32_t wall, const glm::vec2& a, const glm::vec2& b)
+{
+    uint32_t adjacent = map.walls[wall].adjacentSector;
+    if (adjacent == LevelMap::NONE)
+        return true;
+
+    float floor = std::max(map.floorZ(adjacent, a), map.floorZ(adjacent, b));
+    float ceiling = std::min(map.ceilingZ(adjacent, a), map.ceilingZ(adjacent, b));
+    return (floor - actor.z > STEP_HEIGHT || ceiling - std::max(floor, actor.z) < actor.height);
+}
+
+static void collideWithSector(const LevelMap& map, const Actor& actor, uint32_t sector, glm::vec2& pos)
+{
+    const auto& s = map.sectors[sector];
+    uint32_t end = s.firstPoint + s.pointCount;
+    for (uint32_t i = s.firstPoint; i < end; i++) {
+        uint32_t next = (i + 1 < end ? i + 1 : s.firstPoint);
+        const auto& a = map.points[i].pos;
+        const auto& b = map.points[next].pos;
+
+        glm::vec2 ab = b - a;
+        float lengthSq = glm::dot(ab, ab);
+        float t = (lengthSq > 0.0f ? glm::clamp(glm::dot(pos - a, ab) / lengthSq, 0.0f, 1.0f) : 0.0f);
+        glm::vec2 closest = a + ab * t;
+
+        glm::vec2 d = pos - closest;
+        float distanceSq = glm::dot(d, d);
+        if (distanceSq >= actor.radius * actor.radius || !isWallSolid(map, actor, i, a, b))
+            continue;
+
+        float distance = sqrtf(distanceSq);
+        if (distance > 1e-6f)
+            pos = closest + d * (actor.radius / distance);
+        else if (lengthSq > 0.0f) {
+            // Exactly on the wall: push to the left of it, which is inside for counter-clockwise sectors
+            glm::vec2 normal = glm::vec2(-ab.y, ab.x) / sqrtf(lengthSq);
+            pos = closest + normal * actor.radius;
+        }
+    }
+}
+
+static void moveStep(const LevelMap& map, Actor& actor, const glm::vec2& delta)
+{
+    glm::vec2 pos = actor.pos + delta;
+
+    for (int iteration = 0; iteration < COLLISION_ITERATIONS; iteration++) {
+        collideWithSector(map, actor, actor.sector, pos);
+
+        const auto& s = map.sectors[actor.sector];
+        for (uint32_t i = s.firstPoint; i < s.firstPoint + s.pointCount; i++) {
+            uint32_t adjacent = map.walls[i].adjacentSector;
+            if (adjacent != LevelMap::NONE)
+                collideWithSector(map, actor, adjacent, pos);
+        }
+    }
+
+    // Squeezed out of the neighbourhood (e.g. through a corner): stay where we were
+    uint32_t sector = map.updateSector(actor.sector, pos);
+    if (sector == LevelMap::NONE)
+        return;
+
+    actor.pos = pos;
+    actor.sector = sector;
+    actor.z = map.floorZ(sector, pos);
+}
+
+void actorMove(const LevelMap& map, Actor& actor, const glm::vec2& delta)
+{
+    if (actor.sector == LevelMap::NONE) {
+        actorPlace(map, actor);
+        if (actor.sector == LevelMap::NONE)
+            return;
+    }
+
+    // Steps no longer than the radius keep the actor from tunneling through walls
+    float length = glm::length(delta);
+    int steps = std::max(1, int(ceilf(length / actor.radius)));
+    for (int i = 0; i < steps; i++)
+        moveStep(map, actor, delta / float(steps));
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef ACTOR_H
+#define ACTOR_H
+
+#include "levelmap.h"
+#include <glm/glm.hpp>
+
+// Anything that walks around the level: a cylinder standing on the floor of its sector.
+struct Actor
+{
+    glm::vec2 pos{0.0f};
+    float z = 0.0f;                 // height of the feet
+    float angle = 0.0f;             // direction the actor faces, in degrees
+    float radius = 4.0f;
+    float height = 24.0f;
+    uint32_t sector = LevelMap::NONE;
+};
+
+// Finds the sector of the actor by scanning the whole map; only needed when spawning or teleporting.
+void actorPlace(const LevelMap& map, Actor& actor);
+
+// Moves the actor, sliding along walls it can not pass. Only the walls of the current sector and of
+// the sectors behind its portals are checked.
+void actorMove(const LevelMap& map, Actor& actor, const glm::vec2& delta);
+
+#endif
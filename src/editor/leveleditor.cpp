@@ -19,11 +19,20 @@
 #include "game.h"
 #include "menu/mainmenu.h"
 #include "engine/draw.h"
+#include "engine/framearena.h"
 #include "engine/gui.h"
+#include "engine/memtrack.h"
 #include "engine/util.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstring>
 #include <limits>
 
+static const uint32_t PICK_WALL = 0x40000000u;
+static const uint32_t PICK_FLOOR = 0x80000000u;
+static const uint32_t PICK_MESH = 0xC0000000u;
+static const uint32_t PICK_TYPE_MASK = 0xC0000000u;
+
 LevelEditor::LevelEditor(const std::string& file)
     : mFile(file)
     , mSelectedSector(0)
@@ -34,18 +43,20 @@ LevelEditor::LevelEditor(const std::string& file)
     , mCameraVertRotation(45.0f)
     , mCameraPosition(0.0f)
     , mCullFace(false)
+    , mBvhDirty(true)
 {
     strcpy(mMeshFile, "");
     if (fileExists(mFile))
-        mLevel.load(mFile);
+        mLevel.map.load(mFile);
     else {
-        auto sector = std::make_shared<Level::Sector>();
-        sector->points.emplace_back(std::make_shared<Level::Point>(glm::vec2(-100.0f, -100.0f), 0.0f, 60.0f));
-        sector->points.emplace_back(std::make_shared<Level::Point>(glm::vec2( 100.0f, -100.0f), 0.0f, 60.0f));
-        sector->points.emplace_back(std::make_shared<Level::Point>(glm::vec2( 100.0f,  100.0f), 0.0f, 60.0f));
-        sector->points.emplace_back(std::make_shared<Level::Point>(glm::vec2(-100.0f,  100.0f), 0.0f, 60.0f));
-        mSelectedSector = int(mLevel.sectors.size());
-        mLevel.sectors.emplace_back(std::move(sector));
+        auto& map = mLevel.map;
+        uint32_t sector = map.addSector(4);
+        uint32_t first = map.sectors[sector].firstPoint;
+        map.points[first + 0] = LevelMap::Point(glm::vec2(-100.0f, -100.0f), 0.0f, 60.0f);
+        map.points[first + 1] = LevelMap::Point(glm::vec2( 100.0f, -100.0f), 0.0f, 60.0f);
+        map.points[first + 2] = LevelMap::Point(glm::vec2( 100.0f,  100.0f), 0.0f, 60.0f);
+        map.points[first + 3] = LevelMap::Point(glm::vec2(-100.0f,  100.0f), 0.0f, 60.0f);
+        mSelectedSector = int(sector);
     }
 }
 
@@ -53,8 +64,10 @@ LevelEditor::~LevelEditor()
 {
 }
 
-void LevelEditor::run(double time, int width, int height)
+void LevelEditor::render(double alpha, int width, int height)
 {
+    MemTagScope tag(MemTag_Editor);
+
     glm::vec3 cameraOffset = glm::vec3(
         mCameraDistance * sinf(glm::radians(mCameraHorzRotation)) * cosf(glm::radians(mCameraVertRotation)),
         mCameraDistance * sinf(glm::radians(mCameraVertRotation)),
@@ -64,9 +77,9 @@ void LevelEditor::run(double time, int width, int height)
     glm::vec3 cameraPosition = cameraTarget + cameraOffset;
 
     if (mCullFace)
-        glEnable(GL_CULL_FACE);
+        drawEnable(GL_CULL_FACE);
     else
-        glDisable(GL_CULL_FACE);
+        drawDisable(GL_CULL_FACE);
 
     drawBegin(glm::perspective(glm::radians(90.0f), float(width) / float(height), 1.0f, 1000.0f));
 
@@ -89,23 +102,33 @@ void LevelEditor::run(double time, int width, int height)
 
     mLevel.draw3D();
 
-    if (mSelectedSector >= 0 && mSelectedSector < int(mLevel.sectors.size())) {
-        const auto& sector = mLevel.sectors[size_t(mSelectedSector)];
+    auto& map = mLevel.map;
+
+    if (ImGui::IsMouseClicked(0) && !ImGui::GetIO().WantCaptureMouse) {
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        glm::vec3 origin, direction;
+        drawGetRay(glm::vec2(mouse.x, mouse.y), glm::vec2(float(width), float(height)), origin, direction);
+        pick(origin, direction);
+    }
+
+    if (mSelectedSector >= 0 && mSelectedSector < int(map.sectors.size())) {
+        const auto& sector = map.sectors[size_t(mSelectedSector)];
+        const auto* points = &map.points[sector.firstPoint];
 
         drawSetTexture(0);
         drawPushColor(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
         drawSetLineWidth(5.0f);
 
         drawBeginPrimitive(GL_LINES);
-        for (size_t i = 0; i < sector->points.size(); i++) {
-            const auto& point = sector->points[size_t(i)];
-            const auto& nextPoint = sector->points[size_t(i + 1) % sector->points.size()];
+        for (size_t i = 0; i < sector.pointCount; i++) {
+            const auto& point = points[i];
+            const auto& nextPoint = points[(i + 1) % sector.pointCount];
 
             if (int(i) == mSelectedPoint)
                 drawPushColor(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
 
-            auto p1 = glm::vec3(point->pos.x, point->pos.y, point->maxZ);
-            auto p2 = glm::vec3(nextPoint->pos.x, nextPoint->pos.y, nextPoint->maxZ);
+            auto p1 = glm::vec3(point.pos.x, point.pos.y, point.maxZ);
+            auto p2 = glm::vec3(nextPoint.pos.x, nextPoint.pos.y, nextPoint.maxZ);
             drawVertex3D(p1);
             drawVertex3D(p2);
 
@@ -116,13 +139,12 @@ void LevelEditor::run(double time, int width, int height)
 
         drawSetColor(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
 
-        if (mSelectedPoint >= 0 && mSelectedPoint < int(sector->points.size())) {
-            const auto& point = sector->points[size_t(mSelectedPoint)];
-            const auto& nextPoint = sector->points[size_t(mSelectedPoint + 1) % sector->points.size()];
+        if (mSelectedPoint >= 0 && mSelectedPoint < int(sector.pointCount)) {
+            const auto& point = points[size_t(mSelectedPoint)];
 
             drawBeginPrimitive(GL_TRIANGLES);
-            auto p1 = glm::vec3(point->pos.x - 1.0f, point->pos.y - 1.0f, point->minZ);
-            auto p2 = glm::vec3(point->pos.x + 1.0f, point->pos.y + 1.0f, point->maxZ + 4.0f);
+            auto p1 = glm::vec3(point.pos.x - 1.0f, point.pos.y - 1.0f, point.minZ);
+            auto p2 = glm::vec3(point.pos.x + 1.0f, point.pos.y + 1.0f, point.maxZ + 4.0f);
             for (const auto& v : cubeVertices) {
                 glm::vec3 p;
                 p.x = (v.x < 0.0f ? p1.x : p2.x);
@@ -146,8 +168,12 @@ void LevelEditor::run(double time, int width, int height)
         return;
     }
 
-    if (ImGui::Button("Save"))
-        mLevel.save(mFile);
+    if (ImGui::Button("Save")) {
+        map.save(mFile);
+        std::string prepared = changeFileExtension(mFile, ".levelb");
+        if (fileExists(prepared))
+            map.save(prepared);
+    }
 
     ImGui::Checkbox("Cull Faces", &mCullFace);
     ImGui::Checkbox("SSAO", &ssaoEnabled);
@@ -183,165 +209,187 @@ void LevelEditor::run(double time, int width, int height)
     while (mCameraHorzRotation >= 360.0f)
         mCameraHorzRotation -= 360.0f;
 
-    static std::string buffer;
     auto listboxGetter = [](void* data, int n, const char** p) -> bool {
-            //const auto& sector = reinterpret_cast<LevelEditor*>(data)->mLevel.sectors[size_t(n)];
-            buffer = fmt() << n;
-            *p = buffer.c_str();
+            //const auto& sector = reinterpret_cast<LevelEditor*>(data)->mLevel.map.sectors[size_t(n)];
+            *p = frameArenaFormat("%d", n);
             return true;
         };
-    if (ImGui::ListBox("Sectors", &mSelectedSector, listboxGetter, this, int(mLevel.sectors.size()), 5)) {
+    if (ImGui::ListBox("Sectors", &mSelectedSector, listboxGetter, this, int(map.sectors.size()), 5)) {
         mSelectedPoint = 0;
         mSelectedMesh = -1;
     }
 
-    if (mSelectedSector >= 0 && mSelectedSector < int(mLevel.sectors.size())) {
-        auto sector = mLevel.sectors[mSelectedSector];
+    if (mSelectedSector >= 0 && mSelectedSector < int(map.sectors.size())) {
+        uint32_t sector = uint32_t(mSelectedSector);
+        uint32_t first = map.sectors[sector].firstPoint;
+        uint32_t count = map.sectors[sector].pointCount;
 
         ImGui::Button("Drag Sector");
         if (ImGui::IsItemActive()) {
             ImVec2 value = ImGui::GetIO().MouseDelta;
-            for (const auto& pt : sector->points) {
-                auto adjacentPoint = pt->adjacentPoint.lock();
-                if (adjacentPoint) {
-                    adjacentPoint->pos.x += value.x;
-                    adjacentPoint->pos.y += value.y;
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t adjacentPoint = map.walls[i].adjacentPoint;
+                if (adjacentPoint != LevelMap::NONE) {
+                    map.points[adjacentPoint].pos.x += value.x;
+                    map.points[adjacentPoint].pos.y += value.y;
+                    map.invalidatePoint(adjacentPoint);
                 }
-                pt->pos.x += value.x;
-                pt->pos.y += value.y;
+                map.points[i].pos.x += value.x;
+                map.points[i].pos.y += value.y;
             }
+            refitSectorAndNeighbours(sector);
         }
 
         ImGui::Button("Raise/Lower Sector Floor");
         if (ImGui::IsItemActive()) {
             ImVec2 value = ImGui::GetIO().MouseDelta;
-            for (const auto& pt : sector->points) {
-                auto adjacentPoint = pt->adjacentPoint.lock();
-                if (adjacentPoint)
-                    adjacentPoint->minZ += value.y;
-                pt->minZ += value.y;
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t adjacentPoint = map.walls[i].adjacentPoint;
+                if (adjacentPoint != LevelMap::NONE)
+                    map.points[adjacentPoint].minZ += value.y;
+                map.points[i].minZ += value.y;
             }
+            refitSectorAndNeighbours(sector);
         }
 
         ImGui::Button("Raise/Lower Sector Ceiling");
         if (ImGui::IsItemActive()) {
             ImVec2 value = ImGui::GetIO().MouseDelta;
-            for (const auto& pt : sector->points) {
-                auto adjacentPoint = pt->adjacentPoint.lock();
-                if (adjacentPoint)
-                    adjacentPoint->maxZ += value.y;
-                pt->maxZ += value.y;
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t adjacentPoint = map.walls[i].adjacentPoint;
+                if (adjacentPoint != LevelMap::NONE)
+                    map.points[adjacentPoint].maxZ += value.y;
+                map.points[i].maxZ += value.y;
             }
+            refitSectorAndNeighbours(sector);
         }
 
-        static std::string buffer;
         auto listboxGetter = [](void* data, int n, const char** p) -> bool {
                 LevelEditor* self = reinterpret_cast<LevelEditor*>(data);
-                const auto& sector = self->mLevel.sectors[self->mSelectedSector];
-                const auto& point = sector->points[size_t(n)];
-                std::stringstream ss;
-                ss << n << " (" << point->pos.x << "; " << point->pos.y << ')';
-                auto adjacentSector = point->adjacentSector.lock();
-                if (adjacentSector) {
-                    for (size_t i = 0; i < self->mLevel.sectors.size(); i++) {
-                        if (self->mLevel.sectors[i] == adjacentSector) {
-                            ss << " => " << i;
-                            break;
-                        }
-                    }
-                }
-                buffer = ss.str();
-                *p = buffer.c_str();
+                const auto& map = self->mLevel.map;
+                uint32_t index = map.sectors[self->mSelectedSector].firstPoint + uint32_t(n);
+                const auto& point = map.points[index];
+                uint32_t adjacentSector = map.walls[index].adjacentSector;
+                if (adjacentSector != LevelMap::NONE)
+                    *p = frameArenaFormat("%d (%g; %g) => %u", n, point.pos.x, point.pos.y, unsigned(adjacentSector));
+                else
+                    *p = frameArenaFormat("%d (%g; %g)", n, point.pos.x, point.pos.y);
                 return true;
             };
-        ImGui::ListBox("Points", &mSelectedPoint, listboxGetter, this, int(sector->points.size()), 5);
+        ImGui::ListBox("Points", &mSelectedPoint, listboxGetter, this, int(count), 5);
 
-        if (mSelectedPoint >= 0 && mSelectedPoint < int(sector->points.size())) {
-            size_t nextSelectedPoint = size_t(mSelectedPoint + 1) % sector->points.size();
-            auto point = sector->points[size_t(mSelectedPoint)];
-            auto nextPoint = sector->points[nextSelectedPoint];
+        if (mSelectedPoint >= 0 && mSelectedPoint < int(count)) {
+            uint32_t point = first + uint32_t(mSelectedPoint);
+            uint32_t nextPoint = first + uint32_t(mSelectedPoint + 1) % count;
 
             if (ImGui::Button("New Point")) {
-                auto newPoint = std::make_shared<Level::Point>();
-                newPoint->pos = point->pos + (nextPoint->pos - point->pos) * 0.5f;
-                newPoint->minZ = point->minZ + (nextPoint->minZ - point->minZ) * 0.5f;
-                newPoint->maxZ = point->maxZ + (nextPoint->maxZ - point->maxZ) * 0.5f;
+                const auto& p1 = map.points[point];
+                const auto& p2 = map.points[nextPoint];
+                LevelMap::Point newPoint;
+                newPoint.pos = p1.pos + (p2.pos - p1.pos) * 0.5f;
+                newPoint.minZ = p1.minZ + (p2.minZ - p1.minZ) * 0.5f;
+                newPoint.maxZ = p1.maxZ + (p2.maxZ - p1.maxZ) * 0.5f;
                 ++mSelectedPoint;
-                sector->points.emplace(sector->points.begin() + mSelectedPoint, std::move(newPoint));
+                map.insertPoint(sector, uint32_t(mSelectedPoint), newPoint);
+                point = first + uint32_t(mSelectedPoint);
+                nextPoint = map.nextPoint(point);
+                count = map.sectors[sector].pointCount;
+                mBvhDirty = true;
             }
 
-            auto adjacentSector = point->adjacentSector.lock();
-            auto adjacentPoint = point->adjacentPoint.lock();
-            auto nextAdjacentSector = nextPoint->adjacentSector.lock();
-            auto nextAdjacentPoint = nextPoint->adjacentPoint.lock();
-            if (!adjacentSector && !adjacentPoint && !nextAdjacentSector && !nextAdjacentPoint && ImGui::Button("New Adjacent Sector")) {
-                auto d = nextPoint->pos - point->pos;
+            uint32_t adjacentSector = map.walls[point].adjacentSector;
+            uint32_t adjacentPoint = map.walls[point].adjacentPoint;
+            uint32_t nextAdjacentSector = map.walls[nextPoint].adjacentSector;
+            uint32_t nextAdjacentPoint = map.walls[nextPoint].adjacentPoint;
+            if (adjacentSector == LevelMap::NONE && adjacentPoint == LevelMap::NONE
+                    && nextAdjacentSector == LevelMap::NONE && nextAdjacentPoint == LevelMap::NONE
+                    && ImGui::Button("New Adjacent Sector")) {
+                LevelMap::Point p1 = map.points[point];
+                LevelMap::Point p2 = map.points[nextPoint];
+                auto d = p2.pos - p1.pos;
                 auto normal = glm::vec2(d.y, -d.x);
 
-                auto newSector = std::make_shared<Level::Sector>();
-                auto anp = std::make_shared<Level::Point>(nextPoint->pos, nextPoint->minZ, nextPoint->maxZ, sector, nextPoint);
-                newSector->points.emplace_back(anp);
-                auto ap = std::make_shared<Level::Point>(point->pos, point->minZ, point->maxZ, nullptr, point);
-                newSector->points.emplace_back(ap);
-                newSector->points.emplace_back(std::make_shared<Level::Point>(point->pos + normal, point->minZ, point->maxZ));
-                newSector->points.emplace_back(std::make_shared<Level::Point>(nextPoint->pos + normal, nextPoint->minZ, nextPoint->maxZ));
-                mSelectedSector = int(mLevel.sectors.size());
+                uint32_t newSector = map.addSector(4);
+                uint32_t anp = map.sectors[newSector].firstPoint;
+                uint32_t ap = anp + 1;
+                map.points[anp] = p2;
+                map.walls[anp].adjacentSector = sector;
+                map.walls[anp].adjacentPoint = nextPoint;
+                map.points[ap] = p1;
+                map.walls[ap].adjacentPoint = point;
+                map.points[ap + 1] = LevelMap::Point(p1.pos + normal, p1.minZ, p1.maxZ);
+                map.points[ap + 2] = LevelMap::Point(p2.pos + normal, p2.minZ, p2.maxZ);
+                mSelectedSector = int(newSector);
                 mSelectedPoint = 0;
-                mLevel.sectors.emplace_back(newSector);
 
-                point->adjacentSector = newSector;
-                point->adjacentPoint = ap;
-                nextPoint->adjacentPoint = anp;
+                map.walls[point].adjacentSector = newSector;
+                map.walls[point].adjacentPoint = ap;
+                map.walls[nextPoint].adjacentPoint = anp;
+                mBvhDirty = true;
             }
 
-            if (ImGui::DragFloat2("Pos", &point->pos[0], 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max())) {
-                if (adjacentPoint)
-                    adjacentPoint->pos = point->pos;
+            auto& p = map.points[point];
+            if (ImGui::DragFloat2("Pos", &p.pos[0], 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max())) {
+                map.invalidatePoint(point);
+                if (adjacentPoint != LevelMap::NONE) {
+                    map.points[adjacentPoint].pos = p.pos;
+                    map.invalidatePoint(adjacentPoint);
+                }
+                refitSectorAndNeighbours(sector);
             }
 
-            ImGui::DragFloat("MinZ", &point->minZ, 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-            ImGui::DragFloat("MaxZ", &point->maxZ, 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+            if (ImGui::DragFloat("MinZ", &p.minZ, 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max()))
+                refitSectorAndNeighbours(sector);
+            if (ImGui::DragFloat("MaxZ", &p.maxZ, 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max()))
+                refitSectorAndNeighbours(sector);
 
-            if (sector->points.size() > 3) {
-                if (!adjacentPoint && !adjacentSector && ImGui::Button("Delete point"))
-                    sector->points.erase(sector->points.begin() + mSelectedPoint);
+            if (count > 3) {
+                if (adjacentPoint == LevelMap::NONE && adjacentSector == LevelMap::NONE && ImGui::Button("Delete point")) {
+                    map.erasePoint(point);
+                    mBvhDirty = true;
+                }
             }
         }
 
-        if (mLevel.sectors.size() > 1) {
-            if (ImGui::Button("Delete sector"))
-                mLevel.sectors.erase(mLevel.sectors.begin() + mSelectedSector);
+        if (map.sectors.size() > 1) {
+            if (ImGui::Button("Delete sector")) {
+                map.eraseSector(sector);
+                mBvhDirty = true;
+            }
         }
     }
 
     auto listboxGetter2 = [](void* data, int n, const char** p) -> bool {
-            const auto& mesh = reinterpret_cast<LevelEditor*>(data)->mLevel.meshes[size_t(n)];
-            buffer = fmt() << mesh->meshName << ' ' << n;
-            *p = buffer.c_str();
+            const auto& mesh = reinterpret_cast<LevelEditor*>(data)->mLevel.map.meshes[size_t(n)];
+            const std::string& name = assetName(mesh->meshId);
+            size_t length = std::min(name.rfind('.'), name.length());
+            *p = frameArenaFormat("%.*s %d", int(length), name.c_str(), n);
             return true;
         };
-    if (ImGui::ListBox("Meshes", &mSelectedMesh, listboxGetter2, this, int(mLevel.meshes.size()), 10)) {
+    if (ImGui::ListBox("Meshes", &mSelectedMesh, listboxGetter2, this, int(map.meshes.size()), 10)) {
         mSelectedSector = -1;
         mSelectedPoint = -1;
     }
 
     ImGui::InputText("Name", mMeshFile, sizeof(mMeshFile));
     if (ImGui::Button("Create Mesh")) {
-        auto staticMesh = std::make_shared<Level::StaticMesh>();
-        staticMesh->meshName = mMeshFile;
+        auto staticMesh = std::make_shared<LevelMap::StaticMesh>();
+        staticMesh->setMeshName(mMeshFile, strlen(mMeshFile));
         staticMesh->loadMesh();
         staticMesh->calcMatrix();
-        mSelectedMesh = int(mLevel.meshes.size());
-        mLevel.meshes.emplace_back(std::move(staticMesh));
+        mSelectedMesh = int(map.meshes.size());
+        map.meshes.emplace_back(std::move(staticMesh));
+        mBvhDirty = true;
     }
 
-    if (mSelectedMesh >= 0 && mSelectedMesh < int(mLevel.meshes.size())) {
-        auto mesh = mLevel.meshes[mSelectedMesh];
+    if (mSelectedMesh >= 0 && mSelectedMesh < int(map.meshes.size())) {
+        auto mesh = map.meshes[mSelectedMesh];
         bool recalcMatrix = false;
 
         if (ImGui::Button("Clone Mesh")) {
-            mSelectedMesh = int(mLevel.meshes.size());
-            mLevel.meshes.emplace_back(std::make_shared<Level::StaticMesh>(*mesh));
+            mSelectedMesh = int(map.meshes.size());
+            map.meshes.emplace_back(std::make_shared<LevelMap::StaticMesh>(*mesh));
+            mBvhDirty = true;
         }
 
         if (ImGui::DragFloat3("Pos", &mesh->pos[0], 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max()))
@@ -360,11 +408,15 @@ void LevelEditor::run(double time, int width, int height)
         if (ImGui::DragFloat3("Scl", &mesh->scale[0], 0.1f, 0.1f, std::numeric_limits<float>::max()))
             recalcMatrix = true;
 
-        if (recalcMatrix)
+        if (recalcMatrix) {
             mesh->calcMatrix();
+            refitMesh(size_t(mSelectedMesh));
+        }
 
-        if (ImGui::Button("Delete Mesh"))
-            mLevel.meshes.erase(mLevel.meshes.begin() + mSelectedMesh);
+        if (ImGui::Button("Delete Mesh")) {
+            map.meshes.erase(map.meshes.begin() + mSelectedMesh);
+            mBvhDirty = true;
+        }
     }
 
     ImGui::End();
@@ -374,3 +426,167 @@ void LevelEditor::run(double time, int width, int height)
         delete this;
     }
 }
+
+static void getMeshBounds(const LevelMap::StaticMesh& staticMesh, glm::vec3& bboxMin, glm::vec3& bboxMax)
+{
+    const auto& mesh = *staticMesh.mesh;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 p;
+        p.x = (i & 1 ? mesh.bboxMax.x : mesh.bboxMin.x);
+        p.y = (i & 2 ? mesh.bboxMax.y : mesh.bboxMin.y);
+        p.z = (i & 4 ? mesh.bboxMax.z : mesh.bboxMin.z);
+        p = glm::vec3(staticMesh.matrix * glm::vec4(p, 1.0f));
+        bboxMin = (i == 0 ? p : glm::min(bboxMin, p));
+        bboxMax = (i == 0 ? p : glm::max(bboxMax, p));
+    }
+}
+
+// Calls func(a, b, c, id) for the wall and floor triangles of the sector, always in the same order.
+template <typename FUNC> static void forEachSectorTriangle(const LevelMap& map, uint32_t sector, FUNC&& func)
+{
+    uint32_t first = map.sectors[sector].firstPoint;
+    uint32_t n = map.sectors[sector].pointCount;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t i1 = first + i;
+        uint32_t i2 = first + (i + 1) % n;
+        const auto& p1 = map.points[i1];
+        const auto& p2 = map.points[i2];
+        float top1 = p1.maxZ;
+        float top2 = p2.maxZ;
+
+        // Portals are open except for the step up to the adjacent floor
+        const auto& wall = map.walls[i1];
+        if (wall.adjacentSector != LevelMap::NONE) {
+            uint32_t ap1 = wall.adjacentPoint;
+            uint32_t ap2 = map.walls[i2].adjacentPoint;
+            if (ap1 == LevelMap::NONE || ap2 == LevelMap::NONE)
+                continue;
+            top1 = map.points[ap1].minZ;
+            top2 = map.points[ap2].minZ;
+            if (top1 < p1.minZ || top2 < p2.minZ)
+                continue;
+        }
+
+        glm::vec3 a(p1.pos, p1.minZ), b(p1.pos, top1), c(p2.pos, p2.minZ), d(p2.pos, top2);
+        func(a, b, c, PICK_WALL | i1);
+        func(c, b, d, PICK_WALL | i1);
+    }
+
+    const auto* points = &map.points[first];
+    const auto& triangles = map.floorTriangles(sector);
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        const auto& p1 = points[triangles[i]];
+        const auto& p2 = points[triangles[i + 1]];
+        const auto& p3 = points[triangles[i + 2]];
+        func(glm::vec3(p1.pos, p1.minZ), glm::vec3(p2.pos, p2.minZ), glm::vec3(p3.pos, p3.minZ), PICK_FLOOR | sector);
+    }
+}
+
+void LevelEditor::rebuildBvh()
+{
+    const auto& map = mLevel.map;
+    mBvh.clear();
+
+    mSectorPrimitives.clear();
+    for (uint32_t s = 0; s < uint32_t(map.sectors.size()); s++) {
+        mSectorPrimitives.emplace_back(uint32_t(mBvh.primitives.size()));
+        forEachSectorTriangle(map, s, [this](const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32_t id) {
+                mBvh.addTriangle(a, b, c, id);
+            });
+    }
+    mSectorPrimitives.emplace_back(uint32_t(mBvh.primitives.size()));
+
+    mMeshPrimitives.clear();
+    for (size_t i = 0; i < map.meshes.size(); i++) {
+        glm::vec3 bboxMin, bboxMax;
+        getMeshBounds(*map.meshes[i], bboxMin, bboxMax);
+        mMeshPrimitives.emplace_back(mBvh.addBox(bboxMin, bboxMax, PICK_MESH | uint32_t(i)));
+    }
+
+    mBvh.build();
+    mBvhDirty = false;
+}
+
+void LevelEditor::refitSector(uint32_t sector)
+{
+    if (mBvhDirty || sector + 1 >= mSectorPrimitives.size())
+        return;
+
+    uint32_t index = mSectorPrimitives[sector];
+    uint32_t end = mSectorPrimitives[sector + 1];
+    forEachSectorTriangle(mLevel.map, sector, [this, &index, end](const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32_t) {
+            if (index < end)
+                mBvh.setTriangle(index, a, b, c);
+            ++index;
+        });
+
+    // A portal got or lost its step, or the floor triangulation changed
+    if (index != end)
+        mBvhDirty = true;
+}
+
+void LevelEditor::refitSectorAndNeighbours(uint32_t sector)
+{
+    // Portal walls of the neighbours step up to the floor of this sector
+    const auto& map = mLevel.map;
+    refitSector(sector);
+    uint32_t first = map.sectors[sector].firstPoint;
+    for (uint32_t i = first; i < first + map.sectors[sector].pointCount; i++) {
+        uint32_t adjacentSector = map.walls[i].adjacentSector;
+        if (adjacentSector != LevelMap::NONE)
+            refitSector(adjacentSector);
+    }
+}
+
+void LevelEditor::refitMesh(size_t index)
+{
+    if (mBvhDirty || index >= mMeshPrimitives.size())
+        return;
+
+    glm::vec3 bboxMin, bboxMax;
+    getMeshBounds(*mLevel.map.meshes[index], bboxMin, bboxMax);
+
+    const auto& primitive = mBvh.primitives[mMeshPrimitives[index]];
+    if (primitive.bboxMin != bboxMin || primitive.bboxMax != bboxMax)
+        mBvh.setBox(mMeshPrimitives[index], bboxMin, bboxMax);
+}
+
+void LevelEditor::pick(const glm::vec3& origin, const glm::vec3& direction)
+{
+    auto& map = mLevel.map;
+
+    if (mBvhDirty)
+        rebuildBvh();
+    else {
+        // Meshes that were still loading at the last build have got their bounds since
+        for (size_t i = 0; i < mMeshPrimitives.size(); i++)
+            refitMesh(i);
+    }
+
+    BvhHit hit;
+    if (!mBvh.raycast(origin, direction, hit))
+        return;
+
+    uint32_t index = hit.id & ~PICK_TYPE_MASK;
+    switch (hit.id & PICK_TYPE_MASK) {
+        case PICK_WALL: {
+            uint32_t sector = map.sectorOfPoint(index);
+            mSelectedSector = int(sector);
+            mSelectedPoint = int(index - map.sectors[sector].firstPoint);
+            mSelectedMesh = -1;
+            break;
+        }
+
+        case PICK_FLOOR:
+            mSelectedSector = int(index);
+            mSelectedPoint = 0;
+            mSelectedMesh = -1;
+            break;
+
+        case PICK_MESH:
+            mSelectedSector = -1;
+            mSelectedPoint = -1;
+            mSelectedMesh = int(index);
+            break;
+    }
+}
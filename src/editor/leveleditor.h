@@ -19,6 +19,7 @@
 #define LEVELEDITOR_H
 
 #include "menu/gamescreen.h"
+#include "engine/bvh.h"
 #include "engine/mesh.h"
 #include "level.h"
 
@@ -28,7 +29,7 @@ public:
     explicit LevelEditor(const std::string& file = std::string());
     ~LevelEditor();
 
-    void run(double time, int width, int height) override;
+    void render(double alpha, int width, int height) override;
 
 private:
     std::string mFile;
@@ -42,6 +43,16 @@ private:
     glm::vec3 mCameraPosition;
     bool mCullFace;
     char mMeshFile[1024];
+    Bvh mBvh;
+    std::vector<uint32_t> mSectorPrimitives;
+    std::vector<uint32_t> mMeshPrimitives;
+    bool mBvhDirty;
+
+    void rebuildBvh();
+    void refitSector(uint32_t sector);
+    void refitSectorAndNeighbours(uint32_t sector);
+    void refitMesh(size_t index);
+    void pick(const glm::vec3& origin, const glm::vec3& direction);
 };
 
 #endif
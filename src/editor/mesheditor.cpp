@@ -19,7 +19,10 @@
 #include "game.h"
 #include "menu/mainmenu.h"
 #include "engine/draw.h"
+#include "engine/framearena.h"
 #include "engine/gui.h"
+#include "engine/memtrack.h"
+#include "engine/resource.h"
 #include "engine/util.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <limits>
@@ -31,11 +34,13 @@ MeshEditor::MeshEditor(const std::string& file)
     , mCameraHorzRotation(0.0f)
     , mCameraVertRotation(0.0f)
     , mCameraPosition(0.0f)
+    , mBvhDirty(true)
 {
-    if (!fileExists(mFile))
-        mMesh = std::make_shared<Mesh>();
-    else {
-        mMesh = meshGetCached(mFile);
+    // The editor works on a mesh of its own: the cached one is shared with levels, which should not
+    // see the preview geometry
+    mMesh = std::make_shared<Mesh>();
+    if (fileExists(mFile)) {
+        mMesh->load(mFile);
         mCameraDistance = std::max(glm::length(mMesh->bboxSize), 2.0f);
     }
 }
@@ -44,8 +49,10 @@ MeshEditor::~MeshEditor()
 {
 }
 
-void MeshEditor::run(double time, int width, int height)
+void MeshEditor::render(double alpha, int width, int height)
 {
+    MemTagScope tag(MemTag_Editor);
+
     glm::vec3 cameraOffset = glm::vec3(
         mCameraDistance * sinf(glm::radians(mCameraHorzRotation)) * cosf(glm::radians(mCameraVertRotation)),
         mCameraDistance * sinf(glm::radians(mCameraVertRotation)),
@@ -75,6 +82,13 @@ void MeshEditor::run(double time, int width, int height)
 
     drawMesh(*mMesh);
 
+    if (ImGui::IsMouseClicked(0) && !ImGui::GetIO().WantCaptureMouse) {
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        glm::vec3 origin, direction;
+        drawGetRay(glm::vec2(mouse.x, mouse.y), glm::vec2(float(width), float(height)), origin, direction);
+        pick(origin, direction);
+    }
+
     drawEnd();
 
     bool windowVisible = true;
@@ -84,9 +98,24 @@ void MeshEditor::run(double time, int width, int height)
         return;
     }
 
-    if (ImGui::Button("Save"))
+    if (ImGui::Button("Save")) {
         mMesh->save(mFile);
 
+        Mesh baked;
+        baked.load(mFile);
+
+        std::string prepared = changeFileExtension(mFile, ".meshb");
+        if (fileExists(prepared))
+            baked.saveBaked(prepared);
+
+        // Levels that use the mesh pick up the saved version; a load still in flight read the old file
+        auto cached = resourceFind<Mesh>(Resource_Mesh, assetIntern(mFile));
+        if (cached) {
+            *cached = std::move(baked);
+            cached->loading = false;
+        }
+    }
+
     ImGui::BeginGroup();
     ImGui::PushID("Camera");
 
@@ -118,11 +147,9 @@ void MeshEditor::run(double time, int width, int height)
     while (mCameraHorzRotation >= 360.0f)
         mCameraHorzRotation -= 360.0f;
 
-    static std::string buffer;
     auto listboxGetter = [](void* data, int n, const char** p) -> bool {
             auto object = reinterpret_cast<MeshEditor*>(data)->mMesh->objects[size_t(n)].get();
-            buffer = fmt() << '[' << object->typeString() << "] " << n;
-            *p = buffer.c_str();
+            *p = frameArenaFormat("[%s] %d", object->typeString(), n);
             return true;
         };
     ImGui::ListBox("Objects", &mSelectedObject, listboxGetter, this, int(mMesh->objects.size()), 16);
@@ -135,6 +162,7 @@ void MeshEditor::run(double time, int width, int height)
         object->p2 = glm::vec3(1.0f);
         mSelectedObject = int(mMesh->objects.size());
         mMesh->objects.emplace_back(std::move(object));
+        mBvhDirty = true;
         bake = true;
     }
 
@@ -145,11 +173,12 @@ void MeshEditor::run(double time, int width, int height)
             auto newObject = std::unique_ptr<Mesh::Object>(object->clone());
             mSelectedObject = int(mMesh->objects.size());
             mMesh->objects.emplace_back(std::move(newObject));
+            mBvhDirty = true;
             bake = true;
         }
 
         if (ImGui::DragFloat3("Pos", &object->position[0], 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max()))
-            bake = true;
+            object->dirty = true;
 
         if (ImGui::DragFloat3("Rot", &object->rotation[0], 1.0f, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max())) {
             for (size_t i = 0; i < 3; i++) {
@@ -158,23 +187,78 @@ void MeshEditor::run(double time, int width, int height)
                 while (object->rotation[i] >= 360.0f)
                     object->rotation[i] -= 360.0f;
             }
-            bake = true;
+            object->dirty = true;
         }
 
         if (ImGui::DragFloat3("Scl", &object->scale[0], 0.1f, 0.1f, std::numeric_limits<float>::max()))
-            bake = true;
+            object->dirty = true;
 
         if (ImGui::ColorEdit3("Color", &object->color[0]))
+            object->dirty = true;
+
+        if (object->dirty)
             bake = true;
     }
 
     ImGui::End();
 
-    if (bake)
-        mMesh->bake();
+    if (bake) {
+        mMesh->bakeIncremental();
+        if (mSelectedObject >= 0 && mSelectedObject < int(mMesh->objects.size()))
+            refitObject(size_t(mSelectedObject));
+    }
 
     if (!windowVisible) {
         gameSetScreen(mainMenu);
         delete this;
     }
 }
+
+void MeshEditor::rebuildBvh()
+{
+    // Picking needs the vertex ranges of the objects
+    if (!mMesh->preview)
+        mMesh->bakeIncremental();
+
+    mBvh.clear();
+    mObjectPrimitives.clear();
+
+    for (size_t i = 0; i < mMesh->objects.size(); i++) {
+        const auto& object = *mMesh->objects[i];
+        const auto* v = &mMesh->vertices[object.firstVertex];
+        mObjectPrimitives.emplace_back(uint32_t(mBvh.primitives.size()));
+        for (uint32_t j = 0; j + 2 < object.vertexCount; j += 3)
+            mBvh.addTriangle(v[j].position, v[j + 1].position, v[j + 2].position, uint32_t(i));
+    }
+    mObjectPrimitives.emplace_back(uint32_t(mBvh.primitives.size()));
+
+    mBvh.build();
+    mBvhDirty = false;
+}
+
+void MeshEditor::refitObject(size_t index)
+{
+    if (mBvhDirty || index + 1 >= mObjectPrimitives.size())
+        return;
+
+    const auto& object = *mMesh->objects[index];
+    uint32_t first = mObjectPrimitives[index];
+    if (mObjectPrimitives[index + 1] - first != object.vertexCount / 3) {
+        mBvhDirty = true;
+        return;
+    }
+
+    const auto* v = &mMesh->vertices[object.firstVertex];
+    for (uint32_t j = 0; j + 2 < object.vertexCount; j += 3)
+        mBvh.setTriangle(first + j / 3, v[j].position, v[j + 1].position, v[j + 2].position);
+}
+
+void MeshEditor::pick(const glm::vec3& origin, const glm::vec3& direction)
+{
+    if (mBvhDirty || !mMesh->preview)
+        rebuildBvh();
+
+    BvhHit hit;
+    if (mBvh.raycast(origin, direction, hit))
+        mSelectedObject = int(hit.id);
+}
@@ -19,6 +19,7 @@
 #define MESHEDITOR_H
 
 #include "menu/gamescreen.h"
+#include "engine/bvh.h"
 #include "engine/mesh.h"
 
 class MeshEditor : public GameScreen
@@ -27,7 +28,7 @@ public:
     explicit MeshEditor(const std::string& file = std::string());
     ~MeshEditor();
 
-    void run(double time, int width, int height) override;
+    void render(double alpha, int width, int height) override;
 
 private:
     std::string mFile;
@@ -37,6 +38,13 @@ private:
     float mCameraHorzRotation;
     float mCameraVertRotation;
     glm::vec3 mCameraPosition;
+    Bvh mBvh;
+    std::vector<uint32_t> mObjectPrimitives;
+    bool mBvhDirty;
+
+    void rebuildBvh();
+    void refitObject(size_t index);
+    void pick(const glm::vec3& origin, const glm::vec3& direction);
 };
 
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "assetid.h"
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Open addressing with linear probing; slots hold ids, 0 marks an empty slot.
+// Names live in a deque so that references returned by assetName() survive later insertions.
+static std::mutex mutex;
+static std::vector<AssetId> table;
+static std::deque<std::string> names(1);
+static std::vector<uint32_t> hashes(1);
+
+static uint32_t hashName(const char* name, size_t length, const char* suffix)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= uint8_t(name[i]);
+        hash *= 16777619u;
+    }
+    for (const char* p = suffix; *p; ++p) {
+        hash ^= uint8_t(*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool nameEquals(const std::string& str, const char* name, size_t length, const char* suffix)
+{
+    size_t suffixLength = strlen(suffix);
+    return str.length() == length + suffixLength
+        && memcmp(str.data(), name, length) == 0
+        && memcmp(str.data() + length, suffix, suffixLength) == 0;
+}
+
+static void insertSlot(AssetId id)
+{
+    size_t mask = table.size() - 1;
+    size_t slot = hashes[id] & mask;
+    while (table[slot] != NO_ASSET)
+        slot = (slot + 1) & mask;
+    table[slot] = id;
+}
+
+static void growTable()
+{
+    table.assign(table.empty() ? 256 : table.size() * 2, NO_ASSET);
+    for (AssetId id = 1; id < names.size(); id++)
+        insertSlot(id);
+}
+
+AssetId assetIntern(const char* name, size_t length, const char* suffix)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Keep the load factor at or below 1/2 so that probe sequences stay short
+    if ((names.size() + 1) * 2 > table.size())
+        growTable();
+
+    uint32_t hash = hashName(name, length, suffix);
+    size_t mask = table.size() - 1;
+    for (size_t slot = hash & mask; table[slot] != NO_ASSET; slot = (slot + 1) & mask) {
+        AssetId id = table[slot];
+        if (hashes[id] == hash && nameEquals(names[id], name, length, suffix))
+            return id;
+    }
+
+    AssetId id = AssetId(names.size());
+    names.emplace_back(std::string(name, length) + suffix);
+    hashes.emplace_back(hash);
+    insertSlot(id);
+
+    return id;
+}
+
+AssetId assetIntern(const std::string& name)
+{
+    return assetIntern(name.data(), name.length());
+}
+
+const std::string& assetName(AssetId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return names[id];
+}
+
+size_t assetCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.size();
+}
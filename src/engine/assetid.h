@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef ASSETID_H
+#define ASSETID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Asset names are interned into small dense integers, so that caches can be indexed directly
+// and level data never has to compare strings. Ids stay valid until the program exits.
+// All functions are thread-safe: levels are built on the frame thread and loader workers look
+// names up. References returned by assetName() stay valid until the program exits as well.
+typedef uint32_t AssetId;
+
+static const AssetId NO_ASSET = 0;
+
+// Interns `name` followed by `suffix` (e.g. a file extension) without building the joined string
+// unless the name is new.
+AssetId assetIntern(const char* name, size_t length, const char* suffix = "");
+AssetId assetIntern(const std::string& name);
+
+const std::string& assetName(AssetId id);
+
+// Upper bound for ids handed out so far.
+size_t assetCount();
+
+#endif
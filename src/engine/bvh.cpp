@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "bvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const uint32_t NO_NODE = 0xFFFFFFFFu;
+static const int SAH_BINS = 16;
+static const uint32_t MAX_LEAF_SIZE = 8;
+static const float TRAVERSAL_COST = 1.0f;
+static const int STACK_SIZE = 64;
+
+static float surfaceArea(const glm::vec3& bboxMin, const glm::vec3& bboxMax)
+{
+    glm::vec3 d = glm::max(bboxMax - bboxMin, glm::vec3(0.0f));
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static glm::vec3 centroid(const Bvh::Primitive& primitive)
+{
+    return (primitive.bboxMin + primitive.bboxMax) * 0.5f;
+}
+
+static void calcNodeBounds(Bvh& bvh, Bvh::Node& node)
+{
+    node.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+    node.bboxMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (uint32_t i = 0; i < node.count; i++) {
+        const auto& primitive = bvh.primitives[bvh.order[node.first + i]];
+        node.bboxMin = glm::min(node.bboxMin, primitive.bboxMin);
+        node.bboxMax = glm::max(node.bboxMax, primitive.bboxMax);
+    }
+}
+
+static void subdivide(Bvh& bvh, uint32_t nodeIndex, int depth)
+{
+    Bvh::Node& node = bvh.nodes[nodeIndex];
+    calcNodeBounds(bvh, node);
+
+    uint32_t first = node.first;
+    uint32_t count = node.count;
+    // Deeper trees would overflow the traversal stack
+    if (count <= 1 || depth >= STACK_SIZE - 1)
+        return;
+
+    glm::vec3 centroidMin(std::numeric_limits<float>::max());
+    glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 c = centroid(bvh.primitives[bvh.order[first + i]]);
+        centroidMin = glm::min(centroidMin, c);
+        centroidMax = glm::max(centroidMax, c);
+    }
+
+    // Binned SAH: primitives are sorted into bins along each axis by their centroids and every
+    // boundary between bins is evaluated as a split plane
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+        uint32_t binCount[SAH_BINS] = {};
+        for (int i = 0; i < SAH_BINS; i++) {
+            binMin[i] = glm::vec3(std::numeric_limits<float>::max());
+            binMax[i] = glm::vec3(-std::numeric_limits<float>::max());
+        }
+
+        float scale = float(SAH_BINS) / extent;
+        for (uint32_t i = 0; i < count; i++) {
+            const auto& primitive = bvh.primitives[bvh.order[first + i]];
+            int bin = std::min(int((centroid(primitive)[axis] - centroidMin[axis]) * scale), SAH_BINS - 1);
+            ++binCount[bin];
+            binMin[bin] = glm::min(binMin[bin], primitive.bboxMin);
+            binMax[bin] = glm::max(binMax[bin], primitive.bboxMax);
+        }
+
+        float leftArea[SAH_BINS - 1];
+        uint32_t leftCount[SAH_BINS - 1];
+        glm::vec3 accMin(std::numeric_limits<float>::max()), accMax(-std::numeric_limits<float>::max());
+        uint32_t accCount = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            accCount += binCount[i];
+            accMin = glm::min(accMin, binMin[i]);
+            accMax = glm::max(accMax, binMax[i]);
+            leftArea[i] = (accCount > 0 ? surfaceArea(accMin, accMax) : 0.0f);
+            leftCount[i] = accCount;
+        }
+
+        accMin = glm::vec3(std::numeric_limits<float>::max());
+        accMax = glm::vec3(-std::numeric_limits<float>::max());
+        accCount = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            accCount += binCount[i];
+            accMin = glm::min(accMin, binMin[i]);
+            accMax = glm::max(accMax, binMax[i]);
+            if (leftCount[i - 1] == 0 || accCount == 0)
+                continue;
+
+            float cost = leftArea[i - 1] * float(leftCount[i - 1]) + surfaceArea(accMin, accMax) * float(accCount);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    float parentArea = surfaceArea(node.bboxMin, node.bboxMax);
+    float leafCost = float(count);
+    float splitCost = (parentArea > 0.0f ? TRAVERSAL_COST + bestCost / parentArea : leafCost);
+    if (bestAxis < 0 || (splitCost >= leafCost && count <= MAX_LEAF_SIZE))
+        return;
+
+    float scale = float(SAH_BINS) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    float minCoord = centroidMin[bestAxis];
+    auto middle = std::partition(bvh.order.begin() + first, bvh.order.begin() + first + count,
+        [&bvh, bestAxis, bestSplit, scale, minCoord](uint32_t index) {
+            float c = centroid(bvh.primitives[index])[bestAxis];
+            return std::min(int((c - minCoord) * scale), SAH_BINS - 1) < bestSplit;
+        });
+    uint32_t leftCount = uint32_t(middle - (bvh.order.begin() + first));
+
+    uint32_t left = uint32_t(bvh.nodes.size());
+    bvh.nodes.resize(bvh.nodes.size() + 2);
+    bvh.parents.resize(bvh.nodes.size(), nodeIndex);
+
+    bvh.nodes[left].first = first;
+    bvh.nodes[left].count = leftCount;
+    bvh.nodes[left + 1].first = first + leftCount;
+    bvh.nodes[left + 1].count = count - leftCount;
+
+    // `node` is invalidated by the resize above
+    bvh.nodes[nodeIndex].first = left;
+    bvh.nodes[nodeIndex].count = 0;
+
+    subdivide(bvh, left, depth + 1);
+    subdivide(bvh, left + 1, depth + 1);
+}
+
+void Bvh::clear()
+{
+    nodes.clear();
+    primitives.clear();
+    order.clear();
+    parents.clear();
+    leafOf.clear();
+}
+
+uint32_t Bvh::addTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32_t id)
+{
+    Primitive primitive;
+    primitive.isTriangle = true;
+    primitive.id = id;
+    primitives.emplace_back(primitive);
+
+    uint32_t index = uint32_t(primitives.size() - 1);
+    setTriangle(index, a, b, c);
+    return index;
+}
+
+uint32_t Bvh::addBox(const glm::vec3& bboxMin, const glm::vec3& bboxMax, uint32_t id)
+{
+    Primitive primitive;
+    primitive.isTriangle = false;
+    primitive.id = id;
+    primitives.emplace_back(primitive);
+
+    uint32_t index = uint32_t(primitives.size() - 1);
+    setBox(index, bboxMin, bboxMax);
+    return index;
+}
+
+void Bvh::build()
+{
+    nodes.clear();
+    parents.clear();
+    order.resize(primitives.size());
+    for (uint32_t i = 0; i < uint32_t(order.size()); i++)
+        order[i] = i;
+
+    if (primitives.empty())
+        return;
+
+    nodes.reserve(primitives.size() * 2);
+    nodes.resize(1);
+    parents.resize(1, NO_NODE);
+    nodes[0].first = 0;
+    nodes[0].count = uint32_t(primitives.size());
+    subdivide(*this, 0, 0);
+
+    leafOf.resize(primitives.size());
+    for (uint32_t i = 0; i < uint32_t(nodes.size()); i++) {
+        for (uint32_t j = 0; j < nodes[i].count; j++)
+            leafOf[order[nodes[i].first + j]] = i;
+    }
+}
+
+static void refit(Bvh& bvh, uint32_t primitive)
+{
+    if (primitive >= bvh.leafOf.size() || bvh.nodes.empty())
+        return;
+
+    uint32_t node = bvh.leafOf[primitive];
+    calcNodeBounds(bvh, bvh.nodes[node]);
+
+    for (node = bvh.parents[node]; node != NO_NODE; node = bvh.parents[node]) {
+        auto& parent = bvh.nodes[node];
+        const auto& left = bvh.nodes[parent.first];
+        const auto& right = bvh.nodes[parent.first + 1];
+        parent.bboxMin = glm::min(left.bboxMin, right.bboxMin);
+        parent.bboxMax = glm::max(left.bboxMax, right.bboxMax);
+    }
+}
+
+void Bvh::setTriangle(uint32_t index, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    auto& primitive = primitives[index];
+    primitive.triangle[0] = a;
+    primitive.triangle[1] = b;
+    primitive.triangle[2] = c;
+    primitive.bboxMin = glm::min(a, glm::min(b, c));
+    primitive.bboxMax = glm::max(a, glm::max(b, c));
+    refit(*this, index);
+}
+
+void Bvh::setBox(uint32_t index, const glm::vec3& bboxMin, const glm::vec3& bboxMax)
+{
+    auto& primitive = primitives[index];
+    primitive.bboxMin = bboxMin;
+    primitive.bboxMax = bboxMax;
+    refit(*this, index);
+}
+
+// Slab test; returns the entry distance or infinity on a miss
+static float intersectBox(const glm::vec3& origin, const glm::vec3& invDirection,
+    const glm::vec3& bboxMin, const glm::vec3& bboxMax, float maxDistance)
+{
+    glm::vec3 t1 = (bboxMin - origin) * invDirection;
+    glm::vec3 t2 = (bboxMax - origin) * invDirection;
+    glm::vec3 tmin = glm::min(t1, t2);
+    glm::vec3 tmax = glm::max(t1, t2);
+    float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxDistance));
+    return (enter <= exit ? enter : std::numeric_limits<float>::infinity());
+}
+
+// Moeller-Trumbore, both sides
+static float intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3 triangle[3])
+{
+    const float miss = std::numeric_limits<float>::infinity();
+
+    glm::vec3 e1 = triangle[1] - triangle[0];
+    glm::vec3 e2 = triangle[2] - triangle[0];
+    glm::vec3 p = glm::cross(direction, e2);
+    float det = glm::dot(e1, p);
+    if (fabsf(det) < 1e-12f)
+        return miss;
+
+    float invDet = 1.0f / det;
+    glm::vec3 s = origin - triangle[0];
+    float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return miss;
+
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return miss;
+
+    float t = glm::dot(e2, q) * invDet;
+    return (t >= 0.0f ? t : miss);
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, BvhHit& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invDirection = 1.0f / direction;
+    float closest = std::numeric_limits<float>::infinity();
+    uint32_t closestId = 0;
+
+    uint32_t stack[STACK_SIZE];
+    int stackSize = 0;
+
+    if (intersectBox(origin, invDirection, nodes[0].bboxMin, nodes[0].bboxMax, closest) == closest)
+        return false;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; i++) {
+                const auto& primitive = primitives[order[node.first + i]];
+                float t = (primitive.isTriangle
+                    ? intersectTriangle(origin, direction, primitive.triangle)
+                    : intersectBox(origin, invDirection, primitive.bboxMin, primitive.bboxMax, closest));
+                if (t < closest) {
+                    closest = t;
+                    closestId = primitive.id;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so that the farther one can be culled by the closest hit
+        uint32_t left = node.first;
+        uint32_t right = node.first + 1;
+        float tLeft = intersectBox(origin, invDirection, nodes[left].bboxMin, nodes[left].bboxMax, closest);
+        float tRight = intersectBox(origin, invDirection, nodes[right].bboxMin, nodes[right].bboxMax, closest);
+        if (tLeft > tRight) {
+            std::swap(tLeft, tRight);
+            std::swap(left, right);
+        }
+
+        if (tRight < closest)
+            stack[stackSize++] = right;
+        if (tLeft < closest)
+            stack[stackSize++] = left;
+    }
+
+    if (closest == std::numeric_limits<float>::infinity())
+        return false;
+
+    hit.distance = closest;
+    hit.id = closestId;
+    return true;
+}
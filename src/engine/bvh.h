@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct BvhHit
+{
+    float distance;         // in units of the ray direction
+    uint32_t id;
+};
+
+// Bounding volume hierarchy over triangles and boxes for ray queries. Nodes are built with the
+// surface area heuristic into a flat array; moving a primitive refits the bounds up to the root
+// without rebuilding, so call build() again after large changes.
+struct Bvh
+{
+    struct Node
+    {
+        glm::vec3 bboxMin;
+        uint32_t first;     // first primitive of a leaf or the left child (right one follows it)
+        glm::vec3 bboxMax;
+        uint32_t count;     // number of primitives, 0 for inner nodes
+    };
+
+    struct Primitive
+    {
+        glm::vec3 bboxMin;
+        glm::vec3 bboxMax;
+        glm::vec3 triangle[3];
+        bool isTriangle;    // boxes are hit anywhere within their bounds
+        uint32_t id;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Primitive> primitives;     // in the order of insertion
+    std::vector<uint32_t> order;            // primitive indices referenced by the leaves
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> leafOf;
+
+    void clear();
+
+    // Returns the index of the primitive for the set functions below.
+    uint32_t addTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32_t id);
+    uint32_t addBox(const glm::vec3& bboxMin, const glm::vec3& bboxMax, uint32_t id);
+
+    void build();
+
+    void setTriangle(uint32_t index, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+    void setBox(uint32_t index, const glm::vec3& bboxMin, const glm::vec3& bboxMax);
+
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, BvhHit& hit) const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "depthsort.h"
+#include "framearena.h"
+#include <cstring>
+#include <utility>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+static const int RADIX_BITS = 8;
+static const size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+static const int RADIX_PASSES = 32 / RADIX_BITS;
+
+// Unsigned integers that compare the same way as the floats
+static uint32_t floatKey(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t mask = uint32_t(int32_t(bits) >> 31) | 0x80000000u;
+    return bits ^ mask;
+}
+
+// View space z of every point. The camera looks along -z, so ascending z is back to front.
+static void computeKeys(const glm::mat4& m, const float* x, const float* y, const float* z, size_t count, uint32_t* keys)
+{
+    size_t i = 0;
+
+  #ifdef __SSE2__
+    const __m128 m0 = _mm_set1_ps(m[0][2]);
+    const __m128 m1 = _mm_set1_ps(m[1][2]);
+    const __m128 m2 = _mm_set1_ps(m[2][2]);
+    const __m128 m3 = _mm_set1_ps(m[3][2]);
+    const __m128i signBit = _mm_set1_epi32(int(0x80000000u));
+    for (; i + 4 <= count; i += 4) {
+        __m128 depth = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(m0, _mm_loadu_ps(x + i)), _mm_mul_ps(m1, _mm_loadu_ps(y + i))),
+            _mm_add_ps(_mm_mul_ps(m2, _mm_loadu_ps(z + i)), m3));
+        __m128i bits = _mm_castps_si128(depth);
+        __m128i mask = _mm_or_si128(_mm_srai_epi32(bits, 31), signBit);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i), _mm_xor_si128(bits, mask));
+    }
+  #endif
+
+    for (; i < count; i++)
+        keys[i] = floatKey(m[0][2] * x[i] + m[1][2] * y[i] + m[2][2] * z[i] + m[3][2]);
+}
+
+void depthSortBackToFront(const glm::mat4& viewMatrix,
+    const float* x, const float* y, const float* z, size_t count, uint32_t* order)
+{
+    if (count == 0)
+        return;
+
+    uint32_t* keys = static_cast<uint32_t*>(frameArenaAlloc(count * sizeof(uint32_t) * 3, alignof(uint32_t)));
+    uint32_t* tmpKeys = keys + count;
+    uint32_t* tmpOrder = tmpKeys + count;
+
+    computeKeys(viewMatrix, x, y, z, count, keys);
+
+    size_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+    for (size_t i = 0; i < count; i++) {
+        order[i] = uint32_t(i);
+        for (int pass = 0; pass < RADIX_PASSES; pass++)
+            ++histograms[pass][(keys[i] >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+    }
+
+    // Least significant digit first; every pass is stable. Digits that are the same in all keys are skipped.
+    uint32_t* srcKeys = keys;
+    uint32_t* srcOrder = order;
+    uint32_t* dstKeys = tmpKeys;
+    uint32_t* dstOrder = tmpOrder;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t* histogram = histograms[pass];
+        int shift = pass * RADIX_BITS;
+        if (histogram[(srcKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            size_t n = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t index = histogram[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            dstKeys[index] = srcKeys[i];
+            dstOrder[index] = srcOrder[i];
+        }
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcOrder, dstOrder);
+    }
+
+    if (srcOrder != order)
+        memcpy(order, srcOrder, count * sizeof(uint32_t));
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef DEPTHSORT_H
+#define DEPTHSORT_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Fills `order` with indices of the points, farthest from the camera first, for drawing blended objects.
+// The matrix takes points into view space. Points at the same depth keep their order. Runs in linear time:
+// depths are turned into integer keys and radix sorted. Scratch memory comes from the frame arena.
+void depthSortBackToFront(const glm::mat4& viewMatrix,
+    const float* x, const float* y, const float* z, size_t count, uint32_t* order);
+
+#endif
@@ -17,13 +17,19 @@
  */
 #include "opengl.h"
 #include "draw.h"
+#include "memtrack.h"
+#include "profiler.h"
 #include "util.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
 static const size_t VERTICES_PER_INDEX = 5;
 static const size_t MAX_RENDERTARGETS = 3;
+static const size_t MAX_BILLBOARDS_PER_DRAW = 0x10000 / 4;
 
 namespace
 {
@@ -33,27 +39,116 @@ namespace
         int attrPosition;
         int attrTexCoord;
         int attrColor;
+        int attrCorner;
+        int attrSize;
+        int attrAnchor;
         int uniformProjectionMatrix;
         int uniformTexture;
         int uniformRandomizerTexture;
         int uniformAuxTexture[MAX_RENDERTARGETS];
         int uniformViewportSize;
     };
+
+    enum CommandType
+    {
+        Command_Draw,
+        Command_FullscreenQuad,
+        Command_Viewport,
+        Command_Enable,
+        Command_Disable,
+        Command_DepthFunc,
+        Command_DepthMask,
+        Command_BlendFunc,
+        Command_Clear,
+        Command_BeginRenderToTexture,
+        Command_EndRenderToTexture,
+        Command_Callback,
+        Command_BeginPass,
+        Command_Billboards,
+    };
+
+    // Draws reference ranges of the draw list arrays (billboard draws use firstVertex and vertexCount for
+    // a range of `billboards`); other commands keep their arguments in `args`.
+    struct Command
+    {
+        CommandType type;
+        Shader shader;
+        GLuint texture;
+        GLenum primitiveType;
+        float lineWidth;
+        size_t projection;
+        size_t firstVertex;
+        size_t vertexCount;
+        size_t firstIndex;
+        size_t indexCount;
+        GLint args[2];
+        glm::vec4 clearColor;
+    };
+
+    // Center is in view space. The record is also the vertex format of billboards: the corner
+    // index comes from a static buffer of its own.
+    struct Billboard
+    {
+        glm::vec3 center;
+        glm::vec2 size;
+        glm::vec2 anchor;
+        uint32_t color;
+    };
+
+    struct DrawList
+    {
+        std::vector<Command> commands;
+        std::vector<glm::mat4> projections;
+        std::vector<std::function<void()>> callbacks;
+        std::vector<GLfloat> vertices;
+        std::vector<uint32_t> colors;
+        std::vector<GLushort> indices;
+        std::vector<Billboard> billboards;
+        // Cached textures may be evicted between recording and submission; the list keeps the ones it
+        // uses alive and releases them on the GL thread once submitted.
+        std::vector<std::shared_ptr<Texture>> textures;
+        DrawStats stats;
+    };
 }
 
+static const char* const passNames[DrawPassCount] = {
+        "other",
+        "geometry",
+        "ssao",
+        "blur",
+        "composite",
+        "gui",
+    };
+
 static GLuint dummyTexture;
 static GLuint ssaoRandomizerTexture;
 static GLuint vertexBuffer;
 static GLuint colorBuffer;
 static GLuint indexBuffer;
 static GLuint quadVertexBuffer;
+static GLuint billboardIndexBuffer;
+static GLuint billboardCornerBuffer;
+static std::vector<Billboard> billboardVertices;
 static ShaderInfo shaders[ShaderCount];
 
-static std::vector<GLfloat> vertices;
-static std::vector<uint32_t> colors;
-static std::vector<GLushort> indices;
+// One list is recorded while the other one is submitted
+static DrawList drawLists[2];
+static DrawList* recordList = &drawLists[0];
+static std::atomic<DrawList*> finishedList;
+static DrawList* submitList;
+
+// Batch being recorded: where it starts in the draw list and how much of it is complete primitives
+static size_t batchVertex;
+static size_t batchIndex;
 static size_t vertexCount;
 static size_t indexCount;
+static size_t billboardBatch;
+
+static DrawPass recordPass;
+static int64_t recordPassStart;
+static DrawStats submitStats;
+static DrawStats frameStats;
+
 static Shader currentShader = Shader_Default;
 static GLenum currentPrimitiveType;
 static GLuint currentTexture;
@@ -65,6 +160,7 @@ static int framebufferHeight = -1;
 static float currentLineWidth;
 
 static glm::mat4 projectionMatrix;
+static size_t currentProjection;
 static std::vector<std::pair<glm::vec4, uint32_t>> color;
 static std::vector<glm::mat4> modelViewMatrix;
 
@@ -81,6 +177,9 @@ static void loadShader(Shader shader, const std::string& vertex, const std::stri
     shaders[shader].attrPosition = glGetAttribLocation(shaders[shader].handle, "aPosition");
     shaders[shader].attrTexCoord = glGetAttribLocation(shaders[shader].handle, "aTexCoord");
     shaders[shader].attrColor = glGetAttribLocation(shaders[shader].handle, "aColor");
+    shaders[shader].attrCorner = glGetAttribLocation(shaders[shader].handle, "aCorner");
+    shaders[shader].attrSize = glGetAttribLocation(shaders[shader].handle, "aSize");
+    shaders[shader].attrAnchor = glGetAttribLocation(shaders[shader].handle, "aAnchor");
     shaders[shader].uniformProjectionMatrix = glGetUniformLocation(shaders[shader].handle, "uProjectionMatrix");
     shaders[shader].uniformTexture = glGetUniformLocation(shaders[shader].handle, "uTexture");
     shaders[shader].uniformRandomizerTexture = glGetUniformLocation(shaders[shader].handle, "uRandomizerTexture");
@@ -108,6 +207,30 @@ void drawInit()
         };
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadData), quadData, GL_STATIC_DRAW);
 
+    // Every billboard is four vertices, corners in the order (0, 0), (1, 0), (0, 1), (1, 1)
+    static const GLushort quadIndices[] = { 1, 0, 2, 1, 2, 3 };
+    std::vector<GLushort> billboardIndices;
+    billboardIndices.reserve(MAX_BILLBOARDS_PER_DRAW * 6);
+    for (size_t i = 0; i < MAX_BILLBOARDS_PER_DRAW; i++) {
+        GLushort first = GLushort(i * 4);
+        for (GLushort index : quadIndices)
+            billboardIndices.emplace_back(GLushort(first + index));
+    }
+
+    billboardIndexBuffer = openglCreateBuffer();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, billboardIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, billboardIndices.size() * sizeof(GLushort), billboardIndices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    std::vector<GLubyte> billboardCorners(MAX_BILLBOARDS_PER_DRAW * 4);
+    for (size_t i = 0; i < billboardCorners.size(); i++)
+        billboardCorners[i] = GLubyte(i & 3);
+
+    billboardCornerBuffer = openglCreateBuffer();
+    glBindBuffer(GL_ARRAY_BUFFER, billboardCornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, billboardCorners.size(), billboardCorners.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     const uint8_t whitePixel = 0xFF;
     dummyTexture = openglCreateTexture(NoRepeat, GL_NEAREST);
     glBindTexture(GL_TEXTURE_2D, dummyTexture);
@@ -129,10 +252,17 @@ void drawInit()
     loadShader(Shader_SSAO, "DrawSsaoV.glsl", "DrawSsaoF.glsl");
     loadShader(Shader_Blur, "DrawBlurV.glsl", "DrawBlurF.glsl");
     loadShader(Shader_FromFramebuffer, "DrawFromFramebufferV.glsl", "DrawFromFramebufferF.glsl");
+    loadShader(Shader_Billboard, "DrawBillboardV.glsl", "DrawDefaultF.glsl");
 }
 
 void drawShutdown()
 {
+    // The last recorded frame is never submitted
+    finishedList.store(nullptr);
+    submitList = nullptr;
+    for (auto& list : drawLists)
+        list.textures.clear();
+
     openglDeleteFramebuffer(framebuffer);
     openglDeleteRenderbuffer(renderbuffer);
     for (size_t i = 0; i < MAX_RENDERTARGETS; i++)
@@ -142,6 +272,8 @@ void drawShutdown()
     openglDeleteTexture(ssaoRandomizerTexture);
 
     openglDeleteBuffer(quadVertexBuffer);
+    openglDeleteBuffer(billboardIndexBuffer);
+    openglDeleteBuffer(billboardCornerBuffer);
     openglDeleteBuffer(vertexBuffer);
     openglDeleteBuffer(colorBuffer);
     openglDeleteBuffer(indexBuffer);
@@ -151,20 +283,117 @@ void drawShutdown()
     glDeleteProgram(shaders[Shader_SSAO].handle);
     glDeleteProgram(shaders[Shader_Blur].handle);
     glDeleteProgram(shaders[Shader_FromFramebuffer].handle);
+    glDeleteProgram(shaders[Shader_Billboard].handle);
 }
 
-void drawBegin(const glm::mat4& projMatrix)
+static Command& addCommand(CommandType type)
 {
-    vertices.clear();
-    colors.clear();
-    indices.clear();
+    recordList->commands.emplace_back(Command());
+    Command& command = recordList->commands.back();
+    command.type = type;
+    command.shader = currentShader;
+    command.texture = currentTexture;
+    command.primitiveType = currentPrimitiveType;
+    command.lineWidth = currentLineWidth;
+    command.projection = currentProjection;
+    return command;
+}
+
+static void addStateCommand(CommandType type, GLint arg0, GLint arg1 = 0)
+{
+    drawFlush();
+
+    Command& command = addCommand(type);
+    command.args[0] = arg0;
+    command.args[1] = arg1;
+}
+
+static size_t batchVertexCount()
+{
+    return recordList->vertices.size() / VERTICES_PER_INDEX - batchVertex;
+}
+
+static void startBatch()
+{
+    batchVertex = recordList->vertices.size() / VERTICES_PER_INDEX;
+    batchIndex = recordList->indices.size();
+    billboardBatch = recordList->billboards.size();
     vertexCount = 0;
     indexCount = 0;
+}
+
+void drawBeginFrame(int viewportWidth, int viewportHeight)
+{
+    MemTagScope tag(MemTag_Draw);
+
+    DrawList* list = (recordList == &drawLists[0] ? &drawLists[1] : &drawLists[0]);
+    list->commands.clear();
+    list->projections.clear();
+    list->callbacks.clear();
+    list->vertices.clear();
+    list->colors.clear();
+    list->indices.clear();
+    list->billboards.clear();
+    assert(list->textures.empty());     // released by drawSubmit()
+    list->stats = DrawStats();
+
+    recordList = list;
+    startBatch();
+
+    recordPass = DrawPass_Other;
+    recordPassStart = profilerTime();
+
+    currentProjection = 0;
+    list->projections.emplace_back(projectionMatrix);
+
+    addStateCommand(Command_Viewport, viewportWidth, viewportHeight);
+}
+
+void drawEndFrame()
+{
+    MemTagScope tag(MemTag_Draw);
+
+    drawFlush();
+    recordList->stats.buildTime[recordPass] += double(profilerTime() - recordPassStart) * 1e-9;
+    finishedList.store(recordList, std::memory_order_release);
+}
+
+void drawBeginPass(DrawPass pass)
+{
+    addStateCommand(Command_BeginPass, pass);
+
+    int64_t time = profilerTime();
+    recordList->stats.buildTime[recordPass] += double(time - recordPassStart) * 1e-9;
+    recordPass = pass;
+    recordPassStart = time;
+}
+
+const DrawStats& drawFrameStats()
+{
+    return frameStats;
+}
+
+const char* drawPassName(DrawPass pass)
+{
+    return passNames[pass];
+}
+
+void drawCountDrawCalls(unsigned drawCalls, unsigned vertices)
+{
+    submitStats.drawCalls += drawCalls;
+    submitStats.vertices += vertices;
+}
+
+void drawBegin(const glm::mat4& projMatrix)
+{
+    startBatch();
     currentPrimitiveType = 0;
     currentTexture = 0;
     currentLineWidth = 1.0f;
 
     projectionMatrix = projMatrix;
+    currentProjection = recordList->projections.size();
+    recordList->projections.emplace_back(projMatrix);
 
     modelViewMatrix.resize(1);
     modelViewMatrix[0] = glm::mat4(1.0f);
@@ -219,10 +448,58 @@ void drawPopColor()
         color.pop_back();
 }
 
-void drawBeginRenderToTexture(int n, bool clearDepth)
+void drawEnable(GLenum cap)
+{
+    addStateCommand(Command_Enable, GLint(cap));
+}
+
+void drawDisable(GLenum cap)
+{
+    addStateCommand(Command_Disable, GLint(cap));
+}
+
+void drawDepthFunc(GLenum func)
+{
+    addStateCommand(Command_DepthFunc, GLint(func));
+}
+
+void drawDepthMask(bool flag)
+{
+    addStateCommand(Command_DepthMask, flag ? GL_TRUE : GL_FALSE);
+}
+
+void drawBlendFunc(GLenum srcFactor, GLenum dstFactor)
+{
+    addStateCommand(Command_BlendFunc, GLint(srcFactor), GLint(dstFactor));
+}
+
+void drawClear(const glm::vec4& color, GLbitfield mask)
 {
     drawFlush();
 
+    Command& command = addCommand(Command_Clear);
+    command.args[0] = GLint(mask);
+    command.clearColor = color;
+}
+
+void drawCallback(std::function<void()> callback)
+{
+    addStateCommand(Command_Callback, GLint(recordList->callbacks.size()));
+    recordList->callbacks.emplace_back(std::move(callback));
+}
+
+void drawBeginRenderToTexture(int n, bool clearDepth)
+{
+    addStateCommand(Command_BeginRenderToTexture, n, clearDepth ? 1 : 0);
+}
+
+void drawEndRenderToTexture()
+{
+    addStateCommand(Command_EndRenderToTexture, 0);
+}
+
+static void beginRenderToTexture(int n, bool clearDepth)
+{
     GLint viewport[4] = { 0, 0, 0, 0 };
     glGetIntegerv(GL_VIEWPORT, viewport);
     int width = viewport[2];
@@ -251,13 +528,6 @@ void drawBeginRenderToTexture(int n, bool clearDepth)
     glClear(GL_COLOR_BUFFER_BIT | (clearDepth ? GL_DEPTH_BUFFER_BIT : 0));
 }
 
-void drawEndRenderToTexture()
-{
-    drawFlush();
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
 void drawSetShader(Shader shader)
 {
     if (shader != currentShader) {
@@ -274,6 +544,14 @@ void drawSetTexture(GLuint texture)
     }
 }
 
+void drawSetTexture(const std::shared_ptr<Texture>& texture)
+{
+    auto& textures = recordList->textures;
+    if (textures.empty() || textures.back() != texture)
+        textures.emplace_back(texture);
+    drawSetTexture(texture->handle);
+}
+
 void drawSetLineWidth(float width)
 {
     if (width != currentLineWidth) {
@@ -284,10 +562,11 @@ void drawSetLineWidth(float width)
 
 void drawSprite(const glm::vec2& pos, const glm::vec2& size, const glm::vec2& anchor, GLuint texture)
 {
+    drawSetTexture(texture);
+
     glm::vec2 p1 = pos - size * anchor;
     glm::vec2 p2 = p1 + size;
 
-    drawSetTexture(texture);
     drawBeginPrimitive(GL_TRIANGLES);
         GLushort v1 = drawVertex(glm::vec2(p1.x, p2.y), glm::vec2(0.0f, 1.0f));
         drawVertex(glm::vec2(p1.x, p1.y), glm::vec2(0.0f, 0.0f));
@@ -300,52 +579,118 @@ void drawSprite(const glm::vec2& pos, const glm::vec2& size, const glm::vec2& an
 
 void drawSprite(const glm::vec2& pos, const Sprite& sprite)
 {
-    drawSprite(pos, sprite.size, sprite.anchor, sprite.texture);
+    drawSetTexture(sprite.texture);
+    drawSprite(pos, sprite.size, sprite.anchor, sprite.texture->handle);
 }
 
 void drawBillboard(const glm::vec3& pos, const Sprite& sprite)
 {
-    const auto& vm = drawGetMatrix();
-    auto right = glm::vec3(vm[0][0], vm[1][0], vm[2][0]);
-    auto up = -glm::vec3(vm[0][1], vm[1][1], vm[2][1]);
+    drawSetTexture(sprite.texture);
 
-    glm::vec2 d1 = -sprite.size * sprite.anchor;
-    glm::vec2 d2 = d1 + sprite.size;
+    // Keep the order with triangles recorded before
+    if (vertexCount > 0 || indexCount > 0)
+        drawFlush();
 
-    glm::vec3 p1 = pos + right * d1.x + up * d1.y;
-    glm::vec3 p2 = pos + right * d2.x + up * d1.y;
-    glm::vec3 p3 = pos + right * d1.x + up * d2.y;
-    glm::vec3 p4 = pos + right * d2.x + up * d2.y;
+    auto& billboards = recordList->billboards;
+    if (billboards.size() - billboardBatch >= MAX_BILLBOARDS_PER_DRAW)
+        drawFlush();
 
-    drawSetTexture(sprite.texture);
-    drawBeginPrimitive(GL_TRIANGLES);
-        GLushort v1 = drawVertex3D(p2, glm::vec2(1.0f, 0.0f));
-        drawVertex3D(p1, glm::vec2(0.0f, 0.0f));
-        GLushort v2 = drawVertex3D(p3, glm::vec2(0.0f, 1.0f));
-        drawIndex(v1);
-        drawIndex(v2);
-        drawVertex3D(p4, glm::vec2(1.0f, 1.0f));
-    drawEndPrimitive();
+    assert(modelViewMatrix.size() > 0);
+    assert(color.size() > 0);
+    glm::vec4 center = modelViewMatrix.back() * glm::vec4(pos, 1.0f);
+    billboards.emplace_back(Billboard{ glm::vec3(center), sprite.size, sprite.anchor, color.back().second });
 }
 
-void drawMesh(const Mesh& mesh)
+static GLushort emitVertex(const glm::vec3& pos, const glm::vec2& texCoord, uint32_t rgba)
 {
+    auto& vertices = recordList->vertices;
+    auto& colors = recordList->colors;
+
+    GLushort index = GLushort(batchVertexCount());
+    assert(vertices.size() == colors.size() * VERTICES_PER_INDEX);
+
+    assert(modelViewMatrix.size() > 0);
+    glm::vec4 transformedPos = modelViewMatrix.back() * glm::vec4(pos, 1.0f);
+
+    vertices.emplace_back(transformedPos.x);
+    vertices.emplace_back(transformedPos.y);
+    vertices.emplace_back(transformedPos.z);
+    vertices.emplace_back(texCoord.x);
+    vertices.emplace_back(texCoord.y);
+    colors.emplace_back(rgba);
+
+    return index;
+}
+
+void drawMesh(const Mesh& mesh, size_t lod)
+{
+    if (lod >= mesh.lods.size())
+        return;
+
+    const auto& range = mesh.lods[lod];
+    const Mesh::Vertex* meshVertices = &mesh.vertices[range.firstVertex];
+    const uint16_t* meshIndices = &mesh.indices[range.firstIndex];
+
     drawSetTexture(0);
     drawPushColor(glm::vec4(1.0f));
     drawBeginPrimitive(GL_TRIANGLES);
 
-    for (const auto& v : mesh.vertices) {
-        color.back().second = v.color;
-        drawVertex3D(v.position);
+    size_t needed = range.vertexCount * VERTICES_PER_INDEX;
+    if (batchVertexCount() * VERTICES_PER_INDEX + needed >= 0xFFFF && vertexCount > 0)
+        drawFlush();
+
+    if (batchVertexCount() * VERTICES_PER_INDEX + needed < 0xFFFF) {
+        GLushort base = GLushort(batchVertexCount());
+        for (uint32_t i = 0; i < range.vertexCount; i++)
+            emitVertex(meshVertices[i].position, glm::vec2(0.0f), meshVertices[i].color);
+        for (uint32_t i = 0; i < range.indexCount; i++)
+            recordList->indices.emplace_back(GLushort(base + meshIndices[i]));
+    } else {
+        // Mesh does not fit into a single batch, draw it unindexed
+        for (uint32_t i = 0; i < range.indexCount; i++) {
+            const auto& v = meshVertices[meshIndices[i]];
+            color.back().second = v.color;
+            drawVertex3D(v.position);
+        }
     }
 
     drawEndPrimitive();
     drawPopColor();
 }
 
+float drawProjectedSize(const glm::vec3& center, float radius)
+{
+    assert(modelViewMatrix.size() > 0);
+    const glm::mat4& m = modelViewMatrix.back();
+
+    float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+    float distance = -(m * glm::vec4(center, 1.0f)).z;
+    radius *= scale;
+
+    // Camera is inside the sphere
+    if (distance <= radius)
+        return 1.0f;
+
+    return radius * projectionMatrix[1][1] / distance;
+}
+
+void drawGetRay(const glm::vec2& point, const glm::vec2& viewportSize, glm::vec3& origin, glm::vec3& direction)
+{
+    assert(modelViewMatrix.size() > 0);
+    glm::mat4 inverse = glm::inverse(projectionMatrix * modelViewMatrix.back());
+
+    float x = point.x / viewportSize.x * 2.0f - 1.0f;
+    float y = 1.0f - point.y / viewportSize.y * 2.0f;
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
 void drawBeginPrimitive(GLenum primitiveType)
 {
-    if (currentPrimitiveType != primitiveType) {
+    if (currentPrimitiveType != primitiveType || recordList->billboards.size() > billboardBatch) {
         drawFlush();
         currentPrimitiveType = primitiveType;
     }
@@ -353,8 +698,8 @@ void drawBeginPrimitive(GLenum primitiveType)
 
 void drawEndPrimitive()
 {
-    vertexCount = vertices.size() / VERTICES_PER_INDEX;
-    indexCount = indices.size();
+    vertexCount = batchVertexCount();
+    indexCount = recordList->indices.size() - batchIndex;
 }
 
 GLushort drawVertex(const glm::vec2& pos, const glm::vec2& texCoord)
@@ -364,39 +709,84 @@ GLushort drawVertex(const glm::vec2& pos, const glm::vec2& texCoord)
 
 GLushort drawVertex3D(const glm::vec3& pos, const glm::vec2& texCoord)
 {
-    if (vertices.size() + VERTICES_PER_INDEX >= 0xFFFF) {
+    if ((batchVertexCount() + 1) * VERTICES_PER_INDEX >= 0xFFFF) {
         assert(vertexCount > 0);
         drawFlush();
     }
 
-    GLushort index = GLushort(vertices.size()) / VERTICES_PER_INDEX;
-    assert(vertices.size() == colors.size() * VERTICES_PER_INDEX);
-
-    assert(modelViewMatrix.size() > 0);
-    glm::vec4 transformedPos = modelViewMatrix.back() * glm::vec4(pos, 1.0f);
-
     assert(color.size() > 0);
-    vertices.emplace_back(transformedPos.x);
-    vertices.emplace_back(transformedPos.y);
-    vertices.emplace_back(transformedPos.z);
-    vertices.emplace_back(texCoord.x);
-    vertices.emplace_back(texCoord.y);
-    colors.emplace_back(color.back().second);
-    indices.emplace_back(index);
+    GLushort index = emitVertex(pos, texCoord, color.back().second);
+    recordList->indices.emplace_back(index);
 
     return index;
 }
 
 void drawIndex(GLushort index)
 {
-    indices.emplace_back(index);
+    recordList->indices.emplace_back(index);
+}
+
+void drawFlush()
+{
+    PROFILE_SCOPE("drawFlush");
+
+    size_t billboardCount = recordList->billboards.size() - billboardBatch;
+    if (billboardCount > 0) {
+        Command& command = addCommand(Command_Billboards);
+        command.shader = Shader_Billboard;
+        command.firstVertex = billboardBatch;
+        command.vertexCount = billboardCount;
+        billboardBatch += billboardCount;
+    }
+
+    if (vertexCount > 0 || indexCount > 0) {
+        Command& command = addCommand(Command_Draw);
+        command.firstVertex = batchVertex;
+        command.vertexCount = vertexCount;
+        command.firstIndex = batchIndex;
+        command.indexCount = indexCount;
+
+        // Unfinished primitive moves to the next batch
+        auto& indices = recordList->indices;
+        for (size_t i = batchIndex + indexCount; i < indices.size(); i++)
+            indices[i] -= GLushort(vertexCount);
+
+        batchVertex += vertexCount;
+        batchIndex += indexCount;
+        vertexCount = 0;
+        indexCount = 0;
+    }
+}
+
+static void drawFullscreenQuad(Shader shaderId)
+{
+    drawFlush();
+
+    Command& command = addCommand(Command_FullscreenQuad);
+    command.shader = shaderId;
+}
+
+void drawSsao()
+{
+    drawFullscreenQuad(Shader_SSAO);
 }
 
-static void setupUniforms(const ShaderInfo* shader)
+void drawBlur()
+{
+    drawFullscreenQuad(Shader_Blur);
+}
+
+void drawFromFramebuffer(int n)
+{
+    drawSetTexture(renderTargets[n]);
+    drawFullscreenQuad(Shader_FromFramebuffer);
+}
+
+static void setupUniforms(const ShaderInfo* shader, const DrawList& list, const Command& command)
 {
     glUseProgram(shader->handle);
 
-    glLineWidth(currentLineWidth);
+    glLineWidth(command.lineWidth);
 
     int textureIndex = 0;
     for (size_t i = 0; i < MAX_RENDERTARGETS; i++) {
@@ -410,7 +800,7 @@ static void setupUniforms(const ShaderInfo* shader)
 
     if (shader->uniformTexture >= 0) {
         glActiveTexture(GL_TEXTURE0 + textureIndex);
-        glBindTexture(GL_TEXTURE_2D, currentTexture != 0 ? currentTexture : dummyTexture);
+        glBindTexture(GL_TEXTURE_2D, command.texture != 0 ? command.texture : dummyTexture);
         glUniform1i(shader->uniformTexture, textureIndex);
         ++textureIndex;
     }
@@ -431,72 +821,110 @@ static void setupUniforms(const ShaderInfo* shader)
     }
 
     if (shader->uniformProjectionMatrix >= 0)
-        glUniformMatrix4fv(shader->uniformProjectionMatrix, 1, GL_FALSE, &projectionMatrix[0][0]);
+        glUniformMatrix4fv(shader->uniformProjectionMatrix, 1, GL_FALSE, &list.projections[command.projection][0][0]);
 }
 
-void drawFlush()
+static void submitDraw(const DrawList& list, const Command& command)
 {
-    if (vertexCount > 0 || indexCount > 0) {
-        const ShaderInfo* shader = &shaders[currentShader];
-        setupUniforms(shader);
-
-        if (shader->attrPosition >= 0 || shader->attrTexCoord >= 0) {
-            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-            glBufferData(GL_ARRAY_BUFFER,
-                vertexCount * sizeof(GLfloat) * VERTICES_PER_INDEX, vertices.data(), GL_STREAM_DRAW);
-
-            if (shader->attrPosition >= 0) {
-                glVertexAttribPointer(shader->attrPosition, 3, GL_FLOAT, GL_FALSE,
-                    sizeof(GLfloat) * VERTICES_PER_INDEX, (void*)(sizeof(GLfloat) * 0));
-                glEnableVertexAttribArray(shader->attrPosition);
-            }
+    const ShaderInfo* shader = &shaders[command.shader];
+    setupUniforms(shader, list, command);
 
-            if (shader->attrTexCoord >= 0) {
-                glVertexAttribPointer(shader->attrTexCoord, 2, GL_FLOAT, GL_FALSE,
-                    sizeof(GLfloat) * VERTICES_PER_INDEX, (void*)(sizeof(GLfloat) * 3));
-                glEnableVertexAttribArray(shader->attrTexCoord);
-            }
+    if (shader->attrPosition >= 0 || shader->attrTexCoord >= 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, command.vertexCount * sizeof(GLfloat) * VERTICES_PER_INDEX,
+            &list.vertices[command.firstVertex * VERTICES_PER_INDEX], GL_STREAM_DRAW);
+
+        if (shader->attrPosition >= 0) {
+            glVertexAttribPointer(shader->attrPosition, 3, GL_FLOAT, GL_FALSE,
+                sizeof(GLfloat) * VERTICES_PER_INDEX, (void*)(sizeof(GLfloat) * 0));
+            glEnableVertexAttribArray(shader->attrPosition);
         }
 
-        if (shader->attrColor >= 0) {
-            glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
-            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(uint32_t), colors.data(), GL_STREAM_DRAW);
-            glVertexAttribPointer(shader->attrColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, NULL);
-            glEnableVertexAttribArray(shader->attrColor);
+        if (shader->attrTexCoord >= 0) {
+            glVertexAttribPointer(shader->attrTexCoord, 2, GL_FLOAT, GL_FALSE,
+                sizeof(GLfloat) * VERTICES_PER_INDEX, (void*)(sizeof(GLfloat) * 3));
+            glEnableVertexAttribArray(shader->attrTexCoord);
         }
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indices.data(), GL_STREAM_DRAW);
-        glDrawElements(currentPrimitiveType, indexCount, GL_UNSIGNED_SHORT, NULL);
+    if (shader->attrColor >= 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+        glBufferData(GL_ARRAY_BUFFER, command.vertexCount * sizeof(uint32_t),
+            &list.colors[command.firstVertex], GL_STREAM_DRAW);
+        glVertexAttribPointer(shader->attrColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, NULL);
+        glEnableVertexAttribArray(shader->attrColor);
+    }
 
-        if (shader->attrPosition >= 0)
-            glDisableVertexAttribArray(shader->attrPosition);
-        if (shader->attrTexCoord >= 0)
-            glDisableVertexAttribArray(shader->attrTexCoord);
-        if (shader->attrColor >= 0)
-            glDisableVertexAttribArray(shader->attrColor);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, command.indexCount * sizeof(GLushort),
+        &list.indices[command.firstIndex], GL_STREAM_DRAW);
+    glDrawElements(command.primitiveType, command.indexCount, GL_UNSIGNED_SHORT, NULL);
+    drawCountDrawCalls(1, unsigned(command.vertexCount));
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (shader->attrPosition >= 0)
+        glDisableVertexAttribArray(shader->attrPosition);
+    if (shader->attrTexCoord >= 0)
+        glDisableVertexAttribArray(shader->attrTexCoord);
+    if (shader->attrColor >= 0)
+        glDisableVertexAttribArray(shader->attrColor);
 
-        vertices.erase(vertices.begin(), vertices.begin() + vertexCount * VERTICES_PER_INDEX);
-        colors.erase(colors.begin(), colors.begin() + vertexCount);
-        indices.erase(indices.begin(), indices.begin() + indexCount);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-        for (auto& index : indices)
-            index -= vertexCount;
+static void submitBillboards(const DrawList& list, const Command& command)
+{
+    const ShaderInfo* shader = &shaders[command.shader];
+    setupUniforms(shader, list, command);
 
-        vertexCount = 0;
-        indexCount = 0;
+    // GLES2 has no instancing, so every record still has to be repeated for the four corners of its
+    // quad; this is a plain copy, corner indices come from a static buffer.
+    billboardVertices.resize(command.vertexCount * 4);
+    const Billboard* billboards = &list.billboards[command.firstVertex];
+    for (size_t i = 0; i < command.vertexCount; i++) {
+        Billboard* vertex = &billboardVertices[i * 4];
+        vertex[0] = vertex[1] = vertex[2] = vertex[3] = billboards[i];
     }
+
+    glBindBuffer(GL_ARRAY_BUFFER, billboardCornerBuffer);
+    glVertexAttribPointer(shader->attrCorner, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, NULL);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, billboardVertices.size() * sizeof(Billboard), billboardVertices.data(), GL_STREAM_DRAW);
+
+    glVertexAttribPointer(shader->attrPosition, 3, GL_FLOAT, GL_FALSE,
+        sizeof(Billboard), (void*)offsetof(Billboard, center));
+    glVertexAttribPointer(shader->attrSize, 2, GL_FLOAT, GL_FALSE,
+        sizeof(Billboard), (void*)offsetof(Billboard, size));
+    glVertexAttribPointer(shader->attrAnchor, 2, GL_FLOAT, GL_FALSE,
+        sizeof(Billboard), (void*)offsetof(Billboard, anchor));
+    glVertexAttribPointer(shader->attrColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+        sizeof(Billboard), (void*)offsetof(Billboard, color));
+
+    glEnableVertexAttribArray(shader->attrPosition);
+    glEnableVertexAttribArray(shader->attrCorner);
+    glEnableVertexAttribArray(shader->attrSize);
+    glEnableVertexAttribArray(shader->attrAnchor);
+    glEnableVertexAttribArray(shader->attrColor);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, billboardIndexBuffer);
+    glDrawElements(GL_TRIANGLES, GLsizei(command.vertexCount * 6), GL_UNSIGNED_SHORT, NULL);
+    drawCountDrawCalls(1, unsigned(command.vertexCount * 4));
+
+    glDisableVertexAttribArray(shader->attrPosition);
+    glDisableVertexAttribArray(shader->attrCorner);
+    glDisableVertexAttribArray(shader->attrSize);
+    glDisableVertexAttribArray(shader->attrAnchor);
+    glDisableVertexAttribArray(shader->attrColor);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-static void drawFullscreenQuad(Shader shaderId)
+static void submitFullscreenQuad(const DrawList& list, const Command& command)
 {
-    drawFlush();
-
-    const ShaderInfo* shader = &shaders[shaderId];
-    setupUniforms(shader);
+    const ShaderInfo* shader = &shaders[command.shader];
+    setupUniforms(shader, list, command);
 
     if (shader->attrPosition >= 0 || shader->attrTexCoord >= 0) {
         glBindBuffer(GL_ARRAY_BUFFER, quadVertexBuffer);
@@ -514,6 +942,7 @@ static void drawFullscreenQuad(Shader shaderId)
         }
 
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        drawCountDrawCalls(1, 4);
 
         if (shader->attrPosition >= 0)
             glDisableVertexAttribArray(shader->attrPosition);
@@ -522,18 +951,62 @@ static void drawFullscreenQuad(Shader shaderId)
     }
 }
 
-void drawSsao()
-{
-    drawFullscreenQuad(Shader_SSAO);
-}
+void drawAcquireFrame()
+{
+    DrawList* list = finishedList.exchange(nullptr, std::memory_order_acquire);
+    if (list)
+        submitList = list;
+}
+
+void drawSubmit()
+{
+    PROFILE_SCOPE("drawSubmit");
+    MemTagScope tag(MemTag_Draw);
+
+    if (!submitList)
+        drawAcquireFrame();
+
+    DrawList* list = submitList;
+    submitList = nullptr;
+    if (!list)
+        return;
+
+    submitStats = list->stats;
+    DrawPass pass = DrawPass_Other;
+    int64_t passStart = profilerTime();
+
+    for (const auto& command : list->commands) {
+        switch (command.type) {
+            case Command_Draw: submitDraw(*list, command); break;
+            case Command_FullscreenQuad: submitFullscreenQuad(*list, command); break;
+            case Command_Billboards: submitBillboards(*list, command); break;
+            case Command_Viewport: glViewport(0, 0, command.args[0], command.args[1]); break;
+            case Command_Enable: glEnable(GLenum(command.args[0])); break;
+            case Command_Disable: glDisable(GLenum(command.args[0])); break;
+            case Command_DepthFunc: glDepthFunc(GLenum(command.args[0])); break;
+            case Command_DepthMask: glDepthMask(GLboolean(command.args[0])); break;
+            case Command_BlendFunc: glBlendFunc(GLenum(command.args[0]), GLenum(command.args[1])); break;
+            case Command_BeginRenderToTexture: beginRenderToTexture(command.args[0], command.args[1] != 0); break;
+            case Command_EndRenderToTexture: glBindFramebuffer(GL_FRAMEBUFFER, 0); break;
+            case Command_Callback: list->callbacks[size_t(command.args[0])](); break;
+
+            case Command_Clear:
+                glClearColor(command.clearColor.r, command.clearColor.g, command.clearColor.b, command.clearColor.a);
+                glClear(GLbitfield(command.args[0]));
+                break;
+
+            case Command_BeginPass: {
+                int64_t time = profilerTime();
+                submitStats.submitTime[pass] += double(time - passStart) * 1e-9;
+                pass = DrawPass(command.args[0]);
+                passStart = time;
+                break;
+            }
+        }
+    }
 
-void drawBlur()
-{
-    drawFullscreenQuad(Shader_Blur);
-}
+    submitStats.submitTime[pass] += double(profilerTime() - passStart) * 1e-9;
+    frameStats = submitStats;
 
-void drawFromFramebuffer(int n)
-{
-    drawSetTexture(renderTargets[n]);
-    drawFullscreenQuad(Shader_FromFramebuffer);
+    list->textures.clear();
 }
@@ -22,6 +22,7 @@
 #include "engine/sprite.h"
 #include "engine/mesh.h"
 #include <glm/glm.hpp>
+#include <functional>
 
 enum Shader
 {
@@ -30,12 +31,53 @@ enum Shader
     Shader_SSAO,
     Shader_Blur,
     Shader_FromFramebuffer,
+    Shader_Billboard,
     ShaderCount     // should be the last one
 };
 
+enum DrawPass
+{
+    DrawPass_Other = 0,
+    DrawPass_Geometry,
+    DrawPass_Ssao,
+    DrawPass_Blur,
+    DrawPass_Composite,
+    DrawPass_Gui,
+    DrawPassCount   // should be the last one
+};
+
+// Times are CPU seconds: recording commands on the frame thread and issuing them to OpenGL.
+struct DrawStats
+{
+    double buildTime[DrawPassCount];
+    double submitTime[DrawPassCount];
+    unsigned drawCalls;
+    unsigned vertices;
+};
+
 void drawInit();
 void drawShutdown();
 
+// Drawing between these calls is recorded into a draw list instead of going to OpenGL, so a frame can be
+// built on any thread. drawSubmit() replays the last finished list and must run on the thread owning the
+// GL context; the frame after next may only be started once that submission has returned.
+// When the next frame is built while this one is submitted, drawAcquireFrame() has to take the finished
+// list before the next frame is started, otherwise a fast frame thread replaces it and it is never drawn.
+void drawBeginFrame(int viewportWidth, int viewportHeight);
+void drawEndFrame();
+void drawAcquireFrame();
+void drawSubmit();
+
+// Everything recorded from here to the next pass (or the end of the frame) is accounted to this pass.
+void drawBeginPass(DrawPass pass);
+
+// Statistics of the last submitted frame; valid between frames.
+const DrawStats& drawFrameStats();
+const char* drawPassName(DrawPass pass);
+
+// For callbacks that issue draw calls of their own.
+void drawCountDrawCalls(unsigned drawCalls, unsigned vertices);
+
 void drawBegin(const glm::mat4& projMatrix);
 void drawEnd();
 
@@ -48,17 +90,36 @@ void drawPushColor(const glm::vec4& c);
 void drawSetColor(const glm::vec4& c);
 void drawPopColor();
 
+void drawEnable(GLenum cap);
+void drawDisable(GLenum cap);
+void drawDepthFunc(GLenum func);
+void drawDepthMask(bool flag);
+void drawBlendFunc(GLenum srcFactor, GLenum dstFactor);
+void drawClear(const glm::vec4& color, GLbitfield mask);
+
+// Runs the function with the GL context current, at this point of the frame, when the list is submitted.
+void drawCallback(std::function<void()> callback);
+
 void drawBeginRenderToTexture(int n, bool clearDepth);
 void drawEndRenderToTexture();
 
 void drawSetShader(Shader shader);
 void drawSetTexture(GLuint texture);
+// Same, and keeps the texture alive until the frame is submitted. Use it for cached textures.
+void drawSetTexture(const std::shared_ptr<Texture>& texture);
 void drawSetLineWidth(float width);
 
 void drawSprite(const glm::vec2& pos, const glm::vec2& size, const glm::vec2& anchor, GLuint texture);
 void drawSprite(const glm::vec2& pos, const Sprite& sprite);
+// Sprite facing the camera. Only its center is transformed here; corners are placed by the vertex shader.
 void drawBillboard(const glm::vec3& pos, const Sprite& sprite);
-void drawMesh(const Mesh& mesh);
+void drawMesh(const Mesh& mesh, size_t lod = 0);
+
+// Fraction of the viewport height covered by a sphere in the current model space.
+float drawProjectedSize(const glm::vec3& center, float radius);
+
+// Ray in the current model space through a point of the viewport given in window coordinates.
+void drawGetRay(const glm::vec2& point, const glm::vec2& viewportSize, glm::vec3& origin, glm::vec3& direction);
 
 void drawBeginPrimitive(GLenum primitiveType);
 void drawEndPrimitive();
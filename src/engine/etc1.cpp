@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "etc1.h"
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+    struct SubblockFit
+    {
+        int error;
+        int table;
+        uint8_t indices[8];
+    };
+}
+
+static const int etc1Modifiers[8][2] = {
+        {  2,   8 },
+        {  5,  17 },
+        {  9,  29 },
+        { 13,  42 },
+        { 18,  60 },
+        { 24,  80 },
+        { 33, 106 },
+        { 47, 183 },
+    };
+
+// Pixel index is stored as (msb, lsb): 0 = +small, 1 = +large, 2 = -small, 3 = -large.
+static int etc1Modifier(int table, int index)
+{
+    int value = etc1Modifiers[table][index & 1];
+    return (index & 2 ? -value : value);
+}
+
+static uint8_t clampByte(int value)
+{
+    return uint8_t(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static int expand4(int c) { return (c << 4) | c; }
+static int expand5(int c) { return (c << 3) | (c >> 2); }
+
+// Coordinates of the i-th pixel (0..7) of a subblock.
+static void subblockPixel(bool flip, int subblock, int i, int& x, int& y)
+{
+    if (!flip) {
+        x = subblock * 2 + (i >> 2);
+        y = i & 3;
+    } else {
+        x = i & 3;
+        y = subblock * 2 + (i >> 2);
+    }
+}
+
+static SubblockFit fitSubblock(const uint8_t block[16][3], bool flip, int subblock, const int base[3])
+{
+    SubblockFit best;
+    best.error = INT_MAX;
+
+    for (int table = 0; table < 8; table++) {
+        SubblockFit fit;
+        fit.error = 0;
+        fit.table = table;
+
+        for (int i = 0; i < 8 && fit.error < best.error; i++) {
+            int x, y;
+            subblockPixel(flip, subblock, i, x, y);
+            const uint8_t* p = block[y * 4 + x];
+
+            int bestPixelError = INT_MAX;
+            for (int index = 0; index < 4; index++) {
+                int m = etc1Modifier(table, index);
+                int dr = clampByte(base[0] + m) - p[0];
+                int dg = clampByte(base[1] + m) - p[1];
+                int db = clampByte(base[2] + m) - p[2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestPixelError) {
+                    bestPixelError = error;
+                    fit.indices[i] = uint8_t(index);
+                }
+            }
+            fit.error += bestPixelError;
+        }
+
+        if (fit.error < best.error)
+            best = fit;
+    }
+
+    return best;
+}
+
+static void subblockAverage(const uint8_t block[16][3], bool flip, int subblock, int average[3])
+{
+    int sum[3] = { 0, 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        int x, y;
+        subblockPixel(flip, subblock, i, x, y);
+        for (int c = 0; c < 3; c++)
+            sum[c] += block[y * 4 + x][c];
+    }
+    for (int c = 0; c < 3; c++)
+        average[c] = (sum[c] + 4) / 8;
+}
+
+namespace
+{
+    // Base color candidates around the quantized subblock average, with their best fit.
+    struct Candidates
+    {
+        static const int RADIUS = 2;
+        static const int COUNT = (2 * RADIUS + 1) * (2 * RADIUS + 1) * (2 * RADIUS + 1);
+        int color[COUNT][3];
+        SubblockFit fit[COUNT];
+    };
+}
+
+static void fitCandidates(const uint8_t block[16][3], bool flip, int subblock, int bits, Candidates& result)
+{
+    int maxValue = (1 << bits) - 1;
+
+    int average[3];
+    subblockAverage(block, flip, subblock, average);
+
+    int center[3];
+    for (int c = 0; c < 3; c++)
+        center[c] = (average[c] * maxValue + 127) / 255;
+
+    int n = 0;
+    for (int dr = -Candidates::RADIUS; dr <= Candidates::RADIUS; dr++) {
+        for (int dg = -Candidates::RADIUS; dg <= Candidates::RADIUS; dg++) {
+            for (int db = -Candidates::RADIUS; db <= Candidates::RADIUS; db++) {
+                int* color = result.color[n];
+                color[0] = std::min(std::max(center[0] + dr, 0), maxValue);
+                color[1] = std::min(std::max(center[1] + dg, 0), maxValue);
+                color[2] = std::min(std::max(center[2] + db, 0), maxValue);
+
+                int base[3];
+                for (int c = 0; c < 3; c++)
+                    base[c] = (bits == 4 ? expand4(color[c]) : expand5(color[c]));
+
+                result.fit[n] = fitSubblock(block, flip, subblock, base);
+                ++n;
+            }
+        }
+    }
+}
+
+static uint64_t packIndices(uint64_t bits, bool flip, int subblock, const SubblockFit& fit)
+{
+    for (int i = 0; i < 8; i++) {
+        int x, y;
+        subblockPixel(flip, subblock, i, x, y);
+        int bit = x * 4 + y;
+        bits |= uint64_t(fit.indices[i] >> 1) << (bit + 16);
+        bits |= uint64_t(fit.indices[i] & 1) << bit;
+    }
+    return bits;
+}
+
+static uint64_t encodeBlock(const uint8_t block[16][3])
+{
+    uint64_t bestBits = 0;
+    int bestError = INT_MAX;
+
+    for (int flipIndex = 0; flipIndex < 2; flipIndex++) {
+        bool flip = (flipIndex != 0);
+
+        // Individual mode: two 4-bit base colors
+        Candidates individual[2];
+        fitCandidates(block, flip, 0, 4, individual[0]);
+        fitCandidates(block, flip, 1, 4, individual[1]);
+
+        int best[2] = { 0, 0 };
+        for (int s = 0; s < 2; s++) {
+            for (int i = 1; i < Candidates::COUNT; i++) {
+                if (individual[s].fit[i].error < individual[s].fit[best[s]].error)
+                    best[s] = i;
+            }
+        }
+
+        int error = individual[0].fit[best[0]].error + individual[1].fit[best[1]].error;
+        if (error < bestError) {
+            const int* c1 = individual[0].color[best[0]];
+            const int* c2 = individual[1].color[best[1]];
+            uint64_t bits = 0;
+            bits |= uint64_t(c1[0]) << 60 | uint64_t(c2[0]) << 56;
+            bits |= uint64_t(c1[1]) << 52 | uint64_t(c2[1]) << 48;
+            bits |= uint64_t(c1[2]) << 44 | uint64_t(c2[2]) << 40;
+            bits |= uint64_t(individual[0].fit[best[0]].table) << 37;
+            bits |= uint64_t(individual[1].fit[best[1]].table) << 34;
+            bits |= uint64_t(flip) << 32;
+            bits = packIndices(bits, flip, 0, individual[0].fit[best[0]]);
+            bits = packIndices(bits, flip, 1, individual[1].fit[best[1]]);
+            bestBits = bits;
+            bestError = error;
+        }
+
+        // Differential mode: 5-bit base color and a 3-bit signed offset for the second subblock
+        Candidates differential[2];
+        fitCandidates(block, flip, 0, 5, differential[0]);
+        fitCandidates(block, flip, 1, 5, differential[1]);
+
+        for (int i = 0; i < Candidates::COUNT; i++) {
+            const int* c1 = differential[0].color[i];
+            for (int j = 0; j < Candidates::COUNT; j++) {
+                const int* c2 = differential[1].color[j];
+                int d[3] = { c2[0] - c1[0], c2[1] - c1[1], c2[2] - c1[2] };
+                if (d[0] < -4 || d[0] > 3 || d[1] < -4 || d[1] > 3 || d[2] < -4 || d[2] > 3)
+                    continue;
+
+                error = differential[0].fit[i].error + differential[1].fit[j].error;
+                if (error >= bestError)
+                    continue;
+
+                uint64_t bits = 0;
+                bits |= uint64_t(c1[0]) << 59 | uint64_t(d[0] & 7) << 56;
+                bits |= uint64_t(c1[1]) << 51 | uint64_t(d[1] & 7) << 48;
+                bits |= uint64_t(c1[2]) << 43 | uint64_t(d[2] & 7) << 40;
+                bits |= uint64_t(differential[0].fit[i].table) << 37;
+                bits |= uint64_t(differential[1].fit[j].table) << 34;
+                bits |= uint64_t(1) << 33;
+                bits |= uint64_t(flip) << 32;
+                bits = packIndices(bits, flip, 0, differential[0].fit[i]);
+                bits = packIndices(bits, flip, 1, differential[1].fit[j]);
+                bestBits = bits;
+                bestError = error;
+            }
+        }
+    }
+
+    return bestBits;
+}
+
+static void decodeBlock(uint64_t bits, uint8_t block[16][3])
+{
+    bool flip = ((bits >> 32) & 1) != 0;
+    int table[2] = { int((bits >> 37) & 7), int((bits >> 34) & 7) };
+
+    int base[2][3];
+    if ((bits >> 33) & 1) {
+        for (int c = 0; c < 3; c++) {
+            int shift = 59 - c * 8;
+            int c1 = int((bits >> shift) & 31);
+            int d = int((bits >> (shift - 3)) & 7);
+            if (d >= 4)
+                d -= 8;
+            base[0][c] = expand5(c1);
+            base[1][c] = expand5((c1 + d) & 31);
+        }
+    } else {
+        for (int c = 0; c < 3; c++) {
+            int shift = 60 - c * 8;
+            base[0][c] = expand4(int((bits >> shift) & 15));
+            base[1][c] = expand4(int((bits >> (shift - 4)) & 15));
+        }
+    }
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int bit = x * 4 + y;
+            int index = int(((bits >> (bit + 16)) & 1) << 1 | ((bits >> bit) & 1));
+            int subblock = (flip ? y >> 1 : x >> 1);
+            int m = etc1Modifier(table[subblock], index);
+            for (int c = 0; c < 3; c++)
+                block[y * 4 + x][c] = clampByte(base[subblock][c] + m);
+        }
+    }
+}
+
+size_t etc1ImageSize(int width, int height)
+{
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * 8;
+}
+
+void etc1EncodeBlockRow(const uint8_t* pixels, int width, int height, int channels, int blockRow, uint8_t* out)
+{
+    int blocksPerRow = (width + 3) / 4;
+    out += size_t(blockRow) * size_t(blocksPerRow) * 8;
+
+    for (int bx = 0; bx < blocksPerRow; bx++) {
+        // Pixels past the edge repeat the last row and column
+        uint8_t block[16][3];
+        for (int y = 0; y < 4; y++) {
+            int sy = std::min(blockRow * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++) {
+                int sx = std::min(bx * 4 + x, width - 1);
+                const uint8_t* p = pixels + (size_t(sy) * size_t(width) + size_t(sx)) * size_t(channels);
+                block[y * 4 + x][0] = p[0];
+                block[y * 4 + x][1] = p[1];
+                block[y * 4 + x][2] = p[2];
+            }
+        }
+
+        uint64_t bits = encodeBlock(block);
+        for (int i = 0; i < 8; i++)
+            *out++ = uint8_t(bits >> (56 - i * 8));
+    }
+}
+
+void etc1EncodeImage(const uint8_t* pixels, int width, int height, int channels, uint8_t* out)
+{
+    int blockRows = (height + 3) / 4;
+    for (int i = 0; i < blockRows; i++)
+        etc1EncodeBlockRow(pixels, width, height, channels, i, out);
+}
+
+void etc1DecodeBlockRow(const uint8_t* data, int width, int height, int blockRow, uint8_t* rgb)
+{
+    int by = blockRow * 4;
+    data += size_t(blockRow) * size_t((width + 3) / 4) * 8;
+
+    for (int bx = 0; bx < width; bx += 4) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++)
+            bits = (bits << 8) | *data++;
+
+        uint8_t block[16][3];
+        decodeBlock(bits, block);
+
+        int w = std::min(width - bx, 4);
+        int h = std::min(height - by, 4);
+        for (int y = 0; y < h; y++) {
+            uint8_t* dst = rgb + (size_t(by + y) * size_t(width) + size_t(bx)) * 3;
+            for (int x = 0; x < w; x++) {
+                *dst++ = block[y * 4 + x][0];
+                *dst++ = block[y * 4 + x][1];
+                *dst++ = block[y * 4 + x][2];
+            }
+        }
+    }
+}
+
+void etc1DecodeImage(const uint8_t* data, int width, int height, uint8_t* rgb)
+{
+    int blockRows = (height + 3) / 4;
+    for (int i = 0; i < blockRows; i++)
+        etc1DecodeBlockRow(data, width, height, i, rgb);
+}
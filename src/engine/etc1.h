@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef ETC1_H
+#define ETC1_H
+
+#include "engine/opengl.h"
+#include <cstddef>
+#include <cstdint>
+
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+
+// ETC1 stores every 4x4 block of RGB pixels in 8 bytes. Blocks are laid out row by row, partial
+// blocks on the right and bottom edges are padded.
+
+size_t etc1ImageSize(int width, int height);
+
+// Encodes one row of blocks (4 rows of pixels) of an image with 3 or 4 channels (alpha is ignored)
+// into its place in `out`. Rows are independent, so an image can be split between threads.
+void etc1EncodeBlockRow(const uint8_t* pixels, int width, int height, int channels, int blockRow, uint8_t* out);
+void etc1EncodeImage(const uint8_t* pixels, int width, int height, int channels, uint8_t* out);
+
+// Decodes into tightly packed RGB pixels. Like encoding, decoding can be split by rows of blocks.
+void etc1DecodeBlockRow(const uint8_t* data, int width, int height, int blockRow, uint8_t* rgb);
+void etc1DecodeImage(const uint8_t* data, int width, int height, uint8_t* rgb);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "framearena.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+
+static const size_t INITIAL_CHUNK_SIZE = 64 * 1024;
+
+namespace
+{
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    struct Arena
+    {
+        std::vector<Chunk> chunks;
+        size_t current = 0;
+        size_t used = 0;
+    };
+}
+
+// The frame being built allocates from one arena while the previous frame is still being submitted from the other.
+static Arena arenas[2];
+static Arena* arena = &arenas[0];
+
+static void addChunk(Arena& a, size_t size)
+{
+    a.chunks.emplace_back(Chunk{ std::unique_ptr<char[]>(new char[size]), size });
+}
+
+void* frameArenaAlloc(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+
+    for (;;) {
+        if (arena->current < arena->chunks.size()) {
+            Chunk& chunk = arena->chunks[arena->current];
+            size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= chunk.size) {
+                arena->used = offset + size;
+                return chunk.data.get() + offset;
+            }
+            ++arena->current;
+            arena->used = 0;
+            continue;
+        }
+
+        size_t chunkSize = (arena->chunks.empty() ? INITIAL_CHUNK_SIZE : arena->chunks.back().size * 2);
+        addChunk(*arena, std::max(chunkSize, size));
+    }
+}
+
+const char* frameArenaFormat(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int length = vsnprintf(nullptr, 0, format, argsCopy);
+    va_end(argsCopy);
+
+    char* buffer = static_cast<char*>(frameArenaAlloc(size_t(length > 0 ? length : 0) + 1, 1));
+    vsnprintf(buffer, size_t(length > 0 ? length : 0) + 1, format, args);
+    va_end(args);
+
+    return buffer;
+}
+
+void frameArenaReset()
+{
+    arena = (arena == &arenas[0] ? &arenas[1] : &arenas[0]);
+
+    // A frame that did not fit into one chunk gets a single chunk big enough for all of it next time
+    if (arena->chunks.size() > 1) {
+        size_t total = 0;
+        for (const auto& chunk : arena->chunks)
+            total += chunk.size;
+        arena->chunks.clear();
+        addChunk(*arena, total);
+    }
+
+    arena->current = 0;
+    arena->used = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for data that is thrown away with the frame. Memory allocated while building a frame
+// stays valid until that frame has been submitted (see drawSubmit()), so draw callbacks may use it.
+// Only the thread building frames allocates from it; nothing is ever freed individually and
+// destructors of objects placed in it are not called.
+
+void* frameArenaAlloc(size_t size, size_t alignment = alignof(std::max_align_t));
+const char* frameArenaFormat(const char* format, ...);
+
+// Called between frames while nothing is being built. Once the arena has grown to fit a frame,
+// following frames allocate nothing from the heap.
+void frameArenaReset();
+
+template <typename T, typename... ARGS> T* frameArenaNew(ARGS&&... args)
+{
+    return new (frameArenaAlloc(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+}
+
+template <typename T> struct FrameAllocator
+{
+    typedef T value_type;
+
+    FrameAllocator() = default;
+    template <typename U> FrameAllocator(const FrameAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(frameArenaAlloc(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+};
+
+template <typename T, typename U> bool operator==(const FrameAllocator<T>&, const FrameAllocator<U>&) { return true; }
+template <typename T, typename U> bool operator!=(const FrameAllocator<T>&, const FrameAllocator<U>&) { return false; }
+
+template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif
@@ -18,6 +18,9 @@
 #include "gui.h"
 #include "opengl.h"
 #include "draw.h"
+#include "framearena.h"
+#include "memtrack.h"
+#include "profiler.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 #define GLFW_INCLUDE_ES2 1
@@ -34,10 +37,37 @@ static int attrColor;
 static int uniformProjectionMatrix;
 static int uniformTexture;
 
-static void renderDrawLists(ImDrawData* drawData)
+namespace
 {
-    ImGuiIO& io = ImGui::GetIO();
+    struct GuiCommand
+    {
+        ImVec4 clipRect;
+        GLuint texture;
+        unsigned elementCount;
+    };
+
+    struct GuiList
+    {
+        size_t firstVertex;
+        size_t vertexCount;
+        size_t firstIndex;
+        size_t indexCount;
+        size_t firstCommand;
+        size_t commandCount;
+    };
+
+    struct GuiFrame
+    {
+        FrameVector<ImDrawVert> vertices;
+        FrameVector<ImDrawIdx> indices;
+        FrameVector<GuiCommand> commands;
+        FrameVector<GuiList> lists;
+        glm::vec2 displaySize;
+    };
+}
 
+static void submitFrame(const GuiFrame& frame)
+{
     glEnable(GL_BLEND);
     glBlendEquation(GL_FUNC_ADD);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -50,7 +80,7 @@ static void renderDrawLists(ImDrawData* drawData)
     glGetIntegerv(GL_VIEWPORT, viewportSize);
 
     glActiveTexture(GL_TEXTURE0);
-    glm::mat4 projectionMatrix = glm::ortho(0.0f, io.DisplaySize.x, io.DisplaySize.y, 0.0f, -1.0f, 1.0f);
+    glm::mat4 projectionMatrix = glm::ortho(0.0f, frame.displaySize.x, frame.displaySize.y, 0.0f, -1.0f, 1.0f);
 
     glUseProgram(shader);
     glUniform1i(uniformTexture, 0);
@@ -67,40 +97,78 @@ static void renderDrawLists(ImDrawData* drawData)
     glEnableVertexAttribArray(attrTexCoord);
     glEnableVertexAttribArray(attrColor);
 
-    for (int n = 0; n < drawData->CmdListsCount; n++) {
-        const ImDrawList* cmdList = drawData->CmdLists[n];
-
+    for (const auto& list : frame.lists) {
         glBufferData(GL_ARRAY_BUFFER,
-            cmdList->VtxBuffer.Size * sizeof(ImDrawVert),
-            reinterpret_cast<void*>(cmdList->VtxBuffer.Data),
+            list.vertexCount * sizeof(ImDrawVert),
+            &frame.vertices[list.firstVertex],
             GL_STREAM_DRAW);
 
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-            cmdList->IdxBuffer.Size * sizeof(ImDrawIdx),
-            reinterpret_cast<void*>(cmdList->IdxBuffer.Data),
+            list.indexCount * sizeof(ImDrawIdx),
+            &frame.indices[list.firstIndex],
             GL_STREAM_DRAW);
 
+        drawCountDrawCalls(unsigned(list.commandCount), unsigned(list.vertexCount));
+
         const ImDrawIdx* indexBufferOffset = 0;
+        for (size_t i = 0; i < list.commandCount; i++) {
+            const GuiCommand& cmd = frame.commands[list.firstCommand + i];
+            glScissor(int(cmd.clipRect.x),
+                int(viewportSize[3] - cmd.clipRect.w),
+                int(cmd.clipRect.z - cmd.clipRect.x),
+                int(cmd.clipRect.w - cmd.clipRect.y));
+
+            glBindTexture(GL_TEXTURE_2D, cmd.texture);
+            glDrawElements(GL_TRIANGLES, cmd.elementCount, GL_UNSIGNED_SHORT, indexBufferOffset);
+            indexBufferOffset += cmd.elementCount;
+        }
+    }
+
+    glDisableVertexAttribArray(attrPosition);
+    glDisableVertexAttribArray(attrTexCoord);
+    glDisableVertexAttribArray(attrColor);
+}
+
+static void renderDrawLists(ImDrawData* drawData)
+{
+    // ImGui reuses its buffers on the next frame, so the frame is copied and drawn when the draw list is submitted
+    ImGuiIO& io = ImGui::GetIO();
+    GuiFrame* frame = frameArenaNew<GuiFrame>();
+    frame->displaySize = glm::vec2(io.DisplaySize.x, io.DisplaySize.y);
+    // Growing a vector in the arena abandons the old storage, so everything is sized up front
+    size_t commandCount = 0;
+    for (int n = 0; n < drawData->CmdListsCount; n++)
+        commandCount += size_t(drawData->CmdLists[n]->CmdBuffer.Size);
+    frame->vertices.reserve(size_t(drawData->TotalVtxCount));
+    frame->indices.reserve(size_t(drawData->TotalIdxCount));
+    frame->commands.reserve(commandCount);
+    frame->lists.reserve(size_t(drawData->CmdListsCount));
+
+    for (int n = 0; n < drawData->CmdListsCount; n++) {
+        const ImDrawList* cmdList = drawData->CmdLists[n];
+
+        GuiList list;
+        list.firstVertex = frame->vertices.size();
+        list.vertexCount = size_t(cmdList->VtxBuffer.Size);
+        list.firstIndex = frame->indices.size();
+        list.indexCount = size_t(cmdList->IdxBuffer.Size);
+        list.firstCommand = frame->commands.size();
+        frame->vertices.insert(frame->vertices.end(), cmdList->VtxBuffer.begin(), cmdList->VtxBuffer.end());
+        frame->indices.insert(frame->indices.end(), cmdList->IdxBuffer.begin(), cmdList->IdxBuffer.end());
+
         for (int i = 0; i < cmdList->CmdBuffer.Size; i++) {
             const ImDrawCmd* pcmd = &cmdList->CmdBuffer[i];
             if (pcmd->UserCallback)
                 pcmd->UserCallback(cmdList, pcmd);
-            else {
-                glScissor(int(pcmd->ClipRect.x),
-                    int(viewportSize[3] - pcmd->ClipRect.w),
-                    int(pcmd->ClipRect.z - pcmd->ClipRect.x),
-                    int(pcmd->ClipRect.w - pcmd->ClipRect.y));
-
-                glBindTexture(GL_TEXTURE_2D, GLuint(ptrdiff_t(pcmd->TextureId)));
-                glDrawElements(GL_TRIANGLES, pcmd->ElemCount, GL_UNSIGNED_SHORT, indexBufferOffset);
-            }
-            indexBufferOffset += pcmd->ElemCount;
+            else
+                frame->commands.emplace_back(GuiCommand{ pcmd->ClipRect, GLuint(ptrdiff_t(pcmd->TextureId)), pcmd->ElemCount });
         }
+
+        list.commandCount = frame->commands.size() - list.firstCommand;
+        frame->lists.emplace_back(list);
     }
 
-    glDisableVertexAttribArray(attrPosition);
-    glDisableVertexAttribArray(attrTexCoord);
-    glDisableVertexAttribArray(attrColor);
+    drawCallback([frame]() { submitFrame(*frame); });
 }
 
 void guiInit()
@@ -116,6 +184,8 @@ void guiInit()
     uniformTexture = glGetUniformLocation(shader, "uTexture");
 
     ImGuiIO& io = ImGui::GetIO();
+    io.MemAllocFn = memtrackAlloc;
+    io.MemFreeFn = memtrackFree;
     io.KeyMap[ImGuiKey_Tab] = GLFW_KEY_TAB;
     io.KeyMap[ImGuiKey_LeftArrow] = GLFW_KEY_LEFT;
     io.KeyMap[ImGuiKey_RightArrow] = GLFW_KEY_RIGHT;
@@ -163,6 +233,8 @@ void guiShutdown()
 
 void guiBeginFrame(double frameTime, int width, int height)
 {
+    MemTagScope tag(MemTag_Gui);
+
     ImGuiIO& io = ImGui::GetIO();
     io.DisplaySize = ImVec2(float(width), float(height));
     io.DisplayFramebufferScale = ImVec2(1.0f, 1.0f);
@@ -172,9 +244,47 @@ void guiBeginFrame(double frameTime, int width, int height)
 
 void guiEndFrame()
 {
+    PROFILE_SCOPE("guiEndFrame");
+    MemTagScope tag(MemTag_Gui);
+    drawBeginPass(DrawPass_Gui);
     ImGui::Render();
 }
 
+void guiShowAllocations(bool* open)
+{
+    ImGui::SetNextWindowSize(ImVec2(320, 180), ImGuiSetCond_FirstUseEver);
+    if (!ImGui::Begin("Allocations per frame", open, 0)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Columns(4, "allocations");
+    ImGui::Text("tag");
+    ImGui::NextColumn();
+    ImGui::Text("allocs");
+    ImGui::NextColumn();
+    ImGui::Text("frees");
+    ImGui::NextColumn();
+    ImGui::Text("bytes");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (int i = 0; i < MemTagCount; i++) {
+        const MemStats& stats = memtrackFrameStats(MemTag(i));
+        ImGui::Text("%s", memtrackTagName(MemTag(i)));
+        ImGui::NextColumn();
+        ImGui::Text("%u", unsigned(stats.allocations));
+        ImGui::NextColumn();
+        ImGui::Text("%u", unsigned(stats.frees));
+        ImGui::NextColumn();
+        ImGui::Text("%u", unsigned(stats.bytes));
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::End();
+}
+
 void guiSetMousePos(const glm::vec2& pos)
 {
     ImGuiIO& io = ImGui::GetIO();
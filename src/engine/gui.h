@@ -32,6 +32,9 @@ void guiShutdown();
 void guiBeginFrame(double frameTime, int width, int height);
 void guiEndFrame();
 
+// Window with the allocation counters of the last frame (see memtrack.h).
+void guiShowAllocations(bool* open);
+
 void guiSetMousePos(const glm::vec2& pos);
 void guiSetMouseButtonPressed(int button, bool pressed);
 void guiSetMouseWheel(float wheel);
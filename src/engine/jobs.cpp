@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "jobs.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef PLATFORM_EMSCRIPTEN
+    #include <condition_variable>
+    #include <deque>
+    #include <memory>
+    #include <mutex>
+    #include <thread>
+    #include <vector>
+#endif
+
+#ifndef PLATFORM_EMSCRIPTEN
+namespace
+{
+    struct Job
+    {
+        std::function<void()> run;
+        JobCounter* counter;
+    };
+
+    // The owning worker pushes and pops at the back, other threads steal from the front.
+    struct JobQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+}
+
+static const unsigned MAX_WORKER_THREADS = 8;
+
+// Children of a job are usually short, so jobWait() yields this many times before it goes to sleep
+static const int WAIT_SPIN_COUNT = 64;
+
+static bool initialized;
+static bool registeredAtExit;
+static std::vector<std::unique_ptr<JobQueue>> queues;   // one per worker; the last one takes jobs from other threads
+static std::vector<std::thread> workers;
+static std::atomic<int> queuedJobs;
+static std::atomic<unsigned> nextVictim;
+static std::mutex sleepMutex;
+static std::condition_variable sleepWakeup;
+static std::condition_variable waitWakeup;     // threads sleeping in jobWait()
+static std::atomic<int> sleepingWaiters;
+static bool shuttingDown;
+static thread_local JobQueue* ownQueue;
+
+static bool popJob(Job& job)
+{
+    if (queuedJobs.load() <= 0)
+        return false;
+
+    if (ownQueue) {
+        std::lock_guard<std::mutex> lock(ownQueue->mutex);
+        if (!ownQueue->jobs.empty()) {
+            job = std::move(ownQueue->jobs.back());
+            ownQueue->jobs.pop_back();
+            --queuedJobs;
+            return true;
+        }
+    }
+
+    size_t count = queues.size();
+    size_t first = nextVictim++ % count;
+    for (size_t i = 0; i < count; i++) {
+        JobQueue* queue = queues[(first + i) % count].get();
+        if (queue == ownQueue)
+            continue;
+
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty()) {
+            job = std::move(queue->jobs.front());
+            queue->jobs.pop_front();
+            --queuedJobs;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool runOneJob()
+{
+    Job job;
+    if (!popJob(job))
+        return false;
+
+    {
+        PROFILE_SCOPE("Job");
+        job.run();
+    }
+
+    // Whatever the job captured is released before the waiting thread may continue
+    job.run = nullptr;
+    if (job.counter->pending.fetch_sub(1) == 1 && sleepingWaiters.load() > 0) {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        waitWakeup.notify_all();
+    }
+    return true;
+}
+
+static void workerThread(JobQueue* queue)
+{
+    ownQueue = queue;
+    profilerSetThreadName("Job worker");
+
+    for (;;) {
+        if (runOneJob())
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepWakeup.wait(lock, []{ return shuttingDown || queuedJobs.load() > 0; });
+        if (shuttingDown)
+            return;
+    }
+}
+#endif
+
+void jobInit(unsigned threadCount)
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    unsigned workerCount;
+    if (threadCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        workerCount = (workerCount > 1 ? workerCount - 1 : 1);
+    } else
+        workerCount = threadCount - 1;
+    if (workerCount > MAX_WORKER_THREADS)
+        workerCount = MAX_WORKER_THREADS;
+
+    for (unsigned i = 0; i <= workerCount; i++)
+        queues.emplace_back(new JobQueue);
+
+    shuttingDown = false;
+    for (unsigned i = 0; i < workerCount; i++)
+        workers.emplace_back(workerThread, queues[i].get());
+
+    initialized = true;
+
+    // Workers must be gone before static destructors run when the program exits without jobShutdown()
+    if (!registeredAtExit) {
+        registeredAtExit = true;
+        atexit(jobShutdown);
+    }
+  #endif
+}
+
+void jobShutdown()
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    if (!initialized)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        shuttingDown = true;
+    }
+    sleepWakeup.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.get_id() != std::this_thread::get_id())
+            worker.join();
+        else
+            worker.detach();
+    }
+    workers.clear();
+    queues.clear();
+
+    queuedJobs = 0;
+    initialized = false;
+  #endif
+}
+
+unsigned jobThreadCount()
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    return unsigned(workers.size()) + 1;
+  #else
+    return 1;
+  #endif
+}
+
+void jobRun(JobCounter& counter, std::function<void()> job)
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    if (initialized) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+        JobQueue* queue = (ownQueue ? ownQueue : queues.back().get());
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->jobs.emplace_back(Job{ std::move(job), &counter });
+        }
+        ++queuedJobs;
+
+        // Taking the lock orders the push before the check of a worker that is about to sleep
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        sleepWakeup.notify_one();
+        if (sleepingWaiters.load() > 0)
+            waitWakeup.notify_all();
+        return;
+    }
+  #endif
+
+    job();
+}
+
+void jobWait(JobCounter& counter)
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    int spins = 0;
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        if (runOneJob()) {
+            spins = 0;
+            continue;
+        }
+
+        // The remaining jobs are running on other threads
+        if (++spins < WAIT_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleepingWaiters;
+        waitWakeup.wait(lock, [&counter]{ return counter.pending.load() <= 0 || queuedJobs.load() > 0; });
+        --sleepingWaiters;
+        spins = 0;
+    }
+  #endif
+}
+
+void jobParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t grain)
+{
+    if (count == 0)
+        return;
+
+    // Several pieces per thread so that threads finishing early have something to steal
+    if (grain == 0)
+        grain = std::max(count / (jobThreadCount() * 4), size_t(1));
+
+    if (count <= grain || jobThreadCount() == 1) {
+        body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (size_t begin = grain; begin < count; begin += grain) {
+        size_t end = std::min(begin + grain, count);
+        jobRun(counter, [&body, begin, end]() { body(begin, end); });
+    }
+
+    body(0, grain);
+    jobWait(counter);
+}
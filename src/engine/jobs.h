@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+// Counts unfinished jobs started with it. A job may start children on a counter of its own and wait for them.
+struct JobCounter
+{
+    std::atomic<int> pending;
+
+    JobCounter() : pending(0) {}
+};
+
+// Starts workers so that jobs run on `threadCount` threads, counting the one waiting for them.
+// With 0 there is a worker for every core but one, and at least one. Workers are capped at 8.
+void jobInit(unsigned threadCount = 0);
+void jobShutdown();
+
+// Threads that execute jobs, counting the one waiting for them.
+unsigned jobThreadCount();
+
+// Before jobInit() and in single threaded builds the job runs right away.
+void jobRun(JobCounter& counter, std::function<void()> job);
+
+// Runs queued jobs while waiting, so it is fine to call from inside a job.
+void jobWait(JobCounter& counter);
+
+// Calls body(begin, end) for consecutive ranges covering [0, count) and returns when all of them are done.
+// With no grain given the range is split into a few pieces per thread.
+void jobParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t grain = 0);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "ktx.h"
+#include <cstring>
+
+namespace
+{
+    struct KtxHeader
+    {
+        uint8_t identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+}
+
+static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+static size_t ktxPad(size_t size)
+{
+    return (size + 3) & ~size_t(3);
+}
+
+bool ktxParse(const char* data, size_t size, KtxImage& image)
+{
+    if (size < sizeof(KtxHeader))
+        return false;
+
+    KtxHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header.endianness != KTX_ENDIANNESS)
+        return false;
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1)
+        return false;
+
+    image.glType = header.glType;
+    image.glFormat = header.glFormat;
+    image.glInternalFormat = header.glInternalFormat;
+    image.glBaseInternalFormat = header.glBaseInternalFormat;
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+    image.levels.clear();
+
+    size_t offset = sizeof(KtxHeader) + header.bytesOfKeyValueData;
+    uint32_t levelCount = (header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1);
+    for (uint32_t i = 0; i < levelCount; i++) {
+        uint32_t imageSize = 0;
+        if (offset + sizeof(imageSize) > size)
+            return false;
+        memcpy(&imageSize, data + offset, sizeof(imageSize));
+        offset += sizeof(imageSize);
+
+        if (offset + imageSize > size)
+            return false;
+        image.levels.push_back(KtxImage::Level{ data + offset, imageSize });
+        offset += ktxPad(imageSize);
+    }
+
+    return true;
+}
+
+std::string ktxWrite(const KtxImage& image)
+{
+    KtxHeader header;
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glType = image.glType;
+    header.glTypeSize = 1;
+    header.glFormat = image.glFormat;
+    header.glInternalFormat = image.glInternalFormat;
+    header.glBaseInternalFormat = image.glBaseInternalFormat;
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = uint32_t(image.levels.size());
+    header.bytesOfKeyValueData = 0;
+
+    std::string result(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& level : image.levels) {
+        uint32_t imageSize = uint32_t(level.size);
+        result.append(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+        result.append(level.data, level.size);
+        result.append(ktxPad(level.size) - level.size, 0);
+    }
+
+    return result;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef KTX_H
+#define KTX_H
+
+#include "engine/opengl.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Textures with precomputed mip chains are stored in the KTX 1.1 container (single face, no arrays).
+struct KtxImage
+{
+    struct Level
+    {
+        const char* data;
+        size_t size;
+    };
+
+    GLenum glType = 0;
+    GLenum glFormat = 0;
+    GLenum glInternalFormat = 0;
+    GLenum glBaseInternalFormat = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<Level> levels;
+
+    bool isCompressed() const { return glType == 0; }
+};
+
+// Parses the container in place; the levels point into `data`.
+bool ktxParse(const char* data, size_t size, KtxImage& image);
+
+// Serializes the image; level data must already include KTX row padding (4 bytes).
+std::string ktxWrite(const KtxImage& image);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "loader.h"
+#include "memtrack.h"
+#include "profiler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+
+#ifndef PLATFORM_EMSCRIPTEN
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+    #include <vector>
+#endif
+
+namespace
+{
+    struct Request
+    {
+        std::function<void()> work;
+        std::function<void()> finish;
+    };
+}
+
+static bool initialized;
+static bool registeredAtExit;
+static std::atomic<size_t> pendingCount;
+static std::deque<Request> queue;
+static std::deque<Request> completed;
+
+#ifndef PLATFORM_EMSCRIPTEN
+static const unsigned MAX_WORKER_THREADS = 4;
+
+static std::vector<std::thread> workers;
+static std::mutex mutex;
+static std::condition_variable wakeup;
+static bool shuttingDown;
+
+static void workerThread()
+{
+    MemTagScope tag(MemTag_Loader);
+    profilerSetThreadName("Loader");
+
+    for (;;) {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, []{ return shuttingDown || !queue.empty(); });
+            if (shuttingDown)
+                return;
+            request = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        if (request.work) {
+            PROFILE_SCOPE("Loader work");
+            request.work();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.emplace_back(std::move(request));
+    }
+}
+#endif
+
+void loaderInit()
+{
+    initialized = true;
+
+  #ifndef PLATFORM_EMSCRIPTEN
+    unsigned threadCount = std::thread::hardware_concurrency();
+    threadCount = (threadCount > 1 ? threadCount - 1 : 1);
+    if (threadCount > MAX_WORKER_THREADS)
+        threadCount = MAX_WORKER_THREADS;
+
+    shuttingDown = false;
+    for (unsigned i = 0; i < threadCount; i++)
+        workers.emplace_back(workerThread);
+
+    // Workers must be gone before static destructors run when the program exits without loaderShutdown()
+    if (!registeredAtExit) {
+        registeredAtExit = true;
+        atexit(loaderShutdown);
+    }
+  #endif
+}
+
+void loaderShutdown()
+{
+    if (!initialized)
+        return;
+
+  #ifndef PLATFORM_EMSCRIPTEN
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    wakeup.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.get_id() != std::this_thread::get_id())
+            worker.join();
+        else
+            worker.detach();
+    }
+    workers.clear();
+  #endif
+
+    // Requests that did not complete are dropped: whatever they were loading is being destroyed.
+    queue.clear();
+    completed.clear();
+    pendingCount = 0;
+    initialized = false;
+}
+
+void loaderPost(std::function<void()> work, std::function<void()> finish)
+{
+    if (!initialized) {
+        if (work)
+            work();
+        if (finish)
+            finish();
+        return;
+    }
+
+    ++pendingCount;
+
+  #ifndef PLATFORM_EMSCRIPTEN
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(Request{ std::move(work), std::move(finish) });
+    }
+    wakeup.notify_one();
+  #else
+    queue.emplace_back(Request{ std::move(work), std::move(finish) });
+  #endif
+}
+
+void loaderRunFrame(double budget)
+{
+    PROFILE_SCOPE("loaderRunFrame");
+    MemTagScope tag(MemTag_Loader);
+
+    typedef std::chrono::steady_clock Clock;
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+
+    bool first = true;
+    while (first || Clock::now() < deadline) {
+        Request request;
+
+      #ifndef PLATFORM_EMSCRIPTEN
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (completed.empty())
+                return;
+            request = std::move(completed.front());
+            completed.pop_front();
+        }
+      #else
+        // No threads here: both parts of the request run on the main thread, still spread over frames.
+        if (queue.empty())
+            return;
+        request = std::move(queue.front());
+        queue.pop_front();
+        if (request.work)
+            request.work();
+      #endif
+
+        --pendingCount;
+        if (request.finish)
+            request.finish();
+
+        first = false;
+    }
+}
+
+size_t loaderPendingCount()
+{
+    return pendingCount;
+}
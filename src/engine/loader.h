@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstddef>
+#include <functional>
+
+// Background loader. The `work` part of a request runs on a worker thread and must not touch
+// OpenGL; the `finish` part runs on the main thread from loaderRunFrame(). Until loaderInit()
+// is called both parts run immediately, which is what the command line tools rely on.
+//
+// loaderPost() and loaderPendingCount() may be called from any thread; the game posts requests
+// from the frame thread while it builds a frame. loaderInit(), loaderShutdown() and
+// loaderRunFrame() belong to the main thread, and loaderRunFrame() must not overlap with the
+// frame thread because `finish` callbacks modify game state.
+
+void loaderInit();
+void loaderShutdown();
+
+void loaderPost(std::function<void()> work, std::function<void()> finish);
+
+// Runs completed requests until the given time (in seconds) is used up. At least one request is
+// finished per call, so that a single large upload cannot stall the queue.
+void loaderRunFrame(double budget);
+
+size_t loaderPendingCount();
+
+#endif
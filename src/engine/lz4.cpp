@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "lz4.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;      // the block must end with at least this many literals
+static const size_t MATCH_FIND_LIMIT = 12;  // no match may start this close to the end
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 12;
+
+static uint32_t read32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static bool writeLength(char*& op, char* end, size_t length)
+{
+    while (length >= 255) {
+        if (op >= end)
+            return false;
+        *op++ = char(255);
+        length -= 255;
+    }
+    if (op >= end)
+        return false;
+    *op++ = char(length);
+    return true;
+}
+
+static bool writeSequence(char*& op, char* end, const char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    if (op >= end)
+        return false;
+
+    char* token = op++;
+    *token = char((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15 && !writeLength(op, end, literalLength - 15))
+        return false;
+
+    if (size_t(end - op) < literalLength)
+        return false;
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    // The last sequence carries only literals
+    if (matchLength == 0)
+        return true;
+
+    if (end - op < 2)
+        return false;
+    *op++ = char(offset & 0xFF);
+    *op++ = char(offset >> 8);
+
+    matchLength -= MIN_MATCH;
+    *token |= char(matchLength >= 15 ? 15 : matchLength);
+    if (matchLength >= 15 && !writeLength(op, end, matchLength - 15))
+        return false;
+
+    return true;
+}
+
+size_t lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lz4Compress(const char* src, size_t srcSize, char* dst, size_t capacity)
+{
+    char* op = dst;
+    char* end = dst + capacity;
+    size_t anchor = 0;
+
+    if (srcSize > MATCH_FIND_LIMIT) {
+        // Positions are stored plus one, so that zero means "no entry"
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+
+        size_t limit = srcSize - MATCH_FIND_LIMIT;
+        size_t matchLimit = srcSize - LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < limit) {
+            uint32_t value = read32(src + ip);
+            uint32_t& slot = table[hash32(value)];
+            size_t ref = slot;
+            slot = uint32_t(ip + 1);
+
+            if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != value) {
+                ++ip;
+                continue;
+            }
+            --ref;
+
+            size_t length = MIN_MATCH;
+            while (ip + length < matchLimit && src[ref + length] == src[ip + length])
+                ++length;
+
+            if (!writeSequence(op, end, src + anchor, ip - anchor, ip - ref, length))
+                return 0;
+
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!writeSequence(op, end, src + anchor, srcSize - anchor, 0, 0))
+        return 0;
+
+    return size_t(op - dst);
+}
+
+static bool readLength(const char*& ip, const char* end, size_t& length)
+{
+    for (;;) {
+        if (ip >= end)
+            return false;
+        uint8_t byte = uint8_t(*ip++);
+        length += byte;
+        if (byte != 255)
+            return true;
+    }
+}
+
+bool lz4Decompress(const char* src, size_t srcSize, char* dst, size_t dstSize)
+{
+    const char* ip = src;
+    const char* end = src + srcSize;
+    size_t op = 0;
+
+    while (ip < end) {
+        uint8_t token = uint8_t(*ip++);
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength))
+            return false;
+        if (size_t(end - ip) < literalLength || dstSize - op < literalLength)
+            return false;
+        memcpy(dst + op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        size_t offset = uint8_t(ip[0]) | size_t(uint8_t(ip[1])) << 8;
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength))
+            return false;
+        matchLength += MIN_MATCH;
+        if (dstSize - op < matchLength)
+            return false;
+
+        // Source and destination may overlap, which repeats the last `offset` bytes
+        const char* match = dst + op - offset;
+        for (size_t i = 0; i < matchLength; i++)
+            dst[op + i] = match[i];
+        op += matchLength;
+    }
+
+    return op == dstSize;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstddef>
+
+// Compressor and decompressor for the LZ4 block format (no frame header, no checksums).
+
+size_t lz4CompressBound(size_t size);
+
+// Returns the compressed size, or 0 when the result does not fit into `capacity`.
+size_t lz4Compress(const char* src, size_t srcSize, char* dst, size_t capacity);
+
+// Fails unless the block decodes into exactly `dstSize` bytes.
+bool lz4Decompress(const char* src, size_t srcSize, char* dst, size_t dstSize);
+
+#endif
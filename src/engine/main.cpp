@@ -17,21 +17,170 @@
  */
 #include "util.h"
 #include "draw.h"
+#include "framearena.h"
 #include "game.h"
 #include "mesh.h"
+#include "perfhud.h"
+#include "profiler.h"
 #include "gui.h"
+#include "jobs.h"
+#include "loader.h"
+#include "memtrack.h"
+#include "resource.h"
+#include "vfs.h"
 
 #define GLFW_INCLUDE_ES2 1
 #include <GLFW/glfw3.h>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef PLATFORM_EMSCRIPTEN
     #include <emscripten.h>
+#else
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
 #endif
 
+// Time per frame spent on finishing background loads (uploading textures and so on)
+static const double LOADER_FRAME_BUDGET = 0.002;
+
+// With --check-allocs the game plays a level and fails if it still allocates once everything is loaded
+static const char ALLOC_CHECK_LEVEL[] = "room1.level";
+static const int ALLOC_CHECK_WARMUP_FRAMES = 60;
+static const int ALLOC_CHECK_FRAMES = 600;
+
+// With --profile F3 writes a trace of the last frames
+static const char TRACE_FILE[] = "profile.json";
+static const int TRACE_FRAMES = 120;
+
 static float mouseWheel;
 static bool mouseButtonPressed[3];
 static double prevTime;
 static GLFWwindow* window;
+static bool perfHudVisible;
+static bool allocationsVisible;
+static bool checkAllocations;
+static bool allocationCheckFailed;
+static int checkedFrames;
+static bool traceRequested;
+
+namespace
+{
+    struct FrameParams
+    {
+        double frameTime;
+        int winWidth;
+        int winHeight;
+        int fbWidth;
+        int fbHeight;
+    };
+}
+
+static void buildFrame(const FrameParams& params)
+{
+    PROFILE_SCOPE("buildFrame");
+
+    drawBeginFrame(params.fbWidth, params.fbHeight);
+    guiBeginFrame(params.frameTime, params.winWidth, params.winHeight);
+    gameRunFrame(params.frameTime, params.winWidth, params.winHeight);
+
+    if (ImGui::IsKeyPressed(GLFW_KEY_F1, false))
+        perfHudVisible = !perfHudVisible;
+    if (perfHudVisible)
+        perfHudShow(&perfHudVisible);
+
+    if (ImGui::IsKeyPressed(GLFW_KEY_F2, false))
+        allocationsVisible = !allocationsVisible;
+    if (allocationsVisible)
+        guiShowAllocations(&allocationsVisible);
+
+    if (ImGui::IsKeyPressed(GLFW_KEY_F3, false))
+        traceRequested = true;
+
+    guiEndFrame();
+    drawEndFrame();
+}
+
+#ifndef PLATFORM_EMSCRIPTEN
+// While the main thread submits frame N to OpenGL, frame N+1 is built on this thread.
+// Everything else (input, loader callbacks, resource eviction) runs while it is idle.
+//
+// The handoff is a mutex and a condition variable rather than a lock-free queue: there is exactly
+// one request and one completion per frame, both threads have to block when the other one is late,
+// and the lock is held only to copy FrameParams. Spinning on an atomic would burn a core on
+// machines with few of them. The draw lists themselves are double buffered and exchanged with an
+// atomic pointer swap (see drawEndFrame/drawAcquireFrame).
+//
+// Pipelining adds one frame of latency: input sampled for frame N+1 reaches the screen one
+// buffer swap after the frame it would appear in when built and submitted on one thread.
+static std::thread frameThread;
+static std::mutex frameMutex;
+static std::condition_variable frameWakeup;
+static FrameParams frameParams;
+static bool frameRequested;
+static bool frameThreadExit;
+
+static void frameThreadProc()
+{
+    profilerSetThreadName("Frame");
+
+    for (;;) {
+        FrameParams params;
+
+        {
+            std::unique_lock<std::mutex> lock(frameMutex);
+            frameWakeup.wait(lock, []{ return frameThreadExit || frameRequested; });
+            if (frameThreadExit)
+                return;
+            params = frameParams;
+        }
+
+        buildFrame(params);
+
+        {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            frameRequested = false;
+        }
+        frameWakeup.notify_all();
+    }
+}
+
+static void startFrame(const FrameParams& params)
+{
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameParams = params;
+        frameRequested = true;
+    }
+    frameWakeup.notify_all();
+}
+
+static void waitFrame()
+{
+    PROFILE_SCOPE("waitFrame");
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameWakeup.wait(lock, []{ return !frameRequested; });
+}
+
+// Also registered with atexit(): a joinable std::thread destroyed at exit terminates the program.
+static void stopFrameThread()
+{
+    if (!frameThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameThreadExit = true;
+    }
+    frameWakeup.notify_all();
+
+    if (frameThread.get_id() != std::this_thread::get_id())
+        frameThread.join();
+    else
+        frameThread.detach();
+}
+#endif
 
 static void mouseButtonCallback(GLFWwindow*, int button, int action, int)
 {
@@ -58,8 +207,48 @@ static void charCallback(GLFWwindow*, unsigned int c)
         guiInjectUnicode(static_cast<unsigned short>(c));
 }
 
+static void checkFrameAllocations()
+{
+    // Frames until the loader is done fill caches and grow buffers
+    if (loaderPendingCount() > 0) {
+        checkedFrames = 0;
+        return;
+    }
+
+    if (++checkedFrames <= ALLOC_CHECK_WARMUP_FRAMES)
+        return;
+
+    const MemStats& stats = memtrackFrameStats(MemTag_Level);
+    if (stats.allocations != 0) {
+        // Not fatalExit(): the regular shutdown joins the frame, loader and job threads first
+        logPrint(fmt() << "Allocation check failed: level made " << stats.allocations << " allocation(s) ("
+            << stats.bytes << " bytes) in a steady state frame.");
+        allocationCheckFailed = true;
+        checkAllocations = false;
+        glfwSetWindowShouldClose(window, 1);
+        return;
+    }
+
+    if (checkedFrames == ALLOC_CHECK_WARMUP_FRAMES + ALLOC_CHECK_FRAMES) {
+        logPrint(fmt() << "Allocation check passed: no allocations in " << ALLOC_CHECK_FRAMES << " frames.");
+        glfwSetWindowShouldClose(window, 1);
+    }
+}
+
 void runFrame()
 {
+    // The previous frame is complete here, including its work on the frame thread
+    profilerEndFrame();
+    if (traceRequested) {
+        traceRequested = false;
+        if (profilerEnabled)
+            profilerWriteTrace(TRACE_FILE, TRACE_FRAMES);
+        else
+            logPrint("Run the game with --profile to record traces.");
+    }
+
+    PROFILE_SCOPE("runFrame");
+
   #ifndef PLATFORM_EMSCRIPTEN
     if (!glfwGetWindowAttrib(window, GLFW_FOCUSED))
         guiSetMousePos(glm::vec2(-1.0f));
@@ -83,23 +272,50 @@ void runFrame()
     double frameTime = time - prevTime;
     prevTime = time;
 
-    int winWidth = 0, winHeight = 0;
-    glfwGetWindowSize(window, &winWidth, &winHeight);
-    guiBeginFrame(frameTime, winWidth, winHeight);
-
-    int fbWidth = 0, fbHeight = 0;
-    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
-    glViewport(0, 0, fbWidth, fbHeight);
+    FrameParams params;
+    params.frameTime = frameTime;
+    glfwGetWindowSize(window, &params.winWidth, &params.winHeight);
+    glfwGetFramebufferSize(window, &params.fbWidth, &params.fbHeight);
 
-    gameRunFrame(frameTime, winWidth, winHeight);
+    loaderRunFrame(LOADER_FRAME_BUDGET);
+    resourceCollect();
+    frameArenaReset();
 
-    guiEndFrame();
+  #ifndef PLATFORM_EMSCRIPTEN
+    drawAcquireFrame();
+    startFrame(params);
+    drawSubmit();
     glfwSwapBuffers(window);
+    waitFrame();
+  #else
+    buildFrame(params);
+    drawSubmit();
+    glfwSwapBuffers(window);
+  #endif
+
+    perfHudEndFrame(frameTime);
+    memtrackEndFrame();
+    if (checkAllocations)
+        checkFrameAllocations();
+
     glfwPollEvents();
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check-allocs") == 0)
+            checkAllocations = true;
+        else if (strcmp(argv[i], "--profile") == 0)
+            profilerEnable(true);
+        else
+            fatalExit(fmt() << "Usage: " << argv[0] << " [--check-allocs] [--profile]");
+    }
+
+    profilerSetThreadName("Main");
+
+    vfsMount("data.pak");
+
     glfwSetErrorCallback([](int, const char* message){ logPrint(fmt() << "GLFW: " << message); });
 
     if (!glfwInit())
@@ -124,24 +340,38 @@ int main()
     drawInit();
     guiInit();
     meshInitCache();
+    jobInit();
+    loaderInit();
     gameInit();
+    if (checkAllocations)
+        gameStartLevel(ALLOC_CHECK_LEVEL);
 
     prevTime = glfwGetTime();
 
   #ifdef PLATFORM_EMSCRIPTEN
     emscripten_set_main_loop(runFrame, 0, true);
   #else
+    frameThread = std::thread(frameThreadProc);
+    atexit(stopFrameThread);
+
     while (!glfwWindowShouldClose(window))
         runFrame();
 
+    stopFrameThread();
+
+    loaderShutdown();
+    jobShutdown();
     gameShutdown();
     meshShutdownCache();
+    resourceShutdown();
     guiShutdown();
     drawShutdown();
 
     glfwDestroyWindow(window);
     glfwTerminate();
+
+    vfsUnmount();
   #endif
 
-    return 0;
+    return (allocationCheckFailed ? 1 : 0);
 }
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "memtrack.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    struct Counters
+    {
+        std::atomic<size_t> allocations;
+        std::atomic<size_t> frees;
+        std::atomic<size_t> bytes;
+    };
+}
+
+static const char* const tagNames[MemTagCount] = {
+        "other",
+        "draw",
+        "level",
+        "gui",
+        "editor",
+        "loader",
+    };
+
+// Zero-initialized before any constructor runs, so allocations made during static initialization are counted too
+static Counters counters[MemTagCount];
+static MemStats frameStats[MemTagCount];
+static thread_local int currentTag;
+
+static void countAllocation(size_t size)
+{
+    Counters& c = counters[currentTag];
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void countFree()
+{
+    counters[currentTag].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemTagScope::MemTagScope(MemTag tag)
+    : mPrevTag(currentTag)
+{
+    currentTag = tag;
+}
+
+MemTagScope::~MemTagScope()
+{
+    currentTag = mPrevTag;
+}
+
+void* memtrackAlloc(size_t size)
+{
+    countAllocation(size);
+    return malloc(size);
+}
+
+void* memtrackRealloc(void* ptr, size_t size)
+{
+    countAllocation(size);
+    return realloc(ptr, size);
+}
+
+void memtrackFree(void* ptr)
+{
+    if (ptr) {
+        countFree();
+        free(ptr);
+    }
+}
+
+void memtrackEndFrame()
+{
+    for (int i = 0; i < MemTagCount; i++) {
+        frameStats[i].allocations = counters[i].allocations.exchange(0, std::memory_order_relaxed);
+        frameStats[i].frees = counters[i].frees.exchange(0, std::memory_order_relaxed);
+        frameStats[i].bytes = counters[i].bytes.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+const MemStats& memtrackFrameStats(MemTag tag)
+{
+    return frameStats[tag];
+}
+
+const char* memtrackTagName(MemTag tag)
+{
+    return tagNames[tag];
+}
+
+void* operator new(size_t size)
+{
+    countAllocation(size);
+    if (void* ptr = malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    countAllocation(size);
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    memtrackFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    memtrackFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    memtrackFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    memtrackFree(ptr);
+}
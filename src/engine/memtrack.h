@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <cstddef>
+
+// Every heap allocation of the game (global operator new, stb_image, ImGui) is counted under the tag
+// of the innermost MemTagScope alive on the allocating thread.
+enum MemTag
+{
+    MemTag_Other = 0,
+    MemTag_Draw,
+    MemTag_Level,
+    MemTag_Gui,
+    MemTag_Editor,
+    MemTag_Loader,
+    MemTagCount     // should be the last one
+};
+
+struct MemStats
+{
+    size_t allocations;
+    size_t frees;
+    size_t bytes;
+};
+
+class MemTagScope
+{
+public:
+    explicit MemTagScope(MemTag tag);
+    ~MemTagScope();
+
+    MemTagScope(const MemTagScope&) = delete;
+    MemTagScope& operator=(const MemTagScope&) = delete;
+
+private:
+    int mPrevTag;
+};
+
+// Allocation functions for C libraries.
+void* memtrackAlloc(size_t size);
+void* memtrackRealloc(void* ptr, size_t size);
+void memtrackFree(void* ptr);
+
+// Closes the counters of a frame; called between frames while nothing else runs on the frame thread.
+void memtrackEndFrame();
+
+// Counters of the last complete frame.
+const MemStats& memtrackFrameStats(MemTag tag);
+const char* memtrackTagName(MemTag tag);
+
+#endif
@@ -16,11 +16,70 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "mesh.h"
+#include "loader.h"
+#include "meshopt.h"
+#include "resource.h"
 #include "util.h"
 #include <glm/gtc/matrix_transform.hpp>
-#include <map>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
-static std::map<std::string, std::shared_ptr<Mesh>> meshCache;
+namespace
+{
+    struct MeshFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        float bboxMin[3];
+        float bboxMax[3];
+        uint32_t lodCount;
+        uint32_t reserved;
+    };
+
+    struct LodSettings
+    {
+        float minObjectSize;    // relative to the largest dimension of the mesh
+        float minScreenSize;
+        bool hull;              // replace the mesh with its bounding box
+    };
+
+    static_assert(sizeof(Mesh::Vertex) == 16, "Mesh::Vertex layout does not match the prepared mesh format.");
+    static_assert(sizeof(Mesh::Lod) == 20, "Mesh::Lod layout does not match the prepared mesh format.");
+
+    struct VertexHash
+    {
+        size_t operator()(const Mesh::Vertex& v) const
+        {
+            uint32_t words[4];
+            memcpy(words, &v, sizeof(words));
+            size_t h = 2166136261u;
+            for (uint32_t word : words)
+                h = (h ^ word) * 16777619u;
+            return h;
+        }
+    };
+
+    struct VertexEqual
+    {
+        bool operator()(const Mesh::Vertex& a, const Mesh::Vertex& b) const
+        {
+            return a.position == b.position && a.color == b.color;
+        }
+    };
+}
+
+static const char MESHB_MAGIC[4] = { 'M', 'S', 'H', 'B' };
+static const uint32_t MESHB_VERSION = 3;
+
+static const LodSettings lodSettings[] = {
+    { 0.0f, 0.05f, false },
+    { 0.1f, 0.02f, false },
+    { 0.25f, 0.008f, false },
+    { 0.0f, 0.0f, true },
+};
 
 glm::mat4 Mesh::Object::makeMatrix() const
 {
@@ -31,12 +90,12 @@ glm::mat4 Mesh::Object::makeMatrix() const
     return glm::scale(m, scale);
 }
 
-void Mesh::Object::load(std::istringstream& ss)
+void Mesh::Object::load(TextParser& parser)
 {
-    ss >> position.x >> position.y >> position.z;
-    ss >> rotation.x >> rotation.y >> rotation.z;
-    ss >> scale.x >> scale.y >> scale.z;
-    ss >> color.r >> color.g >> color.b >> color.a;
+    parser.read(position.x, position.y, position.z);
+    parser.read(rotation.x, rotation.y, rotation.z);
+    parser.read(scale.x, scale.y, scale.z);
+    parser.read(color.r, color.g, color.b, color.a);
 }
 
 void Mesh::Object::save(std::stringstream& ss) const
@@ -87,26 +146,27 @@ const glm::vec3 cubeVertices[36] = {
     {  1.0f, -1.0f,  1.0f },
 };
 
-void Mesh::Cube::bake(std::vector<Vertex>& vertices)
+void Mesh::Cube::bake(std::vector<MeshFace>& faces, std::vector<MeshSolid>& solids)
 {
-    uint32_t c = toUInt32(color);
     auto m = makeMatrix();
 
-    for (const auto& v : cubeVertices) {
+    glm::vec3 corners[8];
+    for (int i = 0; i < 8; i++) {
         glm::vec3 p;
-        p.x = (v.x < 0.0f ? p1.x : p2.x);
-        p.y = (v.y < 0.0f ? p1.y : p2.y);
-        p.z = (v.z < 0.0f ? p1.z : p2.z);
-        p = glm::vec3(m * glm::vec4(p, 1.0f));
-        vertices.emplace_back(Vertex{ p, c });
+        p.x = (i & 1 ? p2.x : p1.x);
+        p.y = (i & 2 ? p2.y : p1.y);
+        p.z = (i & 4 ? p2.z : p1.z);
+        corners[i] = glm::vec3(m * glm::vec4(p, 1.0f));
     }
+
+    meshAddBox(corners, toUInt32(color), faces, solids);
 }
 
-void Mesh::Cube::load(std::istringstream& ss)
+void Mesh::Cube::load(TextParser& parser)
 {
-    Object::load(ss);
-    ss >> p1.x >> p1.y >> p1.z;
-    ss >> p2.x >> p2.y >> p2.z;
+    Object::load(parser);
+    parser.read(p1.x, p1.y, p1.z);
+    parser.read(p2.x, p2.y, p2.z);
 }
 
 void Mesh::Cube::save(std::stringstream& ss) const
@@ -118,25 +178,23 @@ void Mesh::Cube::save(std::stringstream& ss) const
 
 void Mesh::load(const std::string& file)
 {
-    std::string data = loadFile(file);
-    std::istringstream ss(data);
+    FileMapping mapping(file);
+    TextParser parser(mapping.data(), mapping.size(), file);
 
-    size_t n = 0;
-    ss >> n;
+    size_t n = parser.readSize();
 
     objects.clear();
     objects.reserve(n);
 
     while (n--) {
-        std::string objectType;
-        ss >> objectType;
+        auto objectType = parser.readToken();
 
         if (objectType == Cube::staticTypeString()) {
             auto object = std::unique_ptr<Cube>(new Cube);
-            object->load(ss);
+            object->load(parser);
             objects.emplace_back(std::move(object));
         } else
-            fatalExit(fmt() << "Unsupported object type \"" << objectType << "\" in file \"" << file << "\".");
+            fatalExit(fmt() << "Unsupported object type \"" << objectType.toString() << "\" in file \"" << file << "\".");
     }
 
     bake();
@@ -153,12 +211,226 @@ void Mesh::save(const std::string& file) const
     saveFile(file, ss.str());
 }
 
-void Mesh::bake()
+void Mesh::loadBaked(const std::string& file)
 {
+    FileMapping mapping(file);
+
+    MeshFileHeader header;
+    if (mapping.size() < sizeof(header))
+        fatalExit(fmt() << "Prepared mesh \"" << file << "\" is corrupt.");
+    memcpy(&header, mapping.data(), sizeof(header));
+
+    if (memcmp(header.magic, MESHB_MAGIC, sizeof(MESHB_MAGIC)) != 0 || header.version != MESHB_VERSION)
+        fatalExit(fmt() << "Prepared mesh \"" << file << "\" has unsupported format.");
+    size_t vertexBytes = size_t(header.vertexCount) * sizeof(Vertex);
+    size_t indexBytes = size_t(header.indexCount) * sizeof(uint16_t);
+    size_t lodBytes = size_t(header.lodCount) * sizeof(Lod);
+    if (mapping.size() != sizeof(header) + vertexBytes + indexBytes + lodBytes)
+        fatalExit(fmt() << "Prepared mesh \"" << file << "\" is corrupt.");
+
+    objects.clear();
+
+    const char* p = mapping.data() + sizeof(header);
+    auto begin = reinterpret_cast<const Vertex*>(p);
+    vertices.assign(begin, begin + header.vertexCount);
+    p += vertexBytes;
+
+    indices.resize(header.indexCount);
+    memcpy(indices.data(), p, indexBytes);
+    p += indexBytes;
+
+    lods.resize(header.lodCount);
+    memcpy(lods.data(), p, lodBytes);
+    for (const auto& lod : lods) {
+        if (lod.firstVertex + lod.vertexCount > vertices.size() || lod.firstIndex + lod.indexCount > indices.size())
+            fatalExit(fmt() << "Prepared mesh \"" << file << "\" is corrupt.");
+    }
+
+    bboxMin = glm::vec3(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]);
+    bboxMax = glm::vec3(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]);
+    bboxCenter = (bboxMin + bboxMax) * 0.5f;
+    bboxSize = (bboxMax - bboxMin);
+}
+
+void Mesh::saveBaked(const std::string& file) const
+{
+    MeshFileHeader header;
+    memcpy(header.magic, MESHB_MAGIC, sizeof(MESHB_MAGIC));
+    header.version = MESHB_VERSION;
+    header.vertexCount = uint32_t(vertices.size());
+    header.indexCount = uint32_t(indices.size());
+    header.lodCount = uint32_t(lods.size());
+    header.reserved = 0;
+    for (int i = 0; i < 3; i++) {
+        header.bboxMin[i] = bboxMin[i];
+        header.bboxMax[i] = bboxMax[i];
+    }
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+    data.append(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint16_t));
+    data.append(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(Lod));
+
+    saveFile(file, data);
+}
+
+static void appendFaceVertices(const std::vector<MeshFace>& faces, std::vector<Mesh::Vertex>& vertices)
+{
+    static const int quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+    for (const auto& face : faces) {
+        for (int index : quadIndices)
+            vertices.emplace_back(Mesh::Vertex{ face.corners[index], face.color });
+    }
+}
+
+static void buildGeometry(std::vector<MeshFace>& faces, const std::vector<MeshSolid>& solids,
+    std::vector<Mesh::Vertex>& vertices, std::vector<uint16_t>& indices, MeshBakeStats* stats)
+{
+    size_t inputFaces = faces.size();
+    meshRemoveHiddenFaces(faces, solids);
+    meshMergeFaces(faces);
+
+    std::vector<Mesh::Vertex> soup;
+    soup.reserve(faces.size() * 6);
+    appendFaceVertices(faces, soup);
+
+    // Weld vertices with the same position and color
+    std::unordered_map<Mesh::Vertex, uint16_t, VertexHash, VertexEqual> unique;
+    unique.reserve(soup.size());
     vertices.clear();
+    indices.clear();
+    indices.reserve(soup.size());
+    for (const auto& v : soup) {
+        auto it = unique.find(v);
+        if (it == unique.end()) {
+            if (vertices.size() >= 0xFFFF)
+                fatalExit("Mesh has too many vertices.");
+            it = unique.emplace(v, uint16_t(vertices.size())).first;
+            vertices.emplace_back(v);
+        }
+        indices.emplace_back(it->second);
+    }
+
+    if (stats) {
+        stats->inputFaces = inputFaces;
+        stats->outputFaces = faces.size();
+        stats->inputVertices = soup.size();
+        stats->uniqueVertices = vertices.size();
+        stats->acmrSoup = (soup.size() >= 3 ? 3.0f : 0.0f);
+        stats->acmrWelded = meshCalcACMR(indices, vertices.size());
+    }
+
+    meshOptimizeVertexCache(indices, vertices.size());
+
+    std::vector<uint16_t> remap;
+    meshOptimizeVertexFetch(indices, vertices.size(), remap);
+    std::vector<Mesh::Vertex> ordered(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        ordered[remap[i]] = vertices[i];
+    vertices.swap(ordered);
+
+    if (stats)
+        stats->acmrOptimized = meshCalcACMR(indices, vertices.size());
+}
+
+// Average color of the faces weighted by their area
+static uint32_t averageColor(const std::vector<MeshFace>& faces)
+{
+    double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double totalArea = 0.0;
+    for (const auto& face : faces) {
+        double area = glm::length(glm::cross(face.corners[2] - face.corners[0], face.corners[3] - face.corners[1]));
+        for (int i = 0; i < 4; i++)
+            sum[i] += area * double((face.color >> (i * 8)) & 0xFF);
+        totalArea += area;
+    }
+
+    uint32_t color = 0;
+    if (totalArea > 0.0) {
+        for (int i = 0; i < 4; i++)
+            color |= uint32_t(sum[i] / totalArea + 0.5) << (i * 8);
+    }
+    return color;
+}
 
+void Mesh::bake(MeshBakeStats* stats)
+{
+    std::vector<MeshFace> allFaces;
+    std::vector<MeshSolid> allSolids;
     for (const auto& object : objects)
-        object->bake(vertices);
+        object->bake(allFaces, allSolids);
+
+    glm::vec3 minCorner(0.0f), maxCorner(0.0f);
+    if (!allFaces.empty()) {
+        minCorner = maxCorner = allFaces[0].corners[0];
+        for (const auto& face : allFaces) {
+            for (const auto& c : face.corners) {
+                minCorner = glm::min(minCorner, c);
+                maxCorner = glm::max(maxCorner, c);
+            }
+        }
+    }
+    glm::vec3 size = maxCorner - minCorner;
+    float maxSize = std::max(size.x, std::max(size.y, size.z));
+
+    vertices.clear();
+    indices.clear();
+    lods.clear();
+    preview = false;
+
+    uint32_t hullColor = 0;
+    for (const auto& settings : lodSettings) {
+        std::vector<MeshFace> faces;
+        std::vector<MeshSolid> solids;
+
+        if (settings.hull) {
+            if (lods.empty() || lods.back().indexCount <= 36)
+                break;
+            glm::vec3 corners[8];
+            for (int i = 0; i < 8; i++) {
+                corners[i].x = (i & 1 ? maxCorner.x : minCorner.x);
+                corners[i].y = (i & 2 ? maxCorner.y : minCorner.y);
+                corners[i].z = (i & 4 ? maxCorner.z : minCorner.z);
+            }
+            meshAddBox(corners, hullColor, faces, solids);
+        } else {
+            // Small solids neither show up nor hide anything at this level
+            solids = allSolids;
+            for (auto& solid : solids) {
+                glm::vec3 extent = solid.bboxMax - solid.bboxMin;
+                if (std::max(extent.x, std::max(extent.y, extent.z)) < settings.minObjectSize * maxSize)
+                    solid.valid = false;
+            }
+            for (const auto& face : allFaces) {
+                if (solids[face.solid].valid || !allSolids[face.solid].valid)
+                    faces.emplace_back(face);
+            }
+        }
+
+        std::vector<Vertex> lodVertices;
+        std::vector<uint16_t> lodIndices;
+        buildGeometry(faces, solids, lodVertices, lodIndices, (lods.empty() ? stats : nullptr));
+
+        // Skip levels that did not get any simpler
+        if (!lods.empty() && (lodIndices.empty() || lodIndices.size() >= lods.back().indexCount)) {
+            lods.back().minScreenSize = settings.minScreenSize;
+            continue;
+        }
+
+        if (lods.empty())
+            hullColor = averageColor(faces);
+
+        Lod lod;
+        lod.firstVertex = uint32_t(vertices.size());
+        lod.vertexCount = uint32_t(lodVertices.size());
+        lod.firstIndex = uint32_t(indices.size());
+        lod.indexCount = uint32_t(lodIndices.size());
+        lod.minScreenSize = settings.minScreenSize;
+        lods.emplace_back(lod);
+
+        vertices.insert(vertices.end(), lodVertices.begin(), lodVertices.end());
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
 
     if (vertices.empty()) {
         bboxMin = glm::vec3(0.0f);
@@ -177,22 +449,198 @@ void Mesh::bake()
     }
 }
 
+void Mesh::bakeIncremental()
+{
+    if (!preview) {
+        vertices.clear();
+        indices.clear();
+        preview = true;
+    }
+
+    std::vector<MeshFace> faces;
+    std::vector<MeshSolid> solids;
+    std::vector<Vertex> objectVertices;
+    bool recalcBounds = false;
+
+    uint32_t offset = 0;
+    for (size_t i = 0; i < objects.size(); i++) {
+        auto& object = *objects[i];
+
+        // Object was inserted or an object before it changed size: rebuild the rest of the mesh
+        if (object.firstVertex != offset || offset + object.vertexCount > vertices.size()) {
+            vertices.resize(offset);
+            object.dirty = true;
+            object.vertexCount = 0;
+            recalcBounds = true;
+        }
+
+        if (object.dirty) {
+            faces.clear();
+            solids.clear();
+            objectVertices.clear();
+            object.bake(faces, solids);
+            appendFaceVertices(faces, objectVertices);
+
+            glm::vec3 oldMin = object.bboxMin;
+            glm::vec3 oldMax = object.bboxMax;
+            uint32_t oldCount = object.vertexCount;
+
+            if (!objectVertices.empty()) {
+                object.bboxMin = object.bboxMax = objectVertices[0].position;
+                for (const auto& v : objectVertices) {
+                    object.bboxMin = glm::min(object.bboxMin, v.position);
+                    object.bboxMax = glm::max(object.bboxMax, v.position);
+                }
+            }
+
+            if (objectVertices.size() == oldCount)
+                std::copy(objectVertices.begin(), objectVertices.end(), vertices.begin() + offset);
+            else {
+                vertices.resize(offset);
+                vertices.insert(vertices.end(), objectVertices.begin(), objectVertices.end());
+            }
+
+            object.firstVertex = offset;
+            object.vertexCount = uint32_t(objectVertices.size());
+            object.dirty = false;
+
+            // Growing the bounds is always safe; an object that defined an edge and moved away from
+            // it requires a rescan of the object bounds.
+            if (oldCount == 0 || object.vertexCount == 0)
+                recalcBounds = true;
+            else if (!recalcBounds) {
+                for (int j = 0; j < 3; j++) {
+                    if ((oldMin[j] <= bboxMin[j] && object.bboxMin[j] > oldMin[j])
+                            || (oldMax[j] >= bboxMax[j] && object.bboxMax[j] < oldMax[j]))
+                        recalcBounds = true;
+                }
+                bboxMin = glm::min(bboxMin, object.bboxMin);
+                bboxMax = glm::max(bboxMax, object.bboxMax);
+            }
+        }
+
+        offset += object.vertexCount;
+    }
+
+    // Objects removed from the end
+    if (vertices.size() != offset) {
+        vertices.resize(offset);
+        recalcBounds = true;
+    }
+    if (vertices.size() >= 0xFFFF)
+        fatalExit("Mesh has too many vertices.");
+
+    size_t oldIndexCount = indices.size();
+    indices.resize(vertices.size());
+    for (size_t i = oldIndexCount; i < indices.size(); i++)
+        indices[i] = uint16_t(i);
+
+    Lod lod;
+    lod.firstVertex = 0;
+    lod.vertexCount = uint32_t(vertices.size());
+    lod.firstIndex = 0;
+    lod.indexCount = uint32_t(indices.size());
+    lod.minScreenSize = 0.0f;
+    lods.assign(1, lod);
+
+    if (recalcBounds) {
+        bool first = true;
+        bboxMin = bboxMax = glm::vec3(0.0f);
+        for (const auto& object : objects) {
+            if (object->vertexCount == 0)
+                continue;
+            bboxMin = (first ? object->bboxMin : glm::min(bboxMin, object->bboxMin));
+            bboxMax = (first ? object->bboxMax : glm::max(bboxMax, object->bboxMax));
+            first = false;
+        }
+    }
+
+    bboxCenter = (bboxMin + bboxMax) * 0.5f;
+    bboxSize = (bboxMax - bboxMin);
+}
+
+size_t Mesh::selectLod(float screenSize) const
+{
+    for (size_t i = 0; i < lods.size(); i++) {
+        if (screenSize >= lods[i].minScreenSize)
+            return i;
+    }
+    return (lods.empty() ? 0 : lods.size() - 1);
+}
+
+size_t Mesh::memoryUsage() const
+{
+    return sizeof(Mesh)
+        + vertices.capacity() * sizeof(Vertex)
+        + indices.capacity() * sizeof(uint16_t)
+        + lods.capacity() * sizeof(Lod)
+        + objects.capacity() * (sizeof(std::unique_ptr<Object>) + sizeof(Cube));
+}
+
 void meshInitCache()
 {
 }
 
 void meshShutdownCache()
 {
-    meshCache.clear();
+    resourceClear(Resource_Mesh);
+}
+
+static size_t meshSize(const void* mesh)
+{
+    return static_cast<const Mesh*>(mesh)->memoryUsage();
 }
 
-const std::shared_ptr<Mesh>& meshGetCached(const std::string& name)
+static void loadMesh(Mesh& mesh, const std::string& name)
 {
-    auto it = meshCache.find(name);
-    if (it == meshCache.end()) {
-        auto mesh = std::make_shared<Mesh>();
-        mesh->load(name);
-        it = meshCache.emplace(name, std::move(mesh)).first;
+    std::string prepared = changeFileExtension(name, ".meshb");
+    if (preparedFileIsCurrent(prepared, name))
+        mesh.loadBaked(prepared);
+    else
+        mesh.load(name);
+}
+
+std::shared_ptr<Mesh> meshGetCached(AssetId id)
+{
+    auto mesh = resourceFind<Mesh>(Resource_Mesh, id);
+    if (!mesh) {
+        mesh = std::make_shared<Mesh>();
+        loadMesh(*mesh, assetName(id));
+        resourceInsert(Resource_Mesh, id, mesh, meshSize);
+    } else if (mesh->loading) {
+        loadMesh(*mesh, assetName(id));
+        mesh->loading = false;
     }
-    return it->second;
+    return mesh;
+}
+
+std::shared_ptr<Mesh> meshGetCached(const std::string& name)
+{
+    return meshGetCached(assetIntern(name));
+}
+
+std::shared_ptr<Mesh> meshGetCachedAsync(AssetId id)
+{
+    auto mesh = resourceFind<Mesh>(Resource_Mesh, id);
+    if (mesh)
+        return mesh;
+
+    mesh = std::make_shared<Mesh>();
+    mesh->bboxMin = mesh->bboxMax = mesh->bboxCenter = mesh->bboxSize = glm::vec3(0.0f);
+    mesh->loading = true;
+
+    auto loaded = std::make_shared<Mesh>();
+    const std::string& name = assetName(id);
+    loaderPost(
+        [loaded, name]() {
+            loadMesh(*loaded, name);
+        },
+        [loaded, mesh]() {
+            // Mesh may have been loaded synchronously in the meantime
+            if (mesh->loading)
+                *mesh = std::move(*loaded);
+        });
+
+    resourceInsert(Resource_Mesh, id, mesh, meshSize);
+    return mesh;
 }
@@ -18,12 +18,26 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include "engine/assetid.h"
+#include "engine/meshopt.h"
 #include "engine/opengl.h"
+#include "engine/parser.h"
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
 #include <vector>
 
+struct MeshBakeStats
+{
+    size_t inputFaces;
+    size_t outputFaces;     // after hidden face removal and merging
+    size_t inputVertices;
+    size_t uniqueVertices;
+    float acmrSoup;         // unindexed triangles, every vertex is a miss
+    float acmrWelded;       // welded mesh in the original triangle order
+    float acmrOptimized;
+};
+
 struct Mesh
 {
     struct Vertex
@@ -39,6 +53,13 @@ struct Mesh
         glm::vec3 scale{1.0f};
         glm::vec4 color{1.0f};
 
+        // Range of the object in the preview geometry and its bounds, see bakeIncremental()
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        glm::vec3 bboxMin{0.0f};
+        glm::vec3 bboxMax{0.0f};
+        bool dirty = true;
+
         virtual ~Object() = default;
 
         virtual const char* typeString() const = 0;
@@ -47,10 +68,10 @@ struct Mesh
 
         glm::mat4 makeMatrix() const;
 
-        virtual void load(std::istringstream& ss) = 0;
+        virtual void load(TextParser& parser) = 0;
         virtual void save(std::stringstream& ss) const = 0;
 
-        virtual void bake(std::vector<Vertex>& vertices) = 0;
+        virtual void bake(std::vector<MeshFace>& faces, std::vector<MeshSolid>& solids) = 0;
     };
 
     struct Cube : public Object
@@ -63,23 +84,53 @@ struct Mesh
 
         Object* clone() const override { return new Cube(*this); }
 
-        void load(std::istringstream& ss) override;
+        void load(TextParser& parser) override;
         void save(std::stringstream& ss) const override;
 
-        void bake(std::vector<Vertex>& vertices) override;
+        void bake(std::vector<MeshFace>& faces, std::vector<MeshSolid>& solids) override;
+    };
+
+    // Range of `vertices` and `indices` for one level of detail. Indices are relative to the first
+    // vertex of the level.
+    struct Lod
+    {
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float minScreenSize;    // fraction of the viewport height the mesh should cover to use this level
     };
 
     std::vector<std::unique_ptr<Object>> objects;
     std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<Lod> lods;      // from the most detailed one
     glm::vec3 bboxMin;
     glm::vec3 bboxMax;
     glm::vec3 bboxCenter;
     glm::vec3 bboxSize;
+    bool loading = false;   // empty placeholder while an asynchronous load is in flight
+    bool preview = false;   // geometry was built by bakeIncremental()
 
     void load(const std::string& file);
     void save(const std::string& file) const;
 
-    void bake();
+    // Prepared meshes (".meshb") contain only the baked vertices, indices and bounds, not the objects.
+    void loadBaked(const std::string& file);
+    void saveBaked(const std::string& file) const;
+
+    // Drops hidden faces, merges coplanar ones, welds identical vertices and orders triangles and
+    // vertices for the GPU caches. Lower levels of detail drop small objects and end with the
+    // bounding box. Statistics are for the most detailed level.
+    void bake(MeshBakeStats* stats = nullptr);
+
+    // Quick bake for editing: a single level of unoptimized geometry where only objects marked dirty
+    // (or moved by insertions before them) are rebuilt.
+    void bakeIncremental();
+
+    size_t selectLod(float screenSize) const;
+
+    size_t memoryUsage() const;
 };
 
 extern const glm::vec3 cubeVertices[36];
@@ -87,6 +138,11 @@ extern const glm::vec3 cubeVertices[36];
 void meshInitCache();
 void meshShutdownCache();
 
-const std::shared_ptr<Mesh>& meshGetCached(const std::string& name);
+std::shared_ptr<Mesh> meshGetCached(AssetId id);
+std::shared_ptr<Mesh> meshGetCached(const std::string& name);
+
+// Returns the cached mesh right away; a mesh seen for the first time stays empty until the loader
+// finishes it. meshGetCached() on a mesh that is still loading loads it synchronously.
+std::shared_ptr<Mesh> meshGetCachedAsync(AssetId id);
 
 #endif
@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "meshopt.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cmath>
+
+static const int CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static const float FACE_EPSILON = 1e-3f;
+static const float FACE_PROBE_DISTANCE = 1e-2f;
+static const float AXIS_EPSILON = 1e-5f;
+
+static const int boxFaces[6][4] = {
+    { 0, 2, 6, 4 },
+    { 1, 5, 7, 3 },
+    { 0, 4, 5, 1 },
+    { 2, 3, 7, 6 },
+    { 0, 1, 3, 2 },
+    { 4, 6, 7, 5 },
+};
+
+namespace
+{
+    struct Rect
+    {
+        float u0, v0, u1, v1;
+    };
+
+    struct AxisFace
+    {
+        int axis;
+        bool positive;
+        float d;
+        Rect rect;
+    };
+
+    struct MergeFace
+    {
+        AxisFace face;
+        uint32_t color;
+        bool alive;
+    };
+}
+
+static float vertexScore(int cachePosition, int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // Vertices of the last triangle get a fixed score so that the next triangle does not simply
+        // reuse its edge, which would favour strips over fans.
+        if (cachePosition < 3)
+            score = LAST_TRIANGLE_SCORE;
+        else {
+            float scale = 1.0f / float(CACHE_SIZE - 3);
+            score = powf(1.0f - float(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Vertices with few triangles left are finished first so that they can leave the cache
+    return score + VALENCE_BOOST_SCALE * powf(float(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+void meshOptimizeVertexCache(std::vector<uint16_t>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles that use each vertex; the first `remaining[v]` entries are not emitted yet
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint16_t index : indices)
+        ++offsets[index + 1];
+    for (size_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<int> remaining(vertexCount, 0);
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint16_t v = indices[i];
+        vertexTriangles[offsets[v] + uint32_t(remaining[v]++)] = uint32_t(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<uint16_t> result;
+    result.reserve(indices.size());
+
+    std::vector<uint16_t> cache;
+    std::vector<uint16_t> newCache;
+    cache.reserve(CACHE_SIZE + 3);
+    newCache.reserve(CACHE_SIZE + 3);
+
+    size_t scanStart = 0;
+    long best = -1;
+    for (size_t n = 0; n < triangleCount; n++) {
+        // When no triangle in the cache is left, take the best of the remaining ones
+        if (best < 0) {
+            float bestScore = -1.0f;
+            while (emitted[scanStart])
+                ++scanStart;
+            for (size_t t = scanStart; t < triangleCount; t++) {
+                if (!emitted[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = long(t);
+                }
+            }
+        }
+
+        size_t t = size_t(best);
+        emitted[t] = true;
+
+        newCache.clear();
+        for (int i = 0; i < 3; i++) {
+            uint16_t v = indices[t * 3 + i];
+            result.push_back(v);
+            newCache.push_back(v);
+
+            uint32_t* list = &vertexTriangles[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++) {
+                if (list[j] == t) {
+                    list[j] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        for (uint16_t v : cache) {
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+                newCache.push_back(v);
+        }
+        cache.swap(newCache);
+
+        // Vertices pushed out of the cache are rescored as well
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint16_t v = cache[i];
+            cachePosition[v] = (i < size_t(CACHE_SIZE) ? int(i) : -1);
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint16_t v : cache) {
+            const uint32_t* list = &vertexTriangles[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++) {
+                uint32_t tt = list[j];
+                triangleScore[tt] = score[indices[tt * 3]] + score[indices[tt * 3 + 1]] + score[indices[tt * 3 + 2]];
+                if (triangleScore[tt] > bestScore) {
+                    bestScore = triangleScore[tt];
+                    best = long(tt);
+                }
+            }
+        }
+
+        if (cache.size() > size_t(CACHE_SIZE))
+            cache.resize(CACHE_SIZE);
+    }
+
+    indices.swap(result);
+}
+
+void meshOptimizeVertexFetch(std::vector<uint16_t>& indices, size_t vertexCount, std::vector<uint16_t>& remap)
+{
+    const uint16_t UNUSED = 0xFFFF;
+    remap.assign(vertexCount, UNUSED);
+
+    uint16_t next = 0;
+    for (auto& index : indices) {
+        if (remap[index] == UNUSED)
+            remap[index] = next++;
+        index = remap[index];
+    }
+
+    // Unreferenced vertices go to the end
+    for (auto& index : remap) {
+        if (index == UNUSED)
+            index = next++;
+    }
+}
+
+float meshCalcACMR(const std::vector<uint16_t>& indices, size_t vertexCount, size_t cacheSize)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    // Entries store the time a vertex was added; a vertex is still cached while fewer than
+    // `cacheSize` misses happened since.
+    std::vector<size_t> addedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (uint16_t index : indices) {
+        if (addedAt[index] == 0 || misses - addedAt[index] >= cacheSize) {
+            ++misses;
+            addedAt[index] = misses;
+        }
+    }
+
+    return float(misses) / float(indices.size() / 3);
+}
+
+static glm::vec3 faceNormal(const glm::vec3 corners[4])
+{
+    return glm::cross(corners[2] - corners[0], corners[3] - corners[1]);
+}
+
+void meshAddBox(const glm::vec3 corners[8], uint32_t color, std::vector<MeshFace>& faces, std::vector<MeshSolid>& solids)
+{
+    MeshSolid solid;
+    solid.valid = true;
+    solid.axisAligned = true;
+    solid.bboxMin = corners[0];
+    solid.bboxMax = corners[0];
+
+    glm::vec3 center(0.0f);
+    for (int i = 0; i < 8; i++) {
+        solid.bboxMin = glm::min(solid.bboxMin, corners[i]);
+        solid.bboxMax = glm::max(solid.bboxMax, corners[i]);
+        center += corners[i];
+    }
+    center *= 1.0f / 8.0f;
+
+    for (int i = 0; i < 6; i++) {
+        MeshFace face;
+        face.color = color;
+        face.solid = solids.size();
+        for (int j = 0; j < 4; j++)
+            face.corners[j] = corners[boxFaces[i][j]];
+
+        // Negative scale or swapped corners turn the box inside out
+        glm::vec3 n = faceNormal(face.corners);
+        glm::vec3 faceCenter = (face.corners[0] + face.corners[1] + face.corners[2] + face.corners[3]) * 0.25f;
+        if (glm::dot(n, faceCenter - center) < 0.0f) {
+            std::swap(face.corners[1], face.corners[3]);
+            n = -n;
+        }
+
+        float length = glm::length(n);
+        if (length < 1e-8f) {
+            solid.valid = false;
+            solid.planes[i] = glm::vec4(0.0f);
+            continue;
+        }
+
+        n /= length;
+        solid.planes[i] = glm::vec4(n, glm::dot(n, face.corners[0]));
+        if (std::max(fabsf(n.x), std::max(fabsf(n.y), fabsf(n.z))) < 1.0f - AXIS_EPSILON)
+            solid.axisAligned = false;
+
+        faces.emplace_back(face);
+    }
+
+    solids.emplace_back(solid);
+}
+
+static bool pointInSolid(const glm::vec3& p, const MeshSolid& solid)
+{
+    for (const auto& plane : solid.planes) {
+        if (glm::dot(glm::vec3(plane), p) - plane.w > FACE_EPSILON)
+            return false;
+    }
+    return true;
+}
+
+// Face lies within the solid and the solid continues in front of it
+static bool faceInSolid(const glm::vec3 corners[4], const MeshSolid& solid)
+{
+    for (int i = 0; i < 4; i++) {
+        if (!pointInSolid(corners[i], solid))
+            return false;
+    }
+
+    glm::vec3 center = (corners[0] + corners[1] + corners[2] + corners[3]) * 0.25f;
+    glm::vec3 n = glm::normalize(faceNormal(corners));
+    return pointInSolid(center + n * FACE_PROBE_DISTANCE, solid);
+}
+
+// Describes an axis-aligned rectangular face by its plane and extents on the other two axes
+static bool getAxisFace(const MeshFace& face, AxisFace& out)
+{
+    glm::vec3 n = faceNormal(face.corners);
+    float length = glm::length(n);
+    if (length < 1e-8f)
+        return false;
+    n /= length;
+
+    int k = 0;
+    if (fabsf(n.y) > fabsf(n[k]))
+        k = 1;
+    if (fabsf(n.z) > fabsf(n[k]))
+        k = 2;
+    if (fabsf(n[k]) < 1.0f - AXIS_EPSILON)
+        return false;
+
+    int u = (k + 1) % 3;
+    int v = (k + 2) % 3;
+    out.axis = k;
+    out.positive = (n[k] > 0.0f);
+    out.d = 0.0f;
+    out.rect.u0 = out.rect.u1 = face.corners[0][u];
+    out.rect.v0 = out.rect.v1 = face.corners[0][v];
+    for (const auto& c : face.corners) {
+        out.d += c[k] * 0.25f;
+        out.rect.u0 = std::min(out.rect.u0, c[u]);
+        out.rect.u1 = std::max(out.rect.u1, c[u]);
+        out.rect.v0 = std::min(out.rect.v0, c[v]);
+        out.rect.v1 = std::max(out.rect.v1, c[v]);
+    }
+
+    // Every corner must be a corner of the bounding rectangle
+    for (const auto& c : face.corners) {
+        bool onU = (fabsf(c[u] - out.rect.u0) < FACE_EPSILON || fabsf(c[u] - out.rect.u1) < FACE_EPSILON);
+        bool onV = (fabsf(c[v] - out.rect.v0) < FACE_EPSILON || fabsf(c[v] - out.rect.v1) < FACE_EPSILON);
+        if (!onU || !onV)
+            return false;
+    }
+
+    return true;
+}
+
+static void getAxisFaceCorners(const AxisFace& face, glm::vec3 corners[4])
+{
+    int u = (face.axis + 1) % 3;
+    int v = (face.axis + 2) % 3;
+    float coords[4][2] = {
+        { face.rect.u0, face.rect.v0 },
+        { face.rect.u1, face.rect.v0 },
+        { face.rect.u1, face.rect.v1 },
+        { face.rect.u0, face.rect.v1 },
+    };
+
+    // (u, v, axis) is a right-handed basis, so this order faces the positive direction
+    for (int i = 0; i < 4; i++) {
+        int j = (face.positive ? i : (4 - i) % 4);
+        corners[i][face.axis] = face.d;
+        corners[i][u] = coords[j][0];
+        corners[i][v] = coords[j][1];
+    }
+}
+
+static void subtractRect(std::vector<Rect>& pieces, const Rect& r)
+{
+    std::vector<Rect> result;
+    for (const auto& p : pieces) {
+        if (r.u0 >= p.u1 - FACE_EPSILON || r.u1 <= p.u0 + FACE_EPSILON
+                || r.v0 >= p.v1 - FACE_EPSILON || r.v1 <= p.v0 + FACE_EPSILON) {
+            result.emplace_back(p);
+            continue;
+        }
+
+        float u0 = std::max(p.u0, r.u0);
+        float u1 = std::min(p.u1, r.u1);
+        if (r.u0 > p.u0 + FACE_EPSILON)
+            result.emplace_back(Rect{ p.u0, p.v0, r.u0, p.v1 });
+        if (r.u1 < p.u1 - FACE_EPSILON)
+            result.emplace_back(Rect{ r.u1, p.v0, p.u1, p.v1 });
+        if (r.v0 > p.v0 + FACE_EPSILON)
+            result.emplace_back(Rect{ u0, p.v0, u1, r.v0 });
+        if (r.v1 < p.v1 - FACE_EPSILON)
+            result.emplace_back(Rect{ u0, r.v1, u1, p.v1 });
+    }
+    pieces.swap(result);
+}
+
+static bool isFaceHidden(const MeshFace& face, const std::vector<MeshSolid>& solids)
+{
+    AxisFace axisFace;
+    if (!getAxisFace(face, axisFace)) {
+        for (size_t i = 0; i < solids.size(); i++) {
+            if (i != face.solid && solids[i].valid && faceInSolid(face.corners, solids[i]))
+                return true;
+        }
+        return false;
+    }
+
+    int k = axisFace.axis;
+    int u = (k + 1) % 3;
+    int v = (k + 2) % 3;
+    float d = axisFace.d;
+
+    // Cut away the cross sections of axis-aligned solids that continue in front of the face
+    std::vector<Rect> pieces(1, axisFace.rect);
+    for (size_t i = 0; i < solids.size() && !pieces.empty(); i++) {
+        const auto& solid = solids[i];
+        if (i == face.solid || !solid.valid || !solid.axisAligned)
+            continue;
+
+        float lo = solid.bboxMin[k];
+        float hi = solid.bboxMax[k];
+        bool inFront = (axisFace.positive
+            ? (lo <= d + FACE_EPSILON && hi > d + FACE_EPSILON)
+            : (hi >= d - FACE_EPSILON && lo < d - FACE_EPSILON));
+        if (inFront)
+            subtractRect(pieces, Rect{ solid.bboxMin[u], solid.bboxMin[v], solid.bboxMax[u], solid.bboxMax[v] });
+    }
+
+    // Whatever is left must be inside a rotated solid
+    for (const auto& piece : pieces) {
+        AxisFace part = axisFace;
+        part.rect = piece;
+        glm::vec3 corners[4];
+        getAxisFaceCorners(part, corners);
+
+        bool covered = false;
+        for (size_t i = 0; i < solids.size() && !covered; i++) {
+            if (i != face.solid && solids[i].valid && !solids[i].axisAligned)
+                covered = faceInSolid(corners, solids[i]);
+        }
+        if (!covered)
+            return false;
+    }
+
+    return true;
+}
+
+void meshRemoveHiddenFaces(std::vector<MeshFace>& faces, const std::vector<MeshSolid>& solids)
+{
+    std::vector<uint8_t> hidden(faces.size());
+    jobParallelFor(faces.size(), [&faces, &solids, &hidden](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            hidden[i] = (isFaceHidden(faces[i], solids) ? 1 : 0);
+    });
+
+    std::vector<MeshFace> visible;
+    visible.reserve(faces.size());
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (!hidden[i])
+            visible.emplace_back(faces[i]);
+    }
+    faces.swap(visible);
+}
+
+static bool tryMerge(Rect& a, const Rect& b)
+{
+    if (fabsf(a.v0 - b.v0) < FACE_EPSILON && fabsf(a.v1 - b.v1) < FACE_EPSILON
+            && (fabsf(a.u1 - b.u0) < FACE_EPSILON || fabsf(b.u1 - a.u0) < FACE_EPSILON)) {
+        a.u0 = std::min(a.u0, b.u0);
+        a.u1 = std::max(a.u1, b.u1);
+        return true;
+    }
+
+    if (fabsf(a.u0 - b.u0) < FACE_EPSILON && fabsf(a.u1 - b.u1) < FACE_EPSILON
+            && (fabsf(a.v1 - b.v0) < FACE_EPSILON || fabsf(b.v1 - a.v0) < FACE_EPSILON)) {
+        a.v0 = std::min(a.v0, b.v0);
+        a.v1 = std::max(a.v1, b.v1);
+        return true;
+    }
+
+    return false;
+}
+
+void meshMergeFaces(std::vector<MeshFace>& faces)
+{
+    std::vector<MeshFace> result;
+    std::vector<MergeFace> candidates;
+    for (const auto& face : faces) {
+        MergeFace candidate;
+        if (!getAxisFace(face, candidate.face)) {
+            result.emplace_back(face);
+            continue;
+        }
+        candidate.color = face.color;
+        candidate.alive = true;
+        candidates.emplace_back(candidate);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const MergeFace& a, const MergeFace& b) {
+            if (a.face.axis != b.face.axis)
+                return a.face.axis < b.face.axis;
+            if (a.face.positive != b.face.positive)
+                return a.face.positive < b.face.positive;
+            if (a.color != b.color)
+                return a.color < b.color;
+            return a.face.d < b.face.d;
+        });
+
+    size_t begin = 0;
+    while (begin < candidates.size()) {
+        const auto& first = candidates[begin];
+        size_t end = begin + 1;
+        while (end < candidates.size()
+                && candidates[end].face.axis == first.face.axis
+                && candidates[end].face.positive == first.face.positive
+                && candidates[end].color == first.color
+                && candidates[end].face.d - first.face.d < FACE_EPSILON)
+            ++end;
+
+        bool merged;
+        do {
+            merged = false;
+            for (size_t i = begin; i < end; i++) {
+                if (!candidates[i].alive)
+                    continue;
+                for (size_t j = i + 1; j < end; j++) {
+                    if (candidates[j].alive && tryMerge(candidates[i].face.rect, candidates[j].face.rect)) {
+                        candidates[j].alive = false;
+                        merged = true;
+                    }
+                }
+            }
+        } while (merged);
+
+        for (size_t i = begin; i < end; i++) {
+            if (!candidates[i].alive)
+                continue;
+            MeshFace face;
+            getAxisFaceCorners(candidates[i].face, face.corners);
+            face.color = candidates[i].color;
+            face.solid = 0;
+            result.emplace_back(face);
+        }
+
+        begin = end;
+    }
+
+    faces.swap(result);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Planar quad with corners in counter-clockwise order when viewed from the front.
+struct MeshFace
+{
+    glm::vec3 corners[4];
+    uint32_t color;
+    size_t solid;           // index of the solid the face belongs to
+};
+
+// Convex solid that can hide faces of other solids, described by its outward facing planes.
+struct MeshSolid
+{
+    glm::vec4 planes[6];    // xyz = unit normal, w = distance
+    glm::vec3 bboxMin;
+    glm::vec3 bboxMax;
+    bool valid;             // false for degenerate solids, which hide nothing
+    bool axisAligned;       // solid is exactly its bounding box
+};
+
+// Adds a box as a solid and its six faces. Corner `i` has bit 0 set for the maximum X, bit 1 for the
+// maximum Y and bit 2 for the maximum Z.
+void meshAddBox(const glm::vec3 corners[8], uint32_t color, std::vector<MeshFace>& faces, std::vector<MeshSolid>& solids);
+
+// Removes faces that are fully covered by other solids. Axis-aligned faces are clipped against the
+// union of axis-aligned solids in front of them; everything else is only dropped when it lies
+// entirely within a single solid.
+void meshRemoveHiddenFaces(std::vector<MeshFace>& faces, const std::vector<MeshSolid>& solids);
+
+// Greedily merges coplanar axis-aligned faces of the same color that share a full edge.
+void meshMergeFaces(std::vector<MeshFace>& faces);
+
+// Reorders triangles for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm).
+void meshOptimizeVertexCache(std::vector<uint16_t>& indices, size_t vertexCount);
+
+// Renumbers vertices in the order of their first use. Fills `remap` with the new index of every
+// old vertex so that the caller can reorder its vertex array.
+void meshOptimizeVertexFetch(std::vector<uint16_t>& indices, size_t vertexCount, std::vector<uint16_t>& remap);
+
+// Average number of vertex shader invocations per triangle with a FIFO cache of the given size:
+// 3 for a triangle soup, 0.5 at best for a regular grid.
+float meshCalcACMR(const std::vector<uint16_t>& indices, size_t vertexCount, size_t cacheSize = 16);
+
+#endif
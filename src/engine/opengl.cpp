@@ -16,10 +16,22 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "opengl.h"
+#include "etc1.h"
+#include "jobs.h"
+#include "ktx.h"
+#include "loader.h"
+#include "memtrack.h"
+#include "resource.h"
 #include "util.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <vector>
 
 #define STBI_NO_STDIO
+#define STBI_MALLOC(size) memtrackAlloc(size)
+#define STBI_REALLOC(ptr, size) memtrackRealloc(ptr, size)
+#define STBI_FREE(ptr) memtrackFree(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
@@ -58,74 +70,278 @@ GLuint openglLoadTexture(const std::string& file, int repeat, GLenum filter)
     return openglLoadTextureEx(file, nullptr, nullptr, repeat, filter);
 }
 
-GLuint openglLoadTextureEx(const std::string& file, int* width, int* height, int repeat, GLenum filter)
+namespace
+{
+    // Texture data ready for upload. Decoding touches no OpenGL state, so it can run on a loader thread.
+    struct TextureData
+    {
+        std::unique_ptr<FileMapping> file;
+        KtxImage image;
+        GLint unpackAlignment = 4;
+        stbi_uc* pixels = nullptr;
+        std::vector<std::vector<uint8_t>> decodedLevels;
+
+        TextureData() = default;
+        ~TextureData() { if (pixels) stbi_image_free(pixels); }
+
+        TextureData(const TextureData&) = delete;
+        TextureData& operator=(const TextureData&) = delete;
+    };
+}
+
+static const uint8_t placeholderPixel[4] = { 128, 128, 128, 255 };
+
+static bool isMipmapFilter(GLenum filter)
 {
-    std::string fileData = loadFile(file);
+    switch (filter) {
+        case GL_NEAREST_MIPMAP_NEAREST:
+        case GL_NEAREST_MIPMAP_LINEAR:
+        case GL_LINEAR_MIPMAP_NEAREST:
+        case GL_LINEAR_MIPMAP_LINEAR:
+            return true;
+    }
+    return false;
+}
+
+bool openglHasExtension(const char* name)
+{
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!extensions)
+        return false;
+
+    size_t length = strlen(name);
+    for (const char* p = extensions; (p = strstr(p, name)) != nullptr; p += length) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == 0))
+            return true;
+    }
+
+    return false;
+}
+
+static bool hasEtc1Support()
+{
+    static int supported = -1;
+    if (supported < 0) {
+        supported = (openglHasExtension("GL_OES_compressed_ETC1_RGB8_texture")
+            || openglHasExtension("OES_compressed_ETC1_RGB8_texture")
+            || openglHasExtension("WEBGL_compressed_texture_etc1") ? 1 : 0);
+        if (!supported)
+            logPrint("ETC1 textures are not supported by the driver and will be decoded in software.");
+    }
+    return supported != 0;
+}
+
+// Converts ETC1 levels into plain RGB for drivers that cannot sample them.
+static void decodeEtc1Levels(TextureData& data)
+{
+    KtxImage& image = data.image;
+
+    int w = int(image.width);
+    int h = int(image.height);
+    for (auto& level : image.levels) {
+        if (level.size < etc1ImageSize(w, h))
+            fatalExit("ETC1 texture is corrupt.");
+
+        data.decodedLevels.emplace_back(size_t(w) * size_t(h) * 3);
+        auto& pixels = data.decodedLevels.back();
+        const uint8_t* blocks = reinterpret_cast<const uint8_t*>(level.data);
+        jobParallelFor(size_t((h + 3) / 4), [blocks, w, h, &pixels](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++)
+                etc1DecodeBlockRow(blocks, w, h, int(row), pixels.data());
+        });
+
+        level.data = reinterpret_cast<const char*>(pixels.data());
+        level.size = pixels.size();
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
+    }
+
+    image.glType = GL_UNSIGNED_BYTE;
+    image.glFormat = GL_RGB;
+    image.glInternalFormat = GL_RGB;
+    image.glBaseInternalFormat = GL_RGB;
+    data.unpackAlignment = 1;
+}
+
+static std::string preparedTextureFile(const std::string& file)
+{
+    std::string prepared = changeFileExtension(file, ".ktx");
+    return (preparedFileIsCurrent(prepared, file) ? prepared : file);
+}
+
+static bool isKtxFile(const std::string& file)
+{
+    return file.size() >= 4 && file.compare(file.size() - 4, 4, ".ktx") == 0;
+}
+
+static void decodeTexture(const std::string& file, TextureData& data, bool etc1Supported)
+{
+    data.file.reset(new FileMapping(file));
+
+    if (isKtxFile(file)) {
+        if (!ktxParse(data.file->data(), data.file->size(), data.image) || data.image.levels.empty())
+            fatalExit(fmt() << "Unable to parse texture file \"" << file << "\".");
+        data.unpackAlignment = 4;
+        if (data.image.glInternalFormat == GL_ETC1_RGB8_OES && !etc1Supported)
+            decodeEtc1Levels(data);
+        return;
+    }
 
     int w = 0;
     int h = 0;
     int c = 0;
-    stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()), int(fileData.size()), &w, &h, &c, 0);
-    if (!pixels)
+    data.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(data.file->data()), int(data.file->size()), &w, &h, &c, 0);
+    if (!data.pixels)
         fatalExit(fmt() << "Unable to decode image file \"" << file << "\": " << stbi_failure_reason());
 
-    if (width)
-        *width = w;
-    if (height)
-        *height = h;
-
-    GLint internalFormat;
-    GLenum type, format;
+    GLenum format;
     switch (c) {
-        case 1:
-            internalFormat = GL_LUMINANCE;
-            format = GL_LUMINANCE;
-            type = GL_UNSIGNED_BYTE;
-            break;
+        case 1: format = GL_LUMINANCE; break;
+        case 2: format = GL_LUMINANCE_ALPHA; break;
+        case 3: format = GL_RGB; break;
+        case 4: format = GL_RGBA; break;
+        default: fatalExit(fmt() << "Image \"" << file << "\" has unsupported format.");
+    }
 
-        case 2:
-            internalFormat = GL_LUMINANCE_ALPHA;
-            format = GL_LUMINANCE_ALPHA;
-            type = GL_UNSIGNED_BYTE;
-            break;
+    data.image.glType = GL_UNSIGNED_BYTE;
+    data.image.glFormat = format;
+    data.image.glInternalFormat = format;
+    data.image.glBaseInternalFormat = format;
+    data.image.width = uint32_t(w);
+    data.image.height = uint32_t(h);
+    data.image.levels.emplace_back(KtxImage::Level{ reinterpret_cast<const char*>(data.pixels), size_t(w) * size_t(h) * size_t(c) });
+    data.unpackAlignment = 1;
+
+    // Encoded image is not needed anymore
+    data.file.reset();
+}
 
-        case 3:
-            internalFormat = GL_RGB;
-            format = GL_RGB;
-            type = GL_UNSIGNED_BYTE;
-            break;
+// Returns the amount of texture memory used, as far as it can be estimated.
+static size_t uploadTexture(GLuint texture, const TextureData& data, GLenum filter)
+{
+    const KtxImage& image = data.image;
+    size_t bytes = 0;
 
-        case 4:
-            internalFormat = GL_RGBA;
-            format = GL_RGBA;
-            type = GL_UNSIGNED_BYTE;
-            break;
+    size_t levelCount = (isMipmapFilter(filter) ? image.levels.size() : 1);
+    int w = int(image.width);
+    int h = int(image.height);
 
-        default:
-            fatalExit(fmt() << "Image \"" << file << "\" has unsupported format.");
+    glPixelStorei(GL_UNPACK_ALIGNMENT, data.unpackAlignment);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (size_t i = 0; i < levelCount; i++) {
+        const auto& level = image.levels[i];
+        if (image.isCompressed()) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.glInternalFormat,
+                w, h, 0, GLsizei(level.size), level.data);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), GLint(image.glInternalFormat),
+                w, h, 0, image.glFormat, image.glType, level.data);
+        }
+        bytes += level.size;
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
     }
 
-    GLuint texture = openglCreateTexture(repeat, filter);
+    if (isMipmapFilter(filter) && image.levels.size() == 1) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        bytes += bytes / 3;
+    }
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, pixels);
+    return bytes;
+}
 
-    stbi_image_free(pixels);
+GLuint openglLoadTextureEx(const std::string& file, int* width, int* height, int repeat, GLenum filter)
+{
+    TextureData data;
+    decodeTexture(preparedTextureFile(file), data, hasEtc1Support());
 
-    switch (filter) {
-        case GL_NEAREST:
-        case GL_LINEAR:
-            break;
+    if (width)
+        *width = int(data.image.width);
+    if (height)
+        *height = int(data.image.height);
 
-        case GL_NEAREST_MIPMAP_NEAREST:
-        case GL_NEAREST_MIPMAP_LINEAR:
-        case GL_LINEAR_MIPMAP_NEAREST:
-        case GL_LINEAR_MIPMAP_LINEAR:
-            glGenerateMipmap(GL_TEXTURE_2D);
-            break;
+    GLuint texture = openglCreateTexture(repeat, filter);
+    uploadTexture(texture, data, filter);
+
+    return texture;
+}
+
+static void readTextureSize(const std::string& file, int* width, int* height)
+{
+    FileMapping mapping(file);
+
+    int w = 0;
+    int h = 0;
+    if (isKtxFile(file)) {
+        KtxImage image;
+        if (!ktxParse(mapping.data(), mapping.size(), image))
+            fatalExit(fmt() << "Unable to parse texture file \"" << file << "\".");
+        w = int(image.width);
+        h = int(image.height);
+    } else {
+        int c = 0;
+        if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(mapping.data()), int(mapping.size()), &w, &h, &c))
+            fatalExit(fmt() << "Unable to decode image file \"" << file << "\": " << stbi_failure_reason());
     }
 
+    if (width)
+        *width = w;
+    if (height)
+        *height = h;
+}
+
+Texture::~Texture()
+{
+    if (handle)
+        glDeleteTextures(1, &handle);
+}
+
+static size_t textureSize(const void* texture)
+{
+    return static_cast<const Texture*>(texture)->bytes;
+}
+
+std::shared_ptr<Texture> openglGetCachedTexture(const std::string& file, int repeat, GLenum filter)
+{
+    // Sampling parameters are part of the GL texture object, so they are part of the key
+    AssetId key = assetIntern(fmt() << file << ':' << repeat << ':' << filter);
+    auto texture = resourceFind<Texture>(Resource_Texture, key);
+    if (texture)
+        return texture;
+
+    std::string source = preparedTextureFile(file);
+    texture = std::make_shared<Texture>();
+    readTextureSize(source, &texture->width, &texture->height);
+
+    // The texture is usable right away; it shows a single grey texel until the image arrives.
+    // Mipmap filters would make a texture without mip levels incomplete, so the placeholder samples linearly.
+    texture->handle = openglCreateTexture(repeat, filter);
+    if (isMipmapFilter(filter))
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholderPixel);
+    texture->bytes = sizeof(placeholderPixel);
+
+    bool etc1Supported = hasEtc1Support();
+    auto data = std::make_shared<TextureData>();
+    std::weak_ptr<Texture> weakTexture = texture;
+    loaderPost(
+        [data, source, etc1Supported]() {
+            decodeTexture(source, *data, etc1Supported);
+        },
+        [data, weakTexture, filter]() {
+            // Texture may have been released while the image was loading
+            auto texture = weakTexture.lock();
+            if (!texture)
+                return;
+            texture->bytes = uploadTexture(texture->handle, *data, filter);
+            if (isMipmapFilter(filter)) {
+                glBindTexture(GL_TEXTURE_2D, texture->handle);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            }
+        });
+
+    resourceInsert(Resource_Texture, key, texture, textureSize);
     return texture;
 }
 
@@ -20,6 +20,7 @@
 
 #include <GLES2/gl2.h>
 #include <glm/glm.hpp>
+#include <memory>
 #include <string>
 
 enum GLRepeatFlags
@@ -30,9 +31,32 @@ enum GLRepeatFlags
     RepeatXY = RepeatX | RepeatY,
 };
 
+// Texture owned through the resource cache; the GL object is deleted with the last reference.
+struct Texture
+{
+    GLuint handle = 0;
+    int width = 0;
+    int height = 0;
+    size_t bytes = 0;
+
+    Texture() = default;
+    ~Texture();
+
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+};
+
+bool openglHasExtension(const char* name);
+
 GLuint openglCreateTexture(int repeat = NoRepeat, GLenum filter = GL_LINEAR);
 GLuint openglLoadTexture(const std::string& file, int repeat = NoRepeat, GLenum filter = GL_LINEAR);
 GLuint openglLoadTextureEx(const std::string& file, int* width, int* height, int repeat = NoRepeat, GLenum filter = GL_LINEAR);
+
+// Shared texture from the resource cache. A texture seen for the first time has a placeholder image
+// until the loader uploads the file; width and height are read from the file header right away.
+// Creates the GL object, so it must not be called while a frame is being built on the frame thread.
+std::shared_ptr<Texture> openglGetCachedTexture(const std::string& file, int repeat = NoRepeat, GLenum filter = GL_LINEAR);
+
 void openglDeleteTexture(GLuint handle);
 
 GLuint openglCreateBuffer();
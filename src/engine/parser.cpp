@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "parser.h"
+#include "util.h"
+#include <cmath>
+#include <cstring>
+
+static const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool isDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+bool TextParser::Token::operator==(const char* str) const
+{
+    return strncmp(ptr, str, length) == 0 && str[length] == 0;
+}
+
+TextParser::TextParser(const char* data, size_t size, const std::string& file)
+    : mPtr(data)
+    , mEnd(data + size)
+    , mFile(file)
+{
+}
+
+bool TextParser::atEnd()
+{
+    skipWhitespace();
+    return mPtr == mEnd;
+}
+
+TextParser::Token TextParser::readToken()
+{
+    skipWhitespace();
+
+    Token token;
+    token.ptr = mPtr;
+    while (mPtr < mEnd && uint8_t(*mPtr) > ' ')
+        ++mPtr;
+    token.length = size_t(mPtr - token.ptr);
+
+    if (token.length == 0)
+        error("Unexpected end of file", token);
+
+    return token;
+}
+
+float TextParser::readFloat()
+{
+    Token token = readToken();
+    const char* p = token.ptr;
+    const char* end = p + token.length;
+
+    bool negative = false;
+    if (*p == '-' || *p == '+')
+        negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+
+    for (; p < end && isDigit(*p); ++p, ++digits) {
+        if (mantissa < 1000000000000000000ULL)
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+        else
+            ++exponent;
+    }
+
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, ++digits) {
+            if (mantissa < 1000000000000000000ULL) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                --exponent;
+            }
+        }
+    }
+
+    if (digits == 0)
+        error("Expected a number", token);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = (*p++ == '-');
+        if (p == end || !isDigit(*p))
+            error("Expected a number", token);
+
+        int value = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            if (value < 10000)
+                value = value * 10 + (*p - '0');
+        }
+        exponent += (negativeExponent ? -value : value);
+    }
+
+    if (p != end)
+        error("Expected a number", token);
+
+    double result = double(mantissa);
+    if (exponent < 0) {
+        if (exponent >= -22)
+            result /= powersOf10[-exponent];
+        else
+            result *= std::pow(10.0, double(exponent));
+    } else if (exponent > 0) {
+        if (exponent <= 22)
+            result *= powersOf10[exponent];
+        else
+            result *= std::pow(10.0, double(exponent));
+    }
+
+    return float(negative ? -result : result);
+}
+
+int TextParser::readInt()
+{
+    Token token = readToken();
+    const char* p = token.ptr;
+    const char* end = p + token.length;
+
+    bool negative = false;
+    if (*p == '-' || *p == '+')
+        negative = (*p++ == '-');
+
+    if (p == end)
+        error("Expected an integer", token);
+
+    long long value = 0;
+    for (; p < end; ++p) {
+        if (!isDigit(*p))
+            error("Expected an integer", token);
+        value = value * 10 + (*p - '0');
+        if (value > 0x7FFFFFFFLL)
+            error("Integer is too large", token);
+    }
+
+    return int(negative ? -value : value);
+}
+
+size_t TextParser::readSize()
+{
+    int value = readInt();
+    if (value < 0)
+        fatalExit(fmt() << "Unexpected negative count in file \"" << mFile << "\".");
+    return size_t(value);
+}
+
+void TextParser::skipWhitespace()
+{
+    while (mPtr < mEnd && uint8_t(*mPtr) <= ' ')
+        ++mPtr;
+}
+
+void TextParser::error(const char* what, const Token& token) const
+{
+    fatalExit(fmt() << what << " in file \"" << mFile << "\" (got \"" << token.toString() << "\").");
+}
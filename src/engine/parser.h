@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Whitespace-separated tokenizer for the text asset formats. It works directly on a memory range,
+// never allocates and parses numbers without going through the C locale. Malformed input is fatal.
+class TextParser
+{
+public:
+    struct Token
+    {
+        const char* ptr;
+        size_t length;
+
+        bool operator==(const char* str) const;
+        bool operator!=(const char* str) const { return !(*this == str); }
+        std::string toString() const { return std::string(ptr, length); }
+    };
+
+    TextParser(const char* data, size_t size, const std::string& file);
+
+    bool atEnd();
+
+    Token readToken();
+    std::string readString() { return readToken().toString(); }
+    float readFloat();
+    int readInt();
+    size_t readSize();
+
+    void read(float& value) { value = readFloat(); }
+    void read(int& value) { value = readInt(); }
+    void read(size_t& value) { value = readSize(); }
+
+    template <typename T, typename... ARGS> void read(T& value, ARGS&... args)
+    {
+        read(value);
+        read(args...);
+    }
+
+private:
+    const char* mPtr;
+    const char* mEnd;
+    std::string mFile;
+
+    void skipWhitespace();
+    void error(const char* what, const Token& token) const;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "perfhud.h"
+#include "draw.h"
+#include "framearena.h"
+#include <imgui/imgui.h>
+
+static const int HISTORY_FRAMES = 240;
+
+namespace
+{
+    struct FrameRecord
+    {
+        float frameTime;    // milliseconds
+        DrawStats stats;
+    };
+}
+
+static FrameRecord history[HISTORY_FRAMES];
+static int historyCount;
+static int historyNext;
+static float budget = 1000.0f / 60.0f;
+
+static const FrameRecord& record(int index)
+{
+    return history[(historyNext - historyCount + index + HISTORY_FRAMES) % HISTORY_FRAMES];
+}
+
+static float frameTimeAt(void*, int index)
+{
+    return record(index).frameTime;
+}
+
+void perfHudEndFrame(double frameTime)
+{
+    FrameRecord& frame = history[historyNext];
+    frame.frameTime = float(frameTime * 1000.0);
+    frame.stats = drawFrameStats();
+
+    historyNext = (historyNext + 1) % HISTORY_FRAMES;
+    if (historyCount < HISTORY_FRAMES)
+        ++historyCount;
+}
+
+void perfHudShow(bool* open)
+{
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiSetCond_FirstUseEver);
+    ImGui::SetNextWindowSize(ImVec2(360, 340), ImGuiSetCond_FirstUseEver);
+    if (!ImGui::Begin("Performance", open, 0)) {
+        ImGui::End();
+        return;
+    }
+
+    if (historyCount == 0) {
+        ImGui::End();
+        return;
+    }
+
+    float total = 0.0f;
+    float worst = 0.0f;
+    int overBudget = 0;
+    double buildTime[DrawPassCount] = {};
+    double submitTime[DrawPassCount] = {};
+    for (int i = 0; i < historyCount; i++) {
+        const FrameRecord& frame = record(i);
+        total += frame.frameTime;
+        if (frame.frameTime > worst)
+            worst = frame.frameTime;
+        if (frame.frameTime > budget)
+            ++overBudget;
+        for (int j = 0; j < DrawPassCount; j++) {
+            buildTime[j] += frame.stats.buildTime[j];
+            submitTime[j] += frame.stats.submitTime[j];
+        }
+    }
+
+    const FrameRecord& last = record(historyCount - 1);
+    bool lastOverBudget = (last.frameTime > budget);
+
+    // Bars are scaled so that the budget is half the height of the graph
+    const char* overlay = frameArenaFormat("%.2f ms (avg %.2f, max %.2f)", last.frameTime, total / historyCount, worst);
+    if (lastOverBudget)
+        ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImVec4(1.0f, 0.25f, 0.25f, 1.0f));
+    ImGui::PlotHistogram("##frameTime", frameTimeAt, nullptr, historyCount, 0, overlay, 0.0f, budget * 2.0f, ImVec2(-1.0f, 80.0f));
+    if (lastOverBudget)
+        ImGui::PopStyleColor();
+
+    ImGui::SliderFloat("budget", &budget, 4.0f, 50.0f, "%.1f ms");
+    if (overBudget > 0)
+        ImGui::TextColored(ImVec4(1.0f, 0.25f, 0.25f, 1.0f), "%d of the last %d frames over budget", overBudget, historyCount);
+    else
+        ImGui::Text("Last %d frames within budget", historyCount);
+
+    ImGui::Separator();
+    ImGui::Columns(3, "passes");
+    ImGui::Text("pass");
+    ImGui::NextColumn();
+    ImGui::Text("build, ms");
+    ImGui::NextColumn();
+    ImGui::Text("submit, ms");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (int i = 0; i < DrawPassCount; i++) {
+        ImGui::Text("%s", drawPassName(DrawPass(i)));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", buildTime[i] * 1000.0 / historyCount);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", submitTime[i] * 1000.0 / historyCount);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::Separator();
+    ImGui::Text("draw calls: %u", last.stats.drawCalls);
+    ImGui::Text("vertices: %u", last.stats.vertices);
+
+    ImGui::End();
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "profiler.h"
+#include "util.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static const size_t EVENTS_PER_THREAD = 65536;
+static const size_t MAX_FRAMES = 600;
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+
+    // Buffers are never freed, so scopes of threads that have exited can still be written out
+    struct ThreadBuffer
+    {
+        std::mutex mutex;   // only contended while a trace is being written
+        const char* name;
+        int id;
+        size_t written;
+        Event events[EVENTS_PER_THREAD];
+    };
+}
+
+std::atomic<bool> profilerEnabled;
+
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+static thread_local ThreadBuffer* ownBuffer;
+static thread_local const char* ownThreadName;
+static int64_t frameEnds[MAX_FRAMES];
+static size_t frameCount;
+
+int64_t profilerTime()
+{
+    auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+void profilerRecord(const char* name, int64_t start)
+{
+    int64_t end = profilerTime();
+
+    if (!ownBuffer) {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+        buffer->name = ownThreadName;
+        buffer->written = 0;
+
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->id = int(buffers.size()) + 1;
+        ownBuffer = buffer.get();
+        buffers.emplace_back(std::move(buffer));
+    }
+
+    std::lock_guard<std::mutex> lock(ownBuffer->mutex);
+    Event& event = ownBuffer->events[ownBuffer->written++ % EVENTS_PER_THREAD];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+}
+
+void profilerEnable(bool enable)
+{
+    profilerEnabled.store(enable, std::memory_order_relaxed);
+}
+
+void profilerSetThreadName(const char* name)
+{
+    ownThreadName = name;
+    if (ownBuffer) {
+        std::lock_guard<std::mutex> lock(ownBuffer->mutex);
+        ownBuffer->name = name;
+    }
+}
+
+void profilerEndFrame()
+{
+    frameEnds[frameCount++ % MAX_FRAMES] = profilerTime();
+}
+
+static void writeString(FILE* f, const char* str)
+{
+    fputc('"', f);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', f);
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+void profilerWriteTrace(const std::string& path, int frames)
+{
+    if (frames < 1 || size_t(frames) >= MAX_FRAMES)
+        frames = int(MAX_FRAMES - 1);
+
+    int64_t from = 0;
+    if (frameCount > size_t(frames))
+        from = frameEnds[(frameCount - size_t(frames) - 1) % MAX_FRAMES];
+
+    struct Thread
+    {
+        const char* name;
+        int id;
+        std::vector<Event> events;
+    };
+
+    // Copy first, so recording threads are not held up by file output
+    std::vector<Thread> threads;
+    int64_t base = INT64_MAX;
+    size_t eventCount = 0;
+    {
+        std::lock_guard<std::mutex> buffersLock(buffersMutex);
+        threads.resize(buffers.size());
+        for (size_t i = 0; i < buffers.size(); i++) {
+            ThreadBuffer& buffer = *buffers[i];
+            Thread& thread = threads[i];
+
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            thread.name = buffer.name;
+            thread.id = buffer.id;
+
+            size_t n = (buffer.written < EVENTS_PER_THREAD ? buffer.written : EVENTS_PER_THREAD);
+            for (size_t j = buffer.written - n; j < buffer.written; j++) {
+                const Event& event = buffer.events[j % EVENTS_PER_THREAD];
+                if (event.start >= from) {
+                    thread.events.emplace_back(event);
+                    if (event.start < base)
+                        base = event.start;
+                }
+            }
+            eventCount += thread.events.size();
+        }
+    }
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        const char* errorMessage = strerror(errno);
+        logPrint(fmt() << "Unable to write file \"" << path << "\": " << errorMessage);
+        return;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    bool first = true;
+    for (const auto& thread : threads) {
+        if (thread.name) {
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                (first ? "" : ",\n"), thread.id);
+            writeString(f, thread.name);
+            fputs("}}", f);
+            first = false;
+        }
+
+        for (const auto& event : thread.events) {
+            fprintf(f, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                (first ? "" : ",\n"), thread.id, double(event.start - base) * 0.001,
+                double(event.end - event.start) * 0.001);
+            writeString(f, event.name);
+            fputc('}', f);
+            first = false;
+        }
+    }
+    fputs("\n]}\n", f);
+
+    bool failed = (ferror(f) != 0);
+    fclose(f);
+
+    if (failed)
+        logPrint(fmt() << "Unable to write file \"" << path << "\".");
+    else
+        logPrint(fmt() << "Wrote " << eventCount << " profiler events of the last " << frames << " frames to \"" << path << "\".");
+}
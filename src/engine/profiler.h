@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU markers. Each thread records finished scopes into a ring buffer of its own, so only the
+// latest frames are kept. While profiling is off a marker costs a test of the flag below.
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_CONCAT2(a, b) a##b
+
+extern std::atomic<bool> profilerEnabled;
+
+int64_t profilerTime();
+void profilerRecord(const char* name, int64_t start);
+
+class ProfileScope
+{
+public:
+    // Name must be a string literal (or otherwise outlive the profiler)
+    explicit ProfileScope(const char* name)
+        : mName(nullptr)
+    {
+        if (profilerEnabled.load(std::memory_order_relaxed)) {
+            mName = name;
+            mStart = profilerTime();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (mName)
+            profilerRecord(mName, mStart);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* mName;
+    int64_t mStart;
+};
+
+void profilerEnable(bool enable);
+
+// Names the calling thread in traces.
+void profilerSetThreadName(const char* name);
+
+// Marks a frame boundary; called between frames.
+void profilerEndFrame();
+
+// Writes scopes of the last few frames in the Chrome trace format (chrome://tracing, ui.perfetto.dev).
+void profilerWriteTrace(const std::string& path, int frames);
+
+#endif
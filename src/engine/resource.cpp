@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "resource.h"
+#include "util.h"
+#include <vector>
+
+namespace
+{
+    struct Entry
+    {
+        std::shared_ptr<void> object;
+        size_t (*sizeOf)(const void*);
+        AssetId prev;
+        AssetId next;
+    };
+
+    // Entries are indexed by asset id and linked in the order of use, most recently used first.
+    struct Cache
+    {
+        std::vector<Entry> entries;
+        AssetId head;
+        AssetId tail;
+        size_t count;
+        size_t budget;
+        size_t usedBytes;
+    };
+}
+
+static Cache caches[ResourceTypeCount] = {
+        { {}, NO_ASSET, NO_ASSET, 0, 64 * 1024 * 1024, 0 },    // Resource_Texture
+        { {}, NO_ASSET, NO_ASSET, 0, 16 * 1024 * 1024, 0 },    // Resource_Mesh
+    };
+
+static const char* const typeNames[ResourceTypeCount] = {
+        "texture",
+        "mesh",
+    };
+
+static void unlink(Cache& cache, AssetId id)
+{
+    Entry& entry = cache.entries[id];
+    if (entry.prev != NO_ASSET)
+        cache.entries[entry.prev].next = entry.next;
+    else
+        cache.head = entry.next;
+    if (entry.next != NO_ASSET)
+        cache.entries[entry.next].prev = entry.prev;
+    else
+        cache.tail = entry.prev;
+}
+
+static void linkFront(Cache& cache, AssetId id)
+{
+    Entry& entry = cache.entries[id];
+    entry.prev = NO_ASSET;
+    entry.next = cache.head;
+    if (cache.head != NO_ASSET)
+        cache.entries[cache.head].prev = id;
+    else
+        cache.tail = id;
+    cache.head = id;
+}
+
+void resourceShutdown()
+{
+    for (int type = 0; type < ResourceTypeCount; type++)
+        resourceClear(ResourceType(type));
+}
+
+std::shared_ptr<void> resourceFind(ResourceType type, AssetId id)
+{
+    Cache& cache = caches[type];
+    if (id >= cache.entries.size() || !cache.entries[id].object)
+        return nullptr;
+
+    if (cache.head != id) {
+        unlink(cache, id);
+        linkFront(cache, id);
+    }
+
+    return cache.entries[id].object;
+}
+
+void resourceInsert(ResourceType type, AssetId id, std::shared_ptr<void> object, size_t (*sizeOf)(const void*))
+{
+    Cache& cache = caches[type];
+    if (id >= cache.entries.size())
+        cache.entries.resize(assetCount());
+
+    Entry& entry = cache.entries[id];
+    if (entry.object)
+        unlink(cache, id);
+    else
+        ++cache.count;
+
+    entry.object = std::move(object);
+    entry.sizeOf = sizeOf;
+    linkFront(cache, id);
+}
+
+void resourceClear(ResourceType type)
+{
+    Cache& cache = caches[type];
+    cache.entries.clear();
+    cache.head = NO_ASSET;
+    cache.tail = NO_ASSET;
+    cache.count = 0;
+    cache.usedBytes = 0;
+}
+
+void resourceSetBudget(ResourceType type, size_t bytes)
+{
+    caches[type].budget = bytes;
+}
+
+size_t resourceBudget(ResourceType type)
+{
+    return caches[type].budget;
+}
+
+size_t resourceUsedBytes(ResourceType type)
+{
+    return caches[type].usedBytes;
+}
+
+size_t resourceCount(ResourceType type)
+{
+    return caches[type].count;
+}
+
+void resourceCollect()
+{
+    for (int type = 0; type < ResourceTypeCount; type++) {
+        Cache& cache = caches[type];
+
+        // Sizes are recomputed because asynchronously loaded resources grow after they were inserted.
+        cache.usedBytes = 0;
+        for (AssetId id = cache.head; id != NO_ASSET; id = cache.entries[id].next)
+            cache.usedBytes += cache.entries[id].sizeOf(cache.entries[id].object.get());
+
+        AssetId id = cache.tail;
+        while (cache.usedBytes > cache.budget && id != NO_ASSET) {
+            Entry& entry = cache.entries[id];
+            AssetId prev = entry.prev;
+
+            if (entry.object.use_count() == 1) {
+                logPrint(fmt() << "Evicting " << typeNames[type] << " \"" << assetName(id) << "\".");
+                cache.usedBytes -= entry.sizeOf(entry.object.get());
+                unlink(cache, id);
+                entry.object.reset();
+                --cache.count;
+            }
+
+            id = prev;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include "engine/assetid.h"
+#include <cstddef>
+#include <memory>
+
+enum ResourceType
+{
+    Resource_Texture = 0,
+    Resource_Mesh,
+    ResourceTypeCount   // should be the last one
+};
+
+// Resources are shared by asset id. An entry that nobody outside of the cache references anymore stays
+// cached until its type goes over budget; then the least recently used ones are released first.
+// The cache is not locked: it is used by the main thread and by the frame thread, never at the same
+// time (the main thread calls resourceCollect() only while the frame thread is idle).
+
+void resourceShutdown();
+
+std::shared_ptr<void> resourceFind(ResourceType type, AssetId id);
+void resourceInsert(ResourceType type, AssetId id, std::shared_ptr<void> object, size_t (*sizeOf)(const void*));
+void resourceClear(ResourceType type);
+
+template <typename T> std::shared_ptr<T> resourceFind(ResourceType type, AssetId id)
+{
+    return std::static_pointer_cast<T>(resourceFind(type, id));
+}
+
+void resourceSetBudget(ResourceType type, size_t bytes);
+size_t resourceBudget(ResourceType type);
+size_t resourceUsedBytes(ResourceType type);
+size_t resourceCount(ResourceType type);
+
+// Updates accounting and evicts what does not fit the budget. Called once per frame.
+void resourceCollect();
+
+#endif
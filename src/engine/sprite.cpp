@@ -16,25 +16,21 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "sprite.h"
+#include "parser.h"
 #include "util.h"
-#include <sstream>
 
 Sprite spriteLoad(const std::string& file, GLenum filter)
 {
-    std::string data = loadFile(file);
+    FileMapping mapping(file);
+    TextParser parser(mapping.data(), mapping.size(), file);
 
-    std::stringstream ss(data);
-    std::string textureFile;
+    std::string textureFile = parser.readString();
     glm::vec2 anchor;
-    ss >> textureFile >> anchor.x >> anchor.y;
-
-    int width = 0;
-    int height = 0;
-    GLuint texture = openglLoadTextureEx(textureFile, &width, &height, NoRepeat, filter);
+    parser.read(anchor.x, anchor.y);
 
     Sprite sprite;
-    sprite.texture = texture;
-    sprite.size = glm::vec2(float(width), float(height));
+    sprite.texture = openglGetCachedTexture(textureFile, NoRepeat, filter);
+    sprite.size = glm::vec2(float(sprite.texture->width), float(sprite.texture->height));
     sprite.anchor = anchor;
 
     return sprite;
@@ -42,5 +38,5 @@ Sprite spriteLoad(const std::string& file, GLenum filter)
 
 void spriteDelete(Sprite& sprite)
 {
-    openglDeleteTexture(sprite.texture);
+    sprite.texture.reset();
 }
@@ -23,7 +23,7 @@
 
 struct Sprite
 {
-    GLuint texture;
+    std::shared_ptr<Texture> texture;
     glm::vec2 size;
     glm::vec2 anchor;
 };
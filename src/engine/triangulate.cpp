@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "triangulate.h"
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t NONE = 0xFFFFFFFF;
+
+// Sign of the turn a -> b -> c: positive for counterclockwise, 0 when the points are collinear within
+// the rounding error. Differences of float coordinates are exact in double precision, and the bound is
+// the first stage of Shewchuk's orient2d, so a non-zero result is always the exact sign.
+static int orientation(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+{
+    double left = (double(b.x) - double(a.x)) * (double(c.y) - double(a.y));
+    double right = (double(b.y) - double(a.y)) * (double(c.x) - double(a.x));
+    double det = left - right;
+    double bound = 3.3306690738754716e-16 * (fabs(left) + fabs(right));
+    return (det > bound ? 1 : (det < -bound ? -1 : 0));
+}
+
+// Points on the boundary count as inside.
+static bool pointInTriangle(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c, int sign)
+{
+    return orientation(a, b, p) * sign >= 0 && orientation(b, c, p) * sign >= 0 && orientation(c, a, p) * sign >= 0;
+}
+
+namespace
+{
+    // Kd-tree over all vertices in which only the ones that can block an ear (reflex and collinear)
+    // are active. Vertices are switched on and off as the polygon is clipped, and every node counts
+    // its active vertices, so queries skip the parts of the tree that have none left. Nodes that lie
+    // outside of one of the edges of the queried triangle are skipped as well, so a long thin ear only
+    // visits the vertices along it and not the whole box around it.
+    class BlockerTree
+    {
+    public:
+        BlockerTree(const glm::vec2* points, size_t count)
+            : mPoints(points)
+            , mOrder(count)
+            , mSlot(count)
+            , mActive(count, 0)
+        {
+            for (size_t i = 0; i < count; i++)
+                mOrder[i] = uint32_t(i);
+
+            mNodes.reserve(4 * (count / LEAF_SIZE + 1));
+            mNodes.resize(1);
+            build(0, 0, uint32_t(count));
+
+            for (size_t i = 0; i < count; i++)
+                mSlot[mOrder[i]] = uint32_t(i);
+        }
+
+        void setActive(uint32_t vertex, bool active)
+        {
+            uint32_t slot = mSlot[vertex];
+            if (bool(mActive[slot]) == active)
+                return;
+            mActive[slot] = (active ? 1 : 0);
+
+            uint32_t node = 0;
+            for (;;) {
+                Node& n = mNodes[node];
+                n.active += (active ? 1 : -1);
+                if (n.left == 0)
+                    break;
+                node = (slot < mNodes[n.left].end ? n.left : n.left + 1);
+            }
+        }
+
+        // Calls func(vertex) for active vertices that may lie in the triangle until it returns true.
+        template <typename FUNC> bool any(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c, int sign,
+            FUNC&& func) const
+        {
+            glm::vec2 min = glm::min(a, glm::min(b, c));
+            glm::vec2 max = glm::max(a, glm::max(b, c));
+
+            uint32_t stack[64];
+            size_t depth = 0;
+            stack[depth++] = 0;
+            while (depth > 0) {
+                const Node& node = mNodes[stack[--depth]];
+                if (node.active == 0 || node.max.x < min.x || node.max.y < min.y || node.min.x > max.x || node.min.y > max.y)
+                    continue;
+                if (outside(node, a, b, sign) || outside(node, b, c, sign) || outside(node, c, a, sign))
+                    continue;
+
+                if (node.left != 0) {
+                    stack[depth++] = node.left;
+                    stack[depth++] = node.left + 1;
+                    continue;
+                }
+
+                for (uint32_t slot = node.begin; slot < node.end; slot++) {
+                    if (mActive[slot] && func(mOrder[slot]))
+                        return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static const uint32_t LEAF_SIZE = 8;
+
+        struct Node
+        {
+            glm::vec2 min;
+            glm::vec2 max;
+            uint32_t begin;
+            uint32_t end;
+            uint32_t left;      // the right child follows it; 0 for leaves
+            uint32_t active;
+        };
+
+        const glm::vec2* mPoints;
+        std::vector<Node> mNodes;
+        std::vector<uint32_t> mOrder;       // vertices grouped by node
+        std::vector<uint32_t> mSlot;        // position of every vertex in mOrder
+        std::vector<uint8_t> mActive;       // by slot
+
+        void build(uint32_t index, uint32_t begin, uint32_t end)
+        {
+            glm::vec2 min = mPoints[mOrder[begin]];
+            glm::vec2 max = min;
+            for (uint32_t i = begin + 1; i < end; i++) {
+                min = glm::min(min, mPoints[mOrder[i]]);
+                max = glm::max(max, mPoints[mOrder[i]]);
+            }
+
+            uint32_t left = 0;
+            if (end - begin > LEAF_SIZE) {
+                // Median split across the longer side; the children are next to each other
+                int axis = (max.x - min.x >= max.y - min.y ? 0 : 1);
+                uint32_t middle = begin + (end - begin) / 2;
+                const glm::vec2* points = mPoints;
+                std::nth_element(mOrder.begin() + begin, mOrder.begin() + middle, mOrder.begin() + end,
+                    [points, axis](uint32_t i, uint32_t j) { return points[i][axis] < points[j][axis]; });
+
+                left = uint32_t(mNodes.size());
+                mNodes.resize(mNodes.size() + 2);
+                build(left, begin, middle);
+                build(left + 1, middle, end);
+            }
+
+            Node& node = mNodes[index];
+            node.min = min;
+            node.max = max;
+            node.begin = begin;
+            node.end = end;
+            node.left = left;
+            node.active = 0;
+        }
+
+        // True when the whole node is strictly on the outer side of the edge.
+        static bool outside(const Node& node, const glm::vec2& a, const glm::vec2& b, int sign)
+        {
+            // The corner that is furthest towards the inner side decides
+            float nx = (a.y - b.y) * float(sign);
+            float ny = (b.x - a.x) * float(sign);
+            glm::vec2 corner(nx >= 0.0f ? node.max.x : node.min.x, ny >= 0.0f ? node.max.y : node.min.y);
+            return orientation(a, b, corner) * sign < 0;
+        }
+    };
+}
+
+void triangulatePolygon(const glm::vec2* points, size_t count, std::vector<uint32_t>& indices)
+{
+    if (count < 3)
+        return;
+
+    double area = 0.0;
+    for (size_t i = 0, j = count - 1; i < count; j = i++)
+        area += double(points[j].x) * points[i].y - double(points[i].x) * points[j].y;
+    int sign = (area < 0.0 ? -1 : 1);
+
+    std::vector<uint32_t> prev(count);
+    std::vector<uint32_t> next(count);
+    for (size_t i = 0; i < count; i++) {
+        prev[i] = uint32_t(i == 0 ? count - 1 : i - 1);
+        next[i] = uint32_t(i == count - 1 ? 0 : i + 1);
+    }
+
+    // Reflex and collinear vertices are never ears and may block the ears of others
+    BlockerTree blockers(points, count);
+    std::vector<bool> convex(count);
+    for (size_t i = 0; i < count; i++) {
+        convex[i] = orientation(points[prev[i]], points[i], points[next[i]]) * sign > 0;
+        if (!convex[i])
+            blockers.setActive(uint32_t(i), true);
+    }
+
+    auto isEar = [&](uint32_t b) -> bool {
+            if (!convex[b])
+                return false;
+            uint32_t a = prev[b];
+            uint32_t c = next[b];
+            const glm::vec2& pa = points[a];
+            const glm::vec2& pb = points[b];
+            const glm::vec2& pc = points[c];
+            return !blockers.any(pa, pb, pc, sign, [&](uint32_t i) {
+                    if (i == a || i == c)
+                        return false;
+                    const glm::vec2& p = points[i];
+                    if (p == pa || p == pb || p == pc)
+                        return false;
+                    return pointInTriangle(p, pa, pb, pc, sign);
+                });
+        };
+
+    // Clipping an ear only changes the angles of its two neighbours, and only their ear status can
+    // change, so every clip tests two vertices. Ears wait in a queue in the order they were found;
+    // a vertex whose neighbour was clipped moves to the back, which makes each round around the
+    // ring clip every other vertex instead of fanning triangles out of one of them.
+    std::vector<uint32_t> queue;
+    std::vector<uint32_t> queuedAt(count, NONE);
+    queue.reserve(count * 2);
+    for (uint32_t i = 0; i < uint32_t(count); i++) {
+        if (isEar(i)) {
+            queuedAt[i] = uint32_t(queue.size());
+            queue.emplace_back(i);
+        }
+    }
+
+    indices.reserve(indices.size() + (count - 2) * 3);
+
+    size_t remaining = count;
+    size_t head = 0;
+    uint32_t last = 0;
+    while (remaining > 3) {
+        uint32_t b = NONE;
+        while (head < queue.size() && b == NONE) {
+            uint32_t vertex = queue[head];
+            if (queuedAt[vertex] == head)
+                b = vertex;
+            ++head;
+        }
+
+        // A simple polygon always has an ear. One that is not simple, or is flat below the precision
+        // of the coordinates, may run out of them: clip a collinear vertex if there is one, as its
+        // triangle is empty, or else any convex one.
+        if (b == NONE) {
+            uint32_t v = last;
+            for (size_t i = 0; i < remaining; i++, v = next[v]) {
+                if (orientation(points[prev[v]], points[v], points[next[v]]) == 0) {
+                    b = v;
+                    break;
+                }
+                if (b == NONE && convex[v])
+                    b = v;
+            }
+            if (b == NONE)
+                b = last;
+        }
+
+        uint32_t a = prev[b];
+        uint32_t c = next[b];
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+
+        next[a] = c;
+        prev[c] = a;
+        queuedAt[b] = NONE;
+        blockers.setActive(b, false);
+        --remaining;
+        last = a;
+
+        for (uint32_t v : { a, c }) {
+            convex[v] = orientation(points[prev[v]], points[v], points[next[v]]) * sign > 0;
+            blockers.setActive(v, !convex[v]);
+            if (isEar(v)) {
+                queuedAt[v] = uint32_t(queue.size());
+                queue.emplace_back(v);
+            } else
+                queuedAt[v] = NONE;
+        }
+    }
+
+    indices.push_back(prev[last]);
+    indices.push_back(last);
+    indices.push_back(next[last]);
+}
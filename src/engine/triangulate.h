@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef TRIANGULATE_H
+#define TRIANGULATE_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Triangulates a simple polygon (either winding, concave allowed) by ear clipping and appends
+// exactly count - 2 triangles to `indices` as triples referencing `points`. Orientation tests are
+// exact, so no triangle is dropped or lies outside of the polygon; polygons that are not simple
+// still get count - 2 triangles, but some of them may overlap.
+// Each clip re-tests only the two neighbours of the ear, and ear tests query a kd-tree of the
+// reflex vertices left, which makes it about O(n log n) for sectors whose ears stay small next to
+// their reflex vertices. Ear clipping is O(n^2) in the worst case, when many large ears each have
+// to be tested against many reflex vertices close to them.
+void triangulatePolygon(const glm::vec2* points, size_t count, std::vector<uint32_t>& indices);
+
+#endif
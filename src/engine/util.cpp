@@ -16,6 +16,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "util.h"
+#include "vfs.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -23,6 +24,62 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifndef PLATFORM_EMSCRIPTEN
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+FileMapping::FileMapping(const std::string& name)
+    : mData(nullptr)
+    , mSize(0)
+    , mMapped(false)
+{
+    if (vfsFindPacked(name, mData, mSize, mBuffer))
+        return;
+
+  #ifndef PLATFORM_EMSCRIPTEN
+    int fd = open(("data/" + name).c_str(), O_RDONLY);
+    if (fd < 0) {
+        const char* errorMessage = strerror(errno);
+        fatalExit(fmt() << "Unable to open file \"" << name << "\": " << errorMessage);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        const char* errorMessage = strerror(errno);
+        close(fd);
+        fatalExit(fmt() << "Unable to stat file \"" << name << "\": " << errorMessage);
+    }
+
+    mSize = size_t(st.st_size);
+    if (mSize > 0) {
+        void* ptr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            mData = reinterpret_cast<const char*>(ptr);
+            mMapped = true;
+        }
+    }
+
+    close(fd);
+
+    if (mMapped || mSize == 0)
+        return;
+  #endif
+
+    mBuffer = loadFile(name);
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+}
+
+FileMapping::~FileMapping()
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    if (mMapped)
+        munmap(const_cast<char*>(mData), mSize);
+  #endif
+}
+
 void logPrint(const std::string& message)
 {
   #ifndef PLATFORM_EMSCRIPTEN
@@ -33,18 +90,49 @@ void logPrint(const std::string& message)
 void fatalExit(const std::string& message)
 {
     fprintf(stderr, "FATAL ERROR: %s\n", message.c_str());
+
+  #ifndef PLATFORM_EMSCRIPTEN
+    // exit() would destroy static objects that worker threads are still blocked on, and hang there
+    fflush(nullptr);
+    _exit(1);
+  #else
     exit(1);
+  #endif
 }
 
 bool fileExists(const std::string& name)
 {
-    struct stat st;
-    return (stat(("data/" + name).c_str(), &st) == 0);
+    return vfsIsPacked(name) || vfsIsLoose(name);
+}
+
+bool preparedFileIsCurrent(const std::string& prepared, const std::string& source)
+{
+    if (!fileExists(prepared))
+        return false;
+
+    // Files in the pack are prepared together with their sources; only a source saved
+    // next to it (by an editor, for example) can be newer.
+    if (!vfsIsLoose(source))
+        return true;
+    if (!vfsIsLoose(prepared))
+        return false;
+
+    struct stat sourceStat, preparedStat;
+    if (stat(("data/" + source).c_str(), &sourceStat) < 0 || stat(("data/" + prepared).c_str(), &preparedStat) < 0)
+        return false;
+
+    return preparedStat.st_mtime >= sourceStat.st_mtime;
 }
 
 std::string loadFile(const std::string& name)
 {
-    logPrint(fmt() << "Loading \"" << name << "\"...");
+    {
+        const char* data = nullptr;
+        size_t size = 0;
+        std::string buffer;
+        if (vfsFindPacked(name, data, size, buffer))
+            return (buffer.data() == data ? buffer : std::string(data, size));
+    }
 
     struct stat st;
     if (stat(("data/" + name).c_str(), &st) < 0) {
@@ -97,6 +185,17 @@ void saveFile(const std::string& name, const std::string& data)
     }
 
     fclose(f);
+
+    vfsAddLooseFile(name);
+}
+
+std::string changeFileExtension(const std::string& name, const std::string& extension)
+{
+    size_t dot = name.rfind('.');
+    size_t slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return name + extension;
+    return name.substr(0, dot) + extension;
 }
 
 uint32_t toUInt32(const glm::vec4& c)
@@ -33,13 +33,39 @@ private:
     std::stringstream mStream;
 };
 
+// Read-only view of a game file (see vfs.h). Loose files are memory-mapped where the platform
+// supports it, otherwise read into memory; files stored in the pack are viewed in place.
+class FileMapping
+{
+public:
+    explicit FileMapping(const std::string& name);
+    ~FileMapping();
+
+    const char* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    const char* mData;
+    size_t mSize;
+    bool mMapped;
+    std::string mBuffer;
+
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+};
+
 void logPrint(const std::string& message);
 void fatalExit(const std::string& message);
 
 bool fileExists(const std::string& name);
+
+// True when `prepared` (as written by LDAssetCompiler) exists and is not older than `source`.
+bool preparedFileIsCurrent(const std::string& prepared, const std::string& source);
 std::string loadFile(const std::string& name);
 void saveFile(const std::string& name, const std::string& data);
 
+std::string changeFileExtension(const std::string& name, const std::string& extension);
+
 uint32_t toUInt32(const glm::vec4& c);
 
 #endif
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "vfs.h"
+#include "lz4.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifndef PLATFORM_EMSCRIPTEN
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+namespace
+{
+    // Pack files start with a header, followed by the entries sorted by name, the name table and the
+    // file contents. Contents are aligned to 16 bytes. All values are little-endian.
+    struct PackHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t namesSize;
+    };
+
+    struct PackEntry
+    {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t dataOffset;
+        uint32_t storedSize;
+        uint32_t size;
+        uint32_t flags;
+    };
+
+    enum PackEntryFlags : uint32_t
+    {
+        PackEntry_LZ4 = 0x0001,
+    };
+
+    static_assert(sizeof(PackHeader) == 16, "PackHeader layout does not match the pack format.");
+    static_assert(sizeof(PackEntry) == 24, "PackEntry layout does not match the pack format.");
+}
+
+static const char PACK_MAGIC[4] = { 'L', 'D', 'P', 'K' };
+static const uint32_t PACK_VERSION = 1;
+static const size_t PACK_ALIGNMENT = 16;
+
+static bool mounted;
+static const char* packData;
+static size_t packSize;
+static std::string packBuffer;
+static const PackEntry* packEntries;
+static uint32_t packEntryCount;
+static const char* packNames;
+
+// Written by the editors while the loader threads read it
+static std::mutex looseFilesMutex;
+static std::vector<std::string> looseFiles;
+
+static void listLooseFiles()
+{
+    looseFiles.clear();
+
+    DIR* dir = opendir("data");
+    if (!dir)
+        return;
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            looseFiles.emplace_back(entry->d_name);
+    }
+    closedir(dir);
+
+    std::sort(looseFiles.begin(), looseFiles.end());
+}
+
+static bool mapPack(const std::string& packFile)
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    int fd = open(packFile.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        fatalExit(fmt() << "Unable to read pack file \"" << packFile << "\".");
+    }
+
+    void* ptr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        const char* errorMessage = strerror(errno);
+        fatalExit(fmt() << "Unable to map pack file \"" << packFile << "\": " << errorMessage);
+    }
+
+    packData = reinterpret_cast<const char*>(ptr);
+    packSize = size_t(st.st_size);
+  #else
+    FILE* f = fopen(packFile.c_str(), "rb");
+    if (!f)
+        return false;
+
+    char buffer[65536];
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        packBuffer.append(buffer, bytesRead);
+    fclose(f);
+
+    packData = packBuffer.data();
+    packSize = packBuffer.size();
+  #endif
+
+    return true;
+}
+
+static void unmapPack()
+{
+  #ifndef PLATFORM_EMSCRIPTEN
+    if (packData)
+        munmap(const_cast<char*>(packData), packSize);
+  #endif
+    packBuffer.clear();
+    packData = nullptr;
+    packSize = 0;
+}
+
+bool vfsMount(const std::string& packFile)
+{
+    if (!mapPack(packFile))
+        return false;
+
+    PackHeader header;
+    if (packSize < sizeof(header))
+        fatalExit(fmt() << "Pack file \"" << packFile << "\" is corrupt.");
+    memcpy(&header, packData, sizeof(header));
+
+    if (memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header.version != PACK_VERSION)
+        fatalExit(fmt() << "Pack file \"" << packFile << "\" has unsupported format.");
+
+    size_t entriesSize = size_t(header.entryCount) * sizeof(PackEntry);
+    if (packSize - sizeof(header) < entriesSize || packSize - sizeof(header) - entriesSize < header.namesSize)
+        fatalExit(fmt() << "Pack file \"" << packFile << "\" is corrupt.");
+
+    packEntries = reinterpret_cast<const PackEntry*>(packData + sizeof(header));
+    packEntryCount = header.entryCount;
+    packNames = packData + sizeof(header) + entriesSize;
+
+    for (uint32_t i = 0; i < packEntryCount; i++) {
+        const PackEntry& entry = packEntries[i];
+        if (size_t(entry.nameOffset) + entry.nameLength > header.namesSize
+                || entry.dataOffset > packSize || entry.storedSize > packSize - entry.dataOffset
+                || (!(entry.flags & PackEntry_LZ4) && entry.storedSize != entry.size))
+            fatalExit(fmt() << "Pack file \"" << packFile << "\" is corrupt.");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(looseFilesMutex);
+        listLooseFiles();
+    }
+
+    mounted = true;
+    logPrint(fmt() << "Mounted \"" << packFile << "\": " << packEntryCount << " file(s), "
+        << looseFiles.size() << " loose file(s) override it.");
+
+    return true;
+}
+
+void vfsUnmount()
+{
+    unmapPack();
+    packEntries = nullptr;
+    packEntryCount = 0;
+    packNames = nullptr;
+    mounted = false;
+
+    std::lock_guard<std::mutex> lock(looseFilesMutex);
+    looseFiles.clear();
+}
+
+bool vfsIsLoose(const std::string& name)
+{
+    if (!mounted) {
+        struct stat st;
+        return (stat(("data/" + name).c_str(), &st) == 0);
+    }
+
+    std::lock_guard<std::mutex> lock(looseFilesMutex);
+    return std::binary_search(looseFiles.begin(), looseFiles.end(), name);
+}
+
+void vfsAddLooseFile(const std::string& name)
+{
+    if (!mounted)
+        return;
+
+    std::lock_guard<std::mutex> lock(looseFilesMutex);
+    auto it = std::lower_bound(looseFiles.begin(), looseFiles.end(), name);
+    if (it == looseFiles.end() || *it != name)
+        looseFiles.insert(it, name);
+}
+
+static const PackEntry* findEntry(const std::string& name)
+{
+    auto compare = [](const PackEntry& entry, const std::string& name) -> bool {
+            size_t length = std::min(size_t(entry.nameLength), name.length());
+            int result = memcmp(packNames + entry.nameOffset, name.data(), length);
+            return (result != 0 ? result < 0 : entry.nameLength < name.length());
+        };
+
+    const PackEntry* end = packEntries + packEntryCount;
+    const PackEntry* it = std::lower_bound(packEntries, end, name, compare);
+    if (it == end || it->nameLength != name.length() || memcmp(packNames + it->nameOffset, name.data(), name.length()) != 0)
+        return nullptr;
+
+    return it;
+}
+
+bool vfsIsPacked(const std::string& name)
+{
+    return mounted && findEntry(name) != nullptr;
+}
+
+bool vfsFindPacked(const std::string& name, const char*& data, size_t& size, std::string& buffer)
+{
+    if (!mounted || vfsIsLoose(name))
+        return false;
+
+    const PackEntry* entry = findEntry(name);
+    if (!entry)
+        return false;
+
+    if (!(entry->flags & PackEntry_LZ4)) {
+        data = packData + entry->dataOffset;
+        size = entry->size;
+        return true;
+    }
+
+    buffer.resize(entry->size);
+    if (!lz4Decompress(packData + entry->dataOffset, entry->storedSize, &buffer[0], buffer.size()))
+        fatalExit(fmt() << "Packed file \"" << name << "\" is corrupt.");
+
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+std::string vfsBuildPack(const std::vector<PackInput>& files)
+{
+    std::vector<const PackInput*> sorted;
+    for (const auto& file : files)
+        sorted.push_back(&file);
+    std::sort(sorted.begin(), sorted.end(), [](const PackInput* a, const PackInput* b) { return a->name < b->name; });
+
+    std::string names;
+    for (const auto* file : sorted)
+        names += file->name;
+
+    PackHeader header;
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.entryCount = uint32_t(sorted.size());
+    header.namesSize = uint32_t(names.length());
+
+    std::vector<PackEntry> entries(sorted.size());
+    std::string contents;
+    size_t contentsOffset = sizeof(header) + entries.size() * sizeof(PackEntry) + names.length();
+    contentsOffset = (contentsOffset + PACK_ALIGNMENT - 1) & ~(PACK_ALIGNMENT - 1);
+
+    uint32_t nameOffset = 0;
+    std::vector<char> compressed;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const PackInput& file = *sorted[i];
+        PackEntry& entry = entries[i];
+
+        entry.nameOffset = nameOffset;
+        entry.nameLength = uint32_t(file.name.length());
+        nameOffset += entry.nameLength;
+
+        contents.append((PACK_ALIGNMENT - contents.length() % PACK_ALIGNMENT) % PACK_ALIGNMENT, 0);
+        entry.dataOffset = uint32_t(contentsOffset + contents.length());
+        entry.size = uint32_t(file.data.length());
+        entry.flags = 0;
+
+        size_t compressedSize = 0;
+        if (file.compress && !file.data.empty()) {
+            compressed.resize(lz4CompressBound(file.data.length()));
+            compressedSize = lz4Compress(file.data.data(), file.data.length(), compressed.data(), compressed.size());
+        }
+
+        if (compressedSize > 0 && compressedSize < file.data.length()) {
+            entry.storedSize = uint32_t(compressedSize);
+            entry.flags |= PackEntry_LZ4;
+            contents.append(compressed.data(), compressedSize);
+        } else {
+            entry.storedSize = entry.size;
+            contents.append(file.data);
+        }
+    }
+
+    std::string result(reinterpret_cast<const char*>(&header), sizeof(header));
+    result.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(PackEntry));
+    result.append(names);
+    result.append(contentsOffset - result.length(), 0);
+    result.append(contents);
+
+    return result;
+}
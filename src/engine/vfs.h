@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef VFS_H
+#define VFS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Game files are looked up in the loose data/ directory first and then in the mounted pack file.
+// Without a pack file everything comes from data/ as before. FileMapping (util.h) is the consumer
+// interface: files stored uncompressed in the pack are returned as a span of the mapped pack.
+
+struct PackInput
+{
+    std::string name;
+    std::string data;
+    bool compress;
+};
+
+// Maps the pack file and lists data/ once. Returns false if the pack file does not exist.
+bool vfsMount(const std::string& packFile);
+void vfsUnmount();
+
+// Whether `name` is a file in data/. Once a pack is mounted this is answered from the listing.
+bool vfsIsLoose(const std::string& name);
+void vfsAddLooseFile(const std::string& name);
+
+bool vfsIsPacked(const std::string& name);
+
+// Fails when the file is not packed or a loose file overrides it. Stored entries are returned
+// in place; compressed ones are decompressed into `buffer`.
+bool vfsFindPacked(const std::string& name, const char*& data, size_t& size, std::string& buffer);
+
+// Entries are compressed only when that saves space.
+std::string vfsBuildPack(const std::vector<PackInput>& files);
+
+#endif
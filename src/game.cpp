@@ -17,11 +17,17 @@
  */
 #include "game.h"
 #include "level.h"
-#include "engine/opengl.h"
+#include "engine/draw.h"
+#include "engine/profiler.h"
 #include "menu/gamescreen.h"
 #include "menu/mainmenu.h"
+#include <cmath>
+
+static const double UPDATE_STEP = 1.0 / 60.0;
+static const int MAX_UPDATES_PER_FRAME = 5;
 
 static GameScreen* currentScreen;
+static double updateAccumulator;
 
 void gameInit()
 {
@@ -44,19 +50,43 @@ GameScreen* gameScreen()
 void gameSetScreen(GameScreen* screen)
 {
     currentScreen = screen;
+    updateAccumulator = 0.0;
+}
+
+void gameStartLevel(const std::string& file)
+{
+    Level* level = new Level;
+    level->map.load(file);
+    gameSetScreen(level);
 }
 
 void gameRunFrame(double frameTime, int width, int height)
 {
-    glDisable(GL_BLEND);
-    glEnable(GL_CULL_FACE);
-    glDisable(GL_SCISSOR_TEST);
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
+    PROFILE_SCOPE("gameRunFrame");
+
+    drawDisable(GL_BLEND);
+    drawEnable(GL_CULL_FACE);
+    drawDisable(GL_SCISSOR_TEST);
+    drawEnable(GL_DEPTH_TEST);
+    drawDepthMask(true);
+
+    drawClear(glm::vec4(0.1f, 0.3f, 0.5f, 1.0f), GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (!currentScreen)
+        return;
+
+    updateAccumulator += frameTime;
 
-    glClearColor(0.1f, 0.3f, 0.5f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    int updates = 0;
+    while (updateAccumulator >= UPDATE_STEP) {
+        if (updates++ == MAX_UPDATES_PER_FRAME) {
+            // Too far behind (slow frame, debugger, window drag): drop the backlog instead of spiralling
+            updateAccumulator = fmod(updateAccumulator, UPDATE_STEP);
+            break;
+        }
+        currentScreen->update(UPDATE_STEP);
+        updateAccumulator -= UPDATE_STEP;
+    }
 
-    if (currentScreen)
-        currentScreen->run(frameTime, width, height);
+    currentScreen->render(updateAccumulator / UPDATE_STEP, width, height);
 }
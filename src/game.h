@@ -18,6 +18,8 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <string>
+
 class GameScreen;
 
 void gameInit();
@@ -26,6 +28,9 @@ void gameShutdown();
 GameScreen* gameScreen();
 void gameSetScreen(GameScreen* screen);
 
+// Skips the menu and plays the given level.
+void gameStartLevel(const std::string& file);
+
 void gameRunFrame(double time, int width, int height);
 
 #endif
@@ -17,47 +17,37 @@
  */
 #include "level.h"
 #include "game.h"
+#include "engine/depthsort.h"
 #include "engine/draw.h"
+#include "engine/framearena.h"
 #include "engine/opengl.h"
 #include "engine/gui.h"
+#include "engine/memtrack.h"
+#include "engine/profiler.h"
 #include "engine/util.h"
-#include <map>
 #include <glm/gtc/matrix_transform.hpp>
 
 static const float COEFF = 32.0f;
+static const float WALK_SPEED = 60.0f;
+static const float TURN_SPEED = 120.0f;
 static Sprite man1Sprite;
-static GLuint wallpaperTexture;
-static GLuint floorTexture;
+static std::shared_ptr<Texture> wallpaperTexture;
+static std::shared_ptr<Texture> floorTexture;
 bool ssaoEnabled = true;
 
-void Level::StaticMesh::loadMesh()
-{
-    mesh = meshGetCached(meshName + ".mesh");
-}
-
-void Level::StaticMesh::calcMatrix()
-{
-    matrix = glm::translate(glm::mat4(1.0f), pos);
-    matrix = glm::rotate(matrix, glm::radians(rot.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    matrix = glm::rotate(matrix, glm::radians(rot.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    matrix = glm::rotate(matrix, glm::radians(rot.z), glm::vec3(0.0f, 0.0f, 1.0f));
-    matrix = glm::scale(matrix, scale);
-}
-
 Level::Level()
 {
-    // FIXME
-    auto object = std::make_shared<FlatSprite>();
-    object->pos = glm::vec3(0.0f);
-    object->sprite = man1Sprite;
-    sprites.emplace_back(object);
+    // The player is not part of the map, otherwise saving the level from the editor would store it
+    mPlayerSprite = std::make_shared<LevelMap::FlatSprite>();
+    mPlayerSprite->pos = glm::vec3(0.0f);
+    mPlayerSprite->sprite = man1Sprite;
 
-    auto mesh = std::make_shared<StaticMesh>();
+    auto mesh = std::make_shared<LevelMap::StaticMesh>();
     mesh->pos = glm::vec3(10.0f, 10.0f, 0.0f);
-    mesh->meshName = "chair";
+    mesh->setMeshName("chair", 5);
     mesh->loadMesh();
     mesh->calcMatrix();
-    meshes.emplace_back(mesh);
+    map.meshes.emplace_back(mesh);
 }
 
 Level::~Level()
@@ -67,113 +57,136 @@ Level::~Level()
 void Level::loadResources()
 {
     man1Sprite = spriteLoad("man1.sprite");
-    wallpaperTexture = openglLoadTexture("wallpaper.png", RepeatXY, GL_NEAREST);
-    floorTexture = openglLoadTexture("floor.png", RepeatXY, GL_NEAREST);
+    wallpaperTexture = openglGetCachedTexture("wallpaper.png", RepeatXY, GL_NEAREST);
+    floorTexture = openglGetCachedTexture("floor.png", RepeatXY, GL_NEAREST);
 }
 
 void Level::unloadResources()
 {
     spriteDelete(man1Sprite);
-    openglDeleteTexture(floorTexture);
-    openglDeleteTexture(wallpaperTexture);
+    floorTexture.reset();
+    wallpaperTexture.reset();
 }
 
 void Level::draw3D() const
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
+    drawEnable(GL_DEPTH_TEST);
+    drawDepthMask(true);
 
     if (!ssaoEnabled) {
-        glDepthFunc(GL_LEQUAL);
+        PROFILE_SCOPE("Forward pass");
+        drawBeginPass(DrawPass_Geometry);
+        drawDepthFunc(GL_LEQUAL);
         drawContents3D();
         drawSprites();
-        glDepthFunc(GL_LESS);
+        drawDepthFunc(GL_LESS);
+        drawBeginPass(DrawPass_Other);
         return;
     }
 
-    glDepthFunc(GL_LESS);
-
-    drawBeginRenderToTexture(0, true);
-    drawSetShader(Shader_Depth);
-    drawContents3D();
-    drawEndRenderToTexture();
-
-    glDepthFunc(GL_LEQUAL);
+    drawDepthFunc(GL_LESS);
+    drawBeginPass(DrawPass_Geometry);
 
-    drawBeginRenderToTexture(1, false);
-    drawSetShader(Shader_Default);
-    drawContents3D();
-    drawEndRenderToTexture();
+    {
+        PROFILE_SCOPE("Depth pass");
+        drawBeginRenderToTexture(0, true);
+        drawSetShader(Shader_Depth);
+        drawContents3D();
+        drawEndRenderToTexture();
+    }
 
-    glDisable(GL_DEPTH_TEST);
-    glDepthMask(GL_FALSE);
-    glDepthFunc(GL_LESS);
+    drawDepthFunc(GL_LEQUAL);
 
-    drawBeginRenderToTexture(2, false);
-    drawSsao();
-    drawEndRenderToTexture();
+    {
+        PROFILE_SCOPE("Color pass");
+        drawBeginRenderToTexture(1, false);
+        drawSetShader(Shader_Default);
+        drawContents3D();
+        drawEndRenderToTexture();
+    }
 
-    drawBeginRenderToTexture(0, false);
-    drawBlur();
-    drawEndRenderToTexture();
+    drawDisable(GL_DEPTH_TEST);
+    drawDepthMask(false);
+    drawDepthFunc(GL_LESS);
+
+    {
+        PROFILE_SCOPE("SSAO pass");
+        drawBeginPass(DrawPass_Ssao);
+        drawBeginRenderToTexture(2, false);
+        drawSsao();
+        drawEndRenderToTexture();
+
+        drawBeginPass(DrawPass_Blur);
+        drawBeginRenderToTexture(0, false);
+        drawBlur();
+        drawEndRenderToTexture();
+    }
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
+    drawBeginPass(DrawPass_Composite);
+    drawEnable(GL_DEPTH_TEST);
+    drawDepthFunc(GL_LEQUAL);
 
-    drawBeginRenderToTexture(1, false);
-    drawFromFramebuffer(0);
-    drawSprites();
-    drawEndRenderToTexture();
+    {
+        PROFILE_SCOPE("Sprite pass");
+        drawBeginRenderToTexture(1, false);
+        drawFromFramebuffer(0);
+        drawSprites();
+        drawEndRenderToTexture();
+    }
 
     drawFromFramebuffer(1);
 
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS);
+    drawDepthMask(true);
+    drawDepthFunc(GL_LESS);
+    drawBeginPass(DrawPass_Other);
 }
 
 void Level::drawContents3D() const
 {
-    glDisable(GL_BLEND);
+    drawDisable(GL_BLEND);
 
     // Draw walls
     drawSetTexture(wallpaperTexture);
     drawBeginPrimitive(GL_TRIANGLES);
-    for (const auto& sector : sectors) {
-        size_t n = sector->points.size();
+    for (const auto& sector : map.sectors) {
+        uint32_t first = sector.firstPoint;
+        uint32_t n = sector.pointCount;
         float prev = 0.0f;
-        for (size_t i = 0; i < n; i++) {
-            const auto& p1 = sector->points[i];
-            const auto& p2 = sector->points[(i + 1) % n];
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t i1 = first + i;
+            uint32_t i2 = first + (i + 1) % n;
+            const auto& p1 = map.points[i1];
+            const auto& p2 = map.points[i2];
 
-            float length = glm::length(p2->pos - p1->pos) / COEFF;
+            float length = glm::length(p2.pos - p1.pos) / COEFF;
             float next = prev + length;
 
-            auto adjacentSector = p1->adjacentSector.lock();
-            if (adjacentSector) {
-                auto ap1 = p1->adjacentPoint.lock();
-                auto ap2 = p2->adjacentPoint.lock();
-                if (ap1 && ap2) {
+            const auto& wall = map.walls[i1];
+            if (wall.adjacentSector != LevelMap::NONE) {
+                uint32_t ap1 = wall.adjacentPoint;
+                uint32_t ap2 = map.walls[i2].adjacentPoint;
+                if (ap1 != LevelMap::NONE && ap2 != LevelMap::NONE) {
                     drawEndPrimitive();
 
-                    if (p1->extraWallTex >= 0)
+                    if (wall.extraWallTex >= 0)
                         drawSetTexture(floorTexture);
                     else
                         drawSetTexture(wallpaperTexture);
 
                     drawBeginPrimitive(GL_TRIANGLES);
 
-                    if (p1->minZ <= ap1->minZ && p2->minZ <= ap2->minZ) {
-                        float minz1 = p1->minZ;
-                        float minz2 = p2->minZ;
-                        float maxz1 = ap1->minZ;
-                        float maxz2 = ap2->minZ;
+                    if (p1.minZ <= map.points[ap1].minZ && p2.minZ <= map.points[ap2].minZ) {
+                        float minz1 = p1.minZ;
+                        float minz2 = p2.minZ;
+                        float maxz1 = map.points[ap1].minZ;
+                        float maxz2 = map.points[ap2].minZ;
 
-                        drawVertex3D(glm::vec3(p1->pos, minz1), glm::vec2(prev, 0.0f));
-                        auto v1 = drawVertex3D(glm::vec3(p1->pos, maxz1), glm::vec2(prev, 1.0f));
-                        auto v2 = drawVertex3D(glm::vec3(p2->pos, minz2), glm::vec2(next, 0.0f));
+                        drawVertex3D(glm::vec3(p1.pos, minz1), glm::vec2(prev, 0.0f));
+                        auto v1 = drawVertex3D(glm::vec3(p1.pos, maxz1), glm::vec2(prev, 1.0f));
+                        auto v2 = drawVertex3D(glm::vec3(p2.pos, minz2), glm::vec2(next, 0.0f));
                         drawIndex(v2);
                         drawIndex(v1);
-                        drawVertex3D(glm::vec3(p2->pos, maxz2), glm::vec2(next, 1.0f));
+                        drawVertex3D(glm::vec3(p2.pos, maxz2), glm::vec2(next, 1.0f));
                     }
 
                     drawEndPrimitive();
@@ -184,13 +197,13 @@ void Level::drawContents3D() const
                 continue;
             }
 
-            drawVertex3D(glm::vec3(p1->pos, p1->minZ), glm::vec2(prev, 0.0f));
-            auto v1 = drawVertex3D(glm::vec3(p1->pos, p1->maxZ), glm::vec2(prev, 1.0f));
-            auto v2 = drawVertex3D(glm::vec3(p2->pos, p2->minZ), glm::vec2(next, 0.0f));
+            drawVertex3D(glm::vec3(p1.pos, p1.minZ), glm::vec2(prev, 0.0f));
+            auto v1 = drawVertex3D(glm::vec3(p1.pos, p1.maxZ), glm::vec2(prev, 1.0f));
+            auto v2 = drawVertex3D(glm::vec3(p2.pos, p2.minZ), glm::vec2(next, 0.0f));
 
             drawIndex(v2);
             drawIndex(v1);
-            drawVertex3D(glm::vec3(p2->pos, p2->maxZ), glm::vec2(next, 1.0f));
+            drawVertex3D(glm::vec3(p2.pos, p2.maxZ), glm::vec2(next, 1.0f));
 
             prev = next;
         }
@@ -200,24 +213,21 @@ void Level::drawContents3D() const
     // Draw floor
     drawSetTexture(floorTexture);
     drawBeginPrimitive(GL_TRIANGLES);
-    for (const auto& sector : sectors) {
-        size_t n = sector->points.size();
-        for (size_t i = 2; i < n; i++) {
-            const auto& p1 = sector->points[0];
-            const auto& p2 = sector->points[i - 1];
-            const auto& p3 = sector->points[i];
-
-            drawVertex3D(glm::vec3(p1->pos, p1->minZ), p1->pos / COEFF);
-            drawVertex3D(glm::vec3(p2->pos, p2->minZ), p2->pos / COEFF);
-            drawVertex3D(glm::vec3(p3->pos, p3->minZ), p3->pos / COEFF);
+    for (uint32_t i = 0; i < uint32_t(map.sectors.size()); i++) {
+        const auto* points = &map.points[map.sectors[i].firstPoint];
+        for (uint32_t index : map.floorTriangles(i)) {
+            const auto& p = points[index];
+            drawVertex3D(glm::vec3(p.pos, p.minZ), p.pos / COEFF);
         }
     }
     drawEndPrimitive();
 
     // Draw 3D objects
-    for (const auto& object : meshes) {
+    for (const auto& object : map.meshes) {
+        const auto& mesh = *object->mesh;
         drawPushMatrix(drawGetMatrix() * object->matrix);
-        drawMesh(*object->mesh);
+        float screenSize = drawProjectedSize(mesh.bboxCenter, glm::length(mesh.bboxSize) * 0.5f);
+        drawMesh(mesh, mesh.selectLod(screenSize));
         drawPopMatrix();
     }
 }
@@ -226,154 +236,85 @@ void Level::drawSprites() const
 {
     drawFlush();
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // Draw 2D objects
-    for (const auto& object : sprites)
-        drawBillboard(object->pos, object->sprite);
-    drawFlush();
-
-    glDisable(GL_BLEND);
-}
+    drawEnable(GL_BLEND);
+    drawBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-void Level::load(const std::string& file)
-{
-    std::string data = loadFile(file);
-    std::istringstream ss(data);
-
-    size_t n = 0;
-    ss >> n;
-    sectors.clear();
-    sectors.reserve(n);
-
-    std::map<int, std::shared_ptr<Sector>> sectorIds;
-    std::map<int, std::shared_ptr<Point>> pointIds;
-
-    size_t j = n;
-    while (j--) {
-        int sectorId = -1;
-        size_t nn = 0;
-        ss >> sectorId >> nn;
-
-        auto sector = std::make_shared<Sector>();
-        sectorIds[sectorId] = sector;
-
-        while (nn--) {
-            int pointId = -1;
-            ss >> pointId;
-
-            auto point = std::make_shared<Point>();
-            pointIds[pointId] = point;
-            ss >> point->pos.x >> point->pos.y >> point->minZ >> point->maxZ;
-            sector->points.emplace_back(std::move(point));
-        }
-
-        sectors.emplace_back(std::move(sector));
+    // Draw 2D objects, back to front as they are blended. Level files store only sprite positions,
+    // sprites without an image are not drawn.
+    FrameVector<const LevelMap::FlatSprite*> objects;
+    objects.reserve(map.sprites.size() + 1);
+    for (const auto& sprite : map.sprites) {
+        if (sprite->sprite.texture)
+            objects.emplace_back(sprite.get());
     }
-
-    while (n--) {
-        size_t nn = 0;
-        ss >> nn;
-
-        while (nn--) {
-            int pointId = -1;
-            ss >> pointId;
-            auto point = pointIds[pointId];
-            if (!point)
-                fatalExit("Level file is corrupt.");
-
-            int adjacentPointId = -1, adjacentSectorId = -1;
-            ss >> adjacentSectorId >> adjacentPointId;
-            point->adjacentSector = sectorIds[adjacentSectorId];
-            point->adjacentPoint = pointIds[adjacentPointId];
-            ss >> point->extraWallTex;
-        }
+    objects.emplace_back(mPlayerSprite.get());
+
+    size_t count = objects.size();
+    FrameVector<float> x(count), y(count), z(count);
+    for (size_t i = 0; i < count; i++) {
+        const auto& pos = objects[i]->pos;
+        x[i] = pos.x;
+        y[i] = pos.y;
+        z[i] = pos.z;
     }
 
-    n = 0;
-    ss >> n;
-    meshes.clear();
-    meshes.reserve(n);
-
-    while (n--) {
-        auto staticMesh = std::make_shared<StaticMesh>();
-        ss >> staticMesh->pos.x >> staticMesh->pos.y >> staticMesh->pos.z;
-        ss >> staticMesh->rot.x >> staticMesh->rot.y >> staticMesh->rot.z;
-        ss >> staticMesh->scale.x >> staticMesh->scale.y >> staticMesh->scale.z;
-        ss >> staticMesh->meshName;
-        staticMesh->loadMesh();
-        staticMesh->calcMatrix();
-        meshes.emplace_back(std::move(staticMesh));
+    FrameVector<uint32_t> order(count);
+    depthSortBackToFront(drawGetMatrix(), x.data(), y.data(), z.data(), count, order.data());
+    for (uint32_t index : order) {
+        const auto& object = *objects[index];
+        drawBillboard(object.pos, object.sprite);
     }
+    drawFlush();
 
-    n = 0;
-    ss >> n;
-    // FIXME
-    //sprites.clear();
-    sprites.reserve(n);
-
-    while (n--) {
-        auto sprite = std::make_shared<FlatSprite>();
-        ss >> sprite->pos.x >> sprite->pos.y >> sprite->pos.z;
-        // FIXME
-    }
+    drawDisable(GL_BLEND);
 }
 
-void Level::save(const std::string& file) const
+void Level::updatePlayer(float time)
 {
-    std::stringstream ss;
-
-    std::map<Sector*, int> sectorIds;
-    std::map<Point*, int> pointIds;
-
-    sectorIds[nullptr] = -1;
-    pointIds[nullptr] = -1;
-
-    ss << sectors.size() << std::endl;
-    for (const auto& sector : sectors) {
-        size_t sectorId = sectorIds.size();
-        sectorIds[sector.get()] = int(sectorId);
-        ss << sectorId << ' ' << sector->points.size() << std::endl;
-        for (const auto& point : sector->points) {
-            size_t pointId = pointIds.size();
-            pointIds[point.get()] = int(pointId);
-            ss << pointId << ' ' << point->pos.x << ' ' << point->pos.y << ' ' << point->minZ << ' ' << point->maxZ << std::endl;
-        }
-    }
-
-    for (const auto& sector : sectors) {
-        ss << sector->points.size() << std::endl;
-        for (const auto& point : sector->points) {
-            ss << pointIds[point.get()];
-            ss << ' ' << sectorIds[point->adjacentSector.lock().get()];
-            ss << ' ' << pointIds[point->adjacentPoint.lock().get()];
-            ss << ' ' << point->extraWallTex;
-            ss << std::endl;
+    if (player.sector == LevelMap::NONE && !map.sectors.empty())
+        actorPlace(map, player);
+
+    const auto& io = ImGui::GetIO();
+    if (!io.WantCaptureKeyboard) {
+        float turn = 0.0f;
+        float walk = 0.0f;
+        if (ImGui::IsKeyDown(io.KeyMap[ImGuiKey_LeftArrow]))
+            turn += 1.0f;
+        if (ImGui::IsKeyDown(io.KeyMap[ImGuiKey_RightArrow]))
+            turn -= 1.0f;
+        if (ImGui::IsKeyDown(io.KeyMap[ImGuiKey_UpArrow]))
+            walk += 1.0f;
+        if (ImGui::IsKeyDown(io.KeyMap[ImGuiKey_DownArrow]))
+            walk -= 1.0f;
+
+        player.angle += turn * TURN_SPEED * time;
+        if (walk != 0.0f && player.sector != LevelMap::NONE) {
+            glm::vec2 direction(cosf(glm::radians(player.angle)), sinf(glm::radians(player.angle)));
+            actorMove(map, player, direction * (walk * WALK_SPEED * time));
         }
     }
+}
 
-    ss << meshes.size() << std::endl;
-    for (const auto& mesh : meshes) {
-        ss << mesh->pos.x << ' ' << mesh->pos.y << ' ' << mesh->pos.z << std::endl;
-        ss << mesh->rot.x << ' ' << mesh->rot.y << ' ' << mesh->rot.z << std::endl;
-        ss << mesh->scale.x << ' ' << mesh->scale.y << ' ' << mesh->scale.z << std::endl;
-        ss << mesh->meshName << std::endl;
-    }
-
-    ss << sprites.size() << std::endl;
-    for (const auto& sprite : sprites) {
-        ss << sprite->pos.x << ' ' << sprite->pos.y << ' ' << sprite->pos.z << std::endl;
-        // FIXME
-    }
+void Level::update(double dt)
+{
+    PROFILE_SCOPE("Level::update");
+    MemTagScope tag(MemTag_Level);
 
-    saveFile(file, ss.str());
+    mPrevPlayer = player;
+    updatePlayer(float(dt));
 }
 
-void Level::run(double time, int width, int height)
+void Level::render(double alpha, int width, int height)
 {
+    MemTagScope tag(MemTag_Level);
+
+    // Interpolate between the last two simulation states so motion stays smooth at any frame rate
+    glm::vec3 prevPos(mPrevPlayer.pos, mPrevPlayer.z);
+    glm::vec3 target = glm::mix(prevPos, glm::vec3(player.pos, player.z), float(alpha));
+    mPlayerSprite->pos = target;
+
     drawBegin(glm::perspective(glm::radians(90.0f), float(width) / float(height), 1.0f, 1000.0f));
-    drawPushMatrix(glm::lookAt(glm::vec3(80.0f, 80.0f, 80.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    drawPushMatrix(glm::lookAt(target + glm::vec3(80.0f, 80.0f, 80.0f), target, glm::vec3(0.0f, 0.0f, 1.0f)));
     draw3D();
     drawEnd();
 }
@@ -0,0 +1,705 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "levelmap.h"
+#include "engine/jobs.h"
+#include "engine/parser.h"
+#include "engine/triangulate.h"
+#include "engine/util.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+const uint32_t LevelMap::NONE;
+
+namespace
+{
+    // Binary levels (".levelb") start with a header followed by a table of sections. Every section
+    // is a tightly packed array of records aligned to 16 bytes; points, walls and sectors have exactly
+    // the in-memory layout of the corresponding LevelMap arrays so they are loaded with a single copy
+    // out of the memory-mapped file. All values are little-endian.
+    const char LEVELB_MAGIC[4] = { 'L', 'V', 'L', 'B' };
+    const uint32_t LEVELB_VERSION = 1;
+    const size_t LEVELB_ALIGNMENT = 16;
+
+    enum LevelSection : uint32_t
+    {
+        Section_Points = 1,
+        Section_Walls,
+        Section_Sectors,
+        Section_Meshes,
+        Section_Sprites,
+        Section_Strings,
+    };
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint32_t reserved;
+    };
+
+    struct FileSection
+    {
+        uint32_t type;
+        uint32_t count;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct FileMesh
+    {
+        float pos[3];
+        float rot[3];
+        float scale[3];
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    struct FileSprite
+    {
+        float pos[3];
+    };
+
+    static_assert(sizeof(LevelMap::Point) == 16, "LevelMap::Point layout does not match the binary format.");
+    static_assert(sizeof(LevelMap::Wall) == 12, "LevelMap::Wall layout does not match the binary format.");
+    static_assert(sizeof(LevelMap::Sector) == 8, "LevelMap::Sector layout does not match the binary format.");
+}
+
+static bool isBinaryLevel(const std::string& file)
+{
+    static const std::string extension = ".levelb";
+    return file.length() >= extension.length()
+        && file.compare(file.length() - extension.length(), extension.length(), extension) == 0;
+}
+
+void LevelMap::StaticMesh::setMeshName(const char* name, size_t length)
+{
+    meshId = assetIntern(name, length, ".mesh");
+}
+
+std::string LevelMap::StaticMesh::meshName() const
+{
+    return changeFileExtension(assetName(meshId), "");
+}
+
+void LevelMap::StaticMesh::loadMesh()
+{
+    mesh = meshGetCachedAsync(meshId);
+}
+
+void LevelMap::StaticMesh::calcMatrix()
+{
+    matrix = glm::translate(glm::mat4(1.0f), pos);
+    matrix = glm::rotate(matrix, glm::radians(rot.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    matrix = glm::rotate(matrix, glm::radians(rot.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    matrix = glm::rotate(matrix, glm::radians(rot.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    matrix = glm::scale(matrix, scale);
+}
+
+uint32_t LevelMap::nextPoint(uint32_t point) const
+{
+    const auto& sector = sectors[sectorOfPoint(point)];
+    return (point + 1 < sector.firstPoint + sector.pointCount ? point + 1 : sector.firstPoint);
+}
+
+uint32_t LevelMap::sectorOfPoint(uint32_t point) const
+{
+    auto it = std::upper_bound(sectors.begin(), sectors.end(), point,
+        [](uint32_t p, const Sector& sector) { return p < sector.firstPoint; });
+    assert(it != sectors.begin());
+    return uint32_t(it - sectors.begin()) - 1;
+}
+
+uint32_t LevelMap::addSector(uint32_t pointCount)
+{
+    Sector sector;
+    sector.firstPoint = uint32_t(points.size());
+    sector.pointCount = pointCount;
+
+    points.resize(points.size() + pointCount);
+    walls.resize(walls.size() + pointCount);
+    sectors.emplace_back(sector);
+    mFloors.resize(sectors.size());
+
+    return uint32_t(sectors.size() - 1);
+}
+
+uint32_t LevelMap::insertPoint(uint32_t sector, uint32_t localIndex, const Point& point)
+{
+    uint32_t index = sectors[sector].firstPoint + localIndex;
+
+    points.emplace(points.begin() + index, point);
+    walls.emplace(walls.begin() + index, Wall());
+
+    sectors[sector].pointCount++;
+    for (size_t i = sector + 1; i < sectors.size(); i++)
+        sectors[i].firstPoint++;
+
+    for (auto& wall : walls) {
+        if (wall.adjacentPoint != NONE && wall.adjacentPoint >= index)
+            wall.adjacentPoint++;
+    }
+
+    invalidateFloor(sector);
+    return index;
+}
+
+void LevelMap::erasePoint(uint32_t point)
+{
+    uint32_t sector = sectorOfPoint(point);
+
+    points.erase(points.begin() + point);
+    walls.erase(walls.begin() + point);
+
+    sectors[sector].pointCount--;
+    for (size_t i = sector + 1; i < sectors.size(); i++)
+        sectors[i].firstPoint--;
+
+    for (auto& wall : walls) {
+        if (wall.adjacentPoint == point)
+            wall.adjacentPoint = NONE;
+        else if (wall.adjacentPoint != NONE && wall.adjacentPoint > point)
+            wall.adjacentPoint--;
+    }
+
+    invalidateFloor(sector);
+}
+
+void LevelMap::eraseSector(uint32_t sector)
+{
+    uint32_t first = sectors[sector].firstPoint;
+    uint32_t count = sectors[sector].pointCount;
+
+    points.erase(points.begin() + first, points.begin() + first + count);
+    walls.erase(walls.begin() + first, walls.begin() + first + count);
+    sectors.erase(sectors.begin() + sector);
+    mFloors.erase(mFloors.begin() + sector);
+
+    for (size_t i = sector; i < sectors.size(); i++)
+        sectors[i].firstPoint -= count;
+
+    for (auto& wall : walls) {
+        if (wall.adjacentSector == sector)
+            wall.adjacentSector = NONE;
+        else if (wall.adjacentSector != NONE && wall.adjacentSector > sector)
+            wall.adjacentSector--;
+
+        if (wall.adjacentPoint == NONE)
+            continue;
+        if (wall.adjacentPoint >= first + count)
+            wall.adjacentPoint -= count;
+        else if (wall.adjacentPoint >= first)
+            wall.adjacentPoint = NONE;
+    }
+}
+
+const std::vector<uint32_t>& LevelMap::floorTriangles(uint32_t sector) const
+{
+    // The cache is sized by addSector(), eraseSector() and the loaders
+    assert(mFloors.size() == sectors.size());
+    triangulateFloor(sector);
+    return mFloors[sector].indices;
+}
+
+void LevelMap::buildFloors() const
+{
+    // Sectors are triangulated independently of each other
+    assert(mFloors.size() == sectors.size());
+    jobParallelFor(sectors.size(), [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            triangulateFloor(uint32_t(i));
+    });
+}
+
+void LevelMap::triangulateFloor(uint32_t sector) const
+{
+    auto& floor = mFloors[sector];
+    if (floor.valid)
+        return;
+
+    const auto& s = sectors[sector];
+    std::vector<glm::vec2> positions;
+    positions.reserve(s.pointCount);
+    for (uint32_t i = s.firstPoint; i < s.firstPoint + s.pointCount; i++)
+        positions.emplace_back(points[i].pos);
+
+    floor.indices.clear();
+    triangulatePolygon(positions.data(), positions.size(), floor.indices);
+    floor.valid = true;
+}
+
+bool LevelMap::isInsideSector(uint32_t sector, const glm::vec2& pos) const
+{
+    const auto& s = sectors[sector];
+    bool inside = false;
+    for (uint32_t i = 0, j = s.pointCount - 1; i < s.pointCount; j = i++) {
+        const auto& a = points[s.firstPoint + i].pos;
+        const auto& b = points[s.firstPoint + j].pos;
+        if ((a.y > pos.y) != (b.y > pos.y) && pos.x < (b.x - a.x) * (pos.y - a.y) / (b.y - a.y) + a.x)
+            inside = !inside;
+    }
+    return inside;
+}
+
+uint32_t LevelMap::updateSector(uint32_t sector, const glm::vec2& pos) const
+{
+    if (sector == NONE || sector >= sectors.size())
+        return NONE;
+    if (isInsideSector(sector, pos))
+        return sector;
+
+    const auto& s = sectors[sector];
+    for (uint32_t i = s.firstPoint; i < s.firstPoint + s.pointCount; i++) {
+        uint32_t adjacent = walls[i].adjacentSector;
+        if (adjacent != NONE && isInsideSector(adjacent, pos))
+            return adjacent;
+    }
+
+    return NONE;
+}
+
+uint32_t LevelMap::findSector(const glm::vec2& pos) const
+{
+    for (uint32_t i = 0; i < uint32_t(sectors.size()); i++) {
+        if (isInsideSector(i, pos))
+            return i;
+    }
+    return NONE;
+}
+
+float LevelMap::floorZ(uint32_t sector, const glm::vec2& pos) const
+{
+    return interpolateZ(sector, pos, false);
+}
+
+float LevelMap::ceilingZ(uint32_t sector, const glm::vec2& pos) const
+{
+    return interpolateZ(sector, pos, true);
+}
+
+float LevelMap::interpolateZ(uint32_t sector, const glm::vec2& pos, bool ceiling) const
+{
+    // A sector being built in the editor may have no points yet
+    if (sectors[sector].pointCount == 0)
+        return 0.0f;
+
+    const auto* p = &points[sectors[sector].firstPoint];
+    const auto& triangles = floorTriangles(sector);
+
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        const auto& p1 = p[triangles[i]];
+        const auto& p2 = p[triangles[i + 1]];
+        const auto& p3 = p[triangles[i + 2]];
+
+        glm::vec2 e1 = p2.pos - p1.pos;
+        glm::vec2 e2 = p3.pos - p1.pos;
+        float det = e1.x * e2.y - e1.y * e2.x;
+        if (det == 0.0f)
+            continue;
+
+        glm::vec2 d = pos - p1.pos;
+        float u = (d.x * e2.y - d.y * e2.x) / det;
+        float v = (e1.x * d.y - e1.y * d.x) / det;
+        if (u < -1e-4f || v < -1e-4f || u + v > 1.0f + 1e-4f)
+            continue;
+
+        float z1 = (ceiling ? p1.maxZ : p1.minZ);
+        float z2 = (ceiling ? p2.maxZ : p2.minZ);
+        float z3 = (ceiling ? p3.maxZ : p3.minZ);
+        return z1 + (z2 - z1) * u + (z3 - z1) * v;
+    }
+
+    // Position is on the border or outside of the sector
+    return (ceiling ? p[0].maxZ : p[0].minZ);
+}
+
+void LevelMap::invalidateFloor(uint32_t sector)
+{
+    mFloors[sector].valid = false;
+}
+
+void LevelMap::invalidatePoint(uint32_t point)
+{
+    if (point != NONE)
+        invalidateFloor(sectorOfPoint(point));
+}
+
+void LevelMap::load(const std::string& file, bool loadMeshes)
+{
+    if (isBinaryLevel(file))
+        loadBinary(file, loadMeshes);
+    else
+        loadText(file, loadMeshes);
+
+    validate();
+    buildFloors();
+}
+
+void LevelMap::save(const std::string& file) const
+{
+    if (isBinaryLevel(file))
+        saveBinary(file);
+    else
+        saveText(file);
+}
+
+void LevelMap::loadText(const std::string& file, bool loadMeshes)
+{
+    FileMapping mapping(file);
+    TextParser parser(mapping.data(), mapping.size(), file);
+
+    size_t n = parser.readSize();
+
+    points.clear();
+    walls.clear();
+    sectors.clear();
+    mFloors.clear();
+    sectors.reserve(n);
+
+    // Identifiers in the file are arbitrary integers; they are resolved with a binary search over
+    // sorted (id, index) pairs.
+    typedef std::pair<int, uint32_t> Id;
+    std::vector<Id> sectorIds;
+    std::vector<Id> pointIds;
+    sectorIds.reserve(n);
+
+    size_t j = n;
+    while (j--) {
+        int sectorId = parser.readInt();
+        size_t nn = parser.readSize();
+
+        uint32_t sector = addSector(uint32_t(nn));
+        sectorIds.emplace_back(sectorId, sector);
+
+        for (uint32_t index = sectors[sector].firstPoint; nn--; ++index) {
+            pointIds.emplace_back(parser.readInt(), index);
+
+            auto& point = points[index];
+            parser.read(point.pos.x, point.pos.y, point.minZ, point.maxZ);
+        }
+    }
+
+    std::sort(sectorIds.begin(), sectorIds.end());
+    std::sort(pointIds.begin(), pointIds.end());
+
+    auto lookup = [](const std::vector<Id>& ids, int id) -> uint32_t {
+            auto it = std::lower_bound(ids.begin(), ids.end(), Id(id, 0));
+            return (it != ids.end() && it->first == id ? it->second : NONE);
+        };
+
+    while (n--) {
+        size_t nn = parser.readSize();
+
+        while (nn--) {
+            uint32_t point = lookup(pointIds, parser.readInt());
+            if (point == NONE)
+                fatalExit("Level file is corrupt.");
+
+            int adjacentSectorId = parser.readInt();
+            int adjacentPointId = parser.readInt();
+
+            auto& wall = walls[point];
+            wall.adjacentSector = lookup(sectorIds, adjacentSectorId);
+            wall.adjacentPoint = lookup(pointIds, adjacentPointId);
+            wall.extraWallTex = parser.readInt();
+        }
+    }
+
+    n = (parser.atEnd() ? 0 : parser.readSize());
+    meshes.clear();
+    meshes.reserve(n);
+
+    while (n--) {
+        auto staticMesh = std::make_shared<StaticMesh>();
+        parser.read(staticMesh->pos.x, staticMesh->pos.y, staticMesh->pos.z);
+        parser.read(staticMesh->rot.x, staticMesh->rot.y, staticMesh->rot.z);
+        parser.read(staticMesh->scale.x, staticMesh->scale.y, staticMesh->scale.z);
+        auto name = parser.readToken();
+        staticMesh->setMeshName(name.ptr, name.length);
+        if (loadMeshes)
+            staticMesh->loadMesh();
+        staticMesh->calcMatrix();
+        meshes.emplace_back(std::move(staticMesh));
+    }
+
+    n = (parser.atEnd() ? 0 : parser.readSize());
+    sprites.clear();
+    sprites.reserve(n);
+
+    while (n--) {
+        auto sprite = std::make_shared<FlatSprite>();
+        parser.read(sprite->pos.x, sprite->pos.y, sprite->pos.z);
+        sprites.emplace_back(std::move(sprite));
+    }
+}
+
+void LevelMap::saveText(const std::string& file) const
+{
+    std::stringstream ss;
+
+    // Identifiers in the file are 1-based indices, -1 stands for "none".
+    auto id = [](uint32_t index) -> long { return (index != NONE ? long(index) + 1 : -1L); };
+
+    ss << sectors.size() << std::endl;
+    for (size_t i = 0; i < sectors.size(); i++) {
+        const auto& sector = sectors[i];
+        ss << id(uint32_t(i)) << ' ' << sector.pointCount << std::endl;
+        for (uint32_t j = sector.firstPoint; j < sector.firstPoint + sector.pointCount; j++) {
+            const auto& point = points[j];
+            ss << id(j) << ' ' << point.pos.x << ' ' << point.pos.y << ' ' << point.minZ << ' ' << point.maxZ << std::endl;
+        }
+    }
+
+    for (const auto& sector : sectors) {
+        ss << sector.pointCount << std::endl;
+        for (uint32_t j = sector.firstPoint; j < sector.firstPoint + sector.pointCount; j++) {
+            const auto& wall = walls[j];
+            ss << id(j);
+            ss << ' ' << id(wall.adjacentSector);
+            ss << ' ' << id(wall.adjacentPoint);
+            ss << ' ' << wall.extraWallTex;
+            ss << std::endl;
+        }
+    }
+
+    ss << meshes.size() << std::endl;
+    for (const auto& mesh : meshes) {
+        ss << mesh->pos.x << ' ' << mesh->pos.y << ' ' << mesh->pos.z << std::endl;
+        ss << mesh->rot.x << ' ' << mesh->rot.y << ' ' << mesh->rot.z << std::endl;
+        ss << mesh->scale.x << ' ' << mesh->scale.y << ' ' << mesh->scale.z << std::endl;
+        ss << mesh->meshName() << std::endl;
+    }
+
+    ss << sprites.size() << std::endl;
+    for (const auto& sprite : sprites) {
+        ss << sprite->pos.x << ' ' << sprite->pos.y << ' ' << sprite->pos.z << std::endl;
+    }
+
+    saveFile(file, ss.str());
+}
+
+void LevelMap::loadBinary(const std::string& file, bool loadMeshes)
+{
+    FileMapping mapping(file);
+
+    const char* data = mapping.data();
+    size_t size = mapping.size();
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(data);
+    if (size < sizeof(FileHeader) || memcmp(header->magic, LEVELB_MAGIC, sizeof(LEVELB_MAGIC)) != 0)
+        fatalExit(fmt() << "File \"" << file << "\" is not a binary level.");
+    if (header->version != LEVELB_VERSION)
+        fatalExit(fmt() << "Binary level \"" << file << "\" has unsupported version " << header->version << '.');
+    if (size < sizeof(FileHeader) + size_t(header->sectionCount) * sizeof(FileSection))
+        fatalExit("Level file is corrupt.");
+
+    points.clear();
+    walls.clear();
+    sectors.clear();
+    meshes.clear();
+    sprites.clear();
+    mFloors.clear();
+
+    const FileMesh* fileMeshes = nullptr;
+    size_t meshCount = 0;
+    const FileSprite* fileSprites = nullptr;
+    size_t spriteCount = 0;
+    const char* strings = nullptr;
+    size_t stringsSize = 0;
+
+    const FileSection* sections = reinterpret_cast<const FileSection*>(header + 1);
+    for (uint32_t i = 0; i < header->sectionCount; i++) {
+        const FileSection& section = sections[i];
+        if (size_t(section.offset) + section.size > size)
+            fatalExit("Level file is corrupt.");
+
+        const char* ptr = data + section.offset;
+        // Records are used in place, so a section must be both complete and aligned for its element type
+        auto checkSize = [&section](size_t recordSize, size_t recordAlignment) {
+                if (size_t(section.count) * recordSize != section.size || section.offset % recordAlignment != 0)
+                    fatalExit("Level file is corrupt.");
+            };
+
+        switch (section.type) {
+            case Section_Points: {
+                checkSize(sizeof(Point), alignof(Point));
+                auto begin = reinterpret_cast<const Point*>(ptr);
+                points.assign(begin, begin + section.count);
+                break;
+            }
+
+            case Section_Walls: {
+                checkSize(sizeof(Wall), alignof(Wall));
+                auto begin = reinterpret_cast<const Wall*>(ptr);
+                walls.assign(begin, begin + section.count);
+                break;
+            }
+
+            case Section_Sectors: {
+                checkSize(sizeof(Sector), alignof(Sector));
+                auto begin = reinterpret_cast<const Sector*>(ptr);
+                sectors.assign(begin, begin + section.count);
+                break;
+            }
+
+            case Section_Meshes:
+                checkSize(sizeof(FileMesh), alignof(FileMesh));
+                fileMeshes = reinterpret_cast<const FileMesh*>(ptr);
+                meshCount = section.count;
+                break;
+
+            case Section_Sprites:
+                checkSize(sizeof(FileSprite), alignof(FileSprite));
+                fileSprites = reinterpret_cast<const FileSprite*>(ptr);
+                spriteCount = section.count;
+                break;
+
+            case Section_Strings:
+                strings = ptr;
+                stringsSize = section.size;
+                break;
+
+            default:
+                break;  // Unknown sections are skipped so that older builds can read newer files
+        }
+    }
+
+    mFloors.resize(sectors.size());
+
+    meshes.reserve(meshCount);
+    for (size_t i = 0; i < meshCount; i++) {
+        const FileMesh& m = fileMeshes[i];
+        if (size_t(m.nameOffset) + m.nameLength > stringsSize)
+            fatalExit("Level file is corrupt.");
+
+        auto staticMesh = std::make_shared<StaticMesh>();
+        staticMesh->pos = glm::vec3(m.pos[0], m.pos[1], m.pos[2]);
+        staticMesh->rot = glm::vec3(m.rot[0], m.rot[1], m.rot[2]);
+        staticMesh->scale = glm::vec3(m.scale[0], m.scale[1], m.scale[2]);
+        staticMesh->setMeshName(strings + m.nameOffset, m.nameLength);
+        if (loadMeshes)
+            staticMesh->loadMesh();
+        staticMesh->calcMatrix();
+        meshes.emplace_back(std::move(staticMesh));
+    }
+
+    sprites.reserve(spriteCount);
+    for (size_t i = 0; i < spriteCount; i++) {
+        const FileSprite& s = fileSprites[i];
+        auto sprite = std::make_shared<FlatSprite>();
+        sprite->pos = glm::vec3(s.pos[0], s.pos[1], s.pos[2]);
+        sprites.emplace_back(std::move(sprite));
+    }
+}
+
+void LevelMap::saveBinary(const std::string& file) const
+{
+    // Every mesh name is stored once, placements of the same mesh share it
+    std::string strings;
+    std::vector<std::pair<uint32_t, uint32_t>> nameRanges(assetCount(), std::make_pair(0u, 0u));
+    std::vector<FileMesh> fileMeshes;
+    fileMeshes.reserve(meshes.size());
+    for (const auto& mesh : meshes) {
+        FileMesh m;
+        for (int i = 0; i < 3; i++) {
+            m.pos[i] = mesh->pos[i];
+            m.rot[i] = mesh->rot[i];
+            m.scale[i] = mesh->scale[i];
+        }
+        auto& range = nameRanges[mesh->meshId];
+        if (range.second == 0) {
+            std::string name = mesh->meshName();
+            range = std::make_pair(uint32_t(strings.length()), uint32_t(name.length()));
+            strings += name;
+        }
+        m.nameOffset = range.first;
+        m.nameLength = range.second;
+        fileMeshes.emplace_back(m);
+    }
+
+    std::vector<FileSprite> fileSprites;
+    fileSprites.reserve(sprites.size());
+    for (const auto& sprite : sprites) {
+        FileSprite s;
+        for (int i = 0; i < 3; i++)
+            s.pos[i] = sprite->pos[i];
+        fileSprites.emplace_back(s);
+    }
+
+    struct Source { LevelSection type; size_t count; size_t size; const void* data; };
+    const Source sources[] = {
+            { Section_Points, points.size(), points.size() * sizeof(Point), points.data() },
+            { Section_Walls, walls.size(), walls.size() * sizeof(Wall), walls.data() },
+            { Section_Sectors, sectors.size(), sectors.size() * sizeof(Sector), sectors.data() },
+            { Section_Meshes, fileMeshes.size(), fileMeshes.size() * sizeof(FileMesh), fileMeshes.data() },
+            { Section_Sprites, fileSprites.size(), fileSprites.size() * sizeof(FileSprite), fileSprites.data() },
+            { Section_Strings, strings.length(), strings.length(), strings.data() },
+        };
+    const size_t sectionCount = sizeof(sources) / sizeof(sources[0]);
+
+    auto align = [](size_t offset) { return (offset + LEVELB_ALIGNMENT - 1) & ~(LEVELB_ALIGNMENT - 1); };
+
+    FileHeader header;
+    memcpy(header.magic, LEVELB_MAGIC, sizeof(LEVELB_MAGIC));
+    header.version = LEVELB_VERSION;
+    header.sectionCount = uint32_t(sectionCount);
+    header.reserved = 0;
+
+    FileSection sections[sectionCount];
+    size_t offset = align(sizeof(FileHeader) + sizeof(sections));
+    for (size_t i = 0; i < sectionCount; i++) {
+        sections[i].type = sources[i].type;
+        sections[i].count = uint32_t(sources[i].count);
+        sections[i].offset = uint32_t(offset);
+        sections[i].size = uint32_t(sources[i].size);
+        offset = align(offset + sources[i].size);
+    }
+
+    std::string data(offset, 0);
+    memcpy(&data[0], &header, sizeof(header));
+    memcpy(&data[sizeof(header)], sections, sizeof(sections));
+    for (size_t i = 0; i < sectionCount; i++) {
+        if (sources[i].size > 0)
+            memcpy(&data[sections[i].offset], sources[i].data, sources[i].size);
+    }
+
+    saveFile(file, data);
+}
+
+void LevelMap::validate() const
+{
+    if (walls.size() != points.size())
+        fatalExit("Level file is corrupt.");
+
+    uint32_t expectedFirst = 0;
+    for (const auto& sector : sectors) {
+        if (sector.firstPoint != expectedFirst || sector.pointCount > points.size() - expectedFirst)
+            fatalExit("Level file is corrupt.");
+        expectedFirst += sector.pointCount;
+    }
+    if (expectedFirst != points.size())
+        fatalExit("Level file is corrupt.");
+
+    for (const auto& wall : walls) {
+        if ((wall.adjacentSector != NONE && wall.adjacentSector >= sectors.size())
+                || (wall.adjacentPoint != NONE && wall.adjacentPoint >= points.size()))
+            fatalExit("Level file is corrupt.");
+    }
+}
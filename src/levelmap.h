@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef LEVELMAP_H
+#define LEVELMAP_H
+
+#include "engine/sprite.h"
+#include "engine/mesh.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Level topology is stored Build-style in flat arrays addressed by 32-bit indices. Every sector owns
+// a contiguous range of points; wall `i` runs from point `i` to the next point of the same sector and
+// is described by `walls[i]`. A wall that is a portal references the sector behind it and the point
+// on the other side that coincides with its starting point.
+class LevelMap
+{
+public:
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Point
+    {
+        glm::vec2 pos;
+        float minZ;
+        float maxZ;
+
+        Point()
+            : pos(0.0f)
+            , minZ(0.0f)
+            , maxZ(0.0f)
+        {
+        }
+
+        Point(const glm::vec2& p, float mnZ, float mxZ)
+            : pos(p)
+            , minZ(mnZ)
+            , maxZ(mxZ)
+        {
+        }
+    };
+
+    struct Wall
+    {
+        uint32_t adjacentSector = NONE;
+        uint32_t adjacentPoint = NONE;
+        int32_t extraWallTex = -1;
+    };
+
+    struct Sector
+    {
+        uint32_t firstPoint;
+        uint32_t pointCount;
+    };
+
+    struct StaticMesh
+    {
+        glm::vec3 pos{0.0f};
+        glm::vec3 rot{0.0f};
+        glm::vec3 scale{1.0f};
+        AssetId meshId = NO_ASSET;  // "<name>.mesh"; level files refer to meshes by the bare name
+        glm::mat4 matrix{1.0f};
+        std::shared_ptr<Mesh> mesh;
+
+        void setMeshName(const char* name, size_t length);
+        std::string meshName() const;
+
+        void loadMesh();
+        void calcMatrix();
+    };
+
+    struct FlatSprite
+    {
+        glm::vec3 pos;
+        Sprite sprite;
+    };
+
+    std::vector<Point> points;
+    std::vector<Wall> walls;
+    std::vector<Sector> sectors;
+    std::vector<std::shared_ptr<StaticMesh>> meshes;
+    std::vector<std::shared_ptr<FlatSprite>> sprites;
+
+    uint32_t nextPoint(uint32_t point) const;
+    uint32_t sectorOfPoint(uint32_t point) const;
+
+    uint32_t addSector(uint32_t pointCount);
+    uint32_t insertPoint(uint32_t sector, uint32_t localIndex, const Point& point);
+    void erasePoint(uint32_t point);
+    void eraseSector(uint32_t sector);
+
+    // updateSector() checks the given sector and the sectors behind its portals only, so that its
+    // cost does not depend on the size of the level; findSector() scans the whole map. Both return
+    // NONE for positions outside of the sectors they check.
+    bool isInsideSector(uint32_t sector, const glm::vec2& pos) const;
+    uint32_t updateSector(uint32_t sector, const glm::vec2& pos) const;
+    uint32_t findSector(const glm::vec2& pos) const;
+
+    // Heights interpolated over the floor triangles of the sector.
+    float floorZ(uint32_t sector, const glm::vec2& pos) const;
+    float ceilingZ(uint32_t sector, const glm::vec2& pos) const;
+
+    // Floor triangles as indices local to the sector; rebuilt lazily after invalidateFloor().
+    const std::vector<uint32_t>& floorTriangles(uint32_t sector) const;
+    void buildFloors() const;
+    void invalidateFloor(uint32_t sector);
+    void invalidatePoint(uint32_t point);
+
+    // Files with the ".levelb" extension use the binary format, anything else is treated as text.
+    // Without `loadMeshes` static meshes keep only their names and placement, which is all the
+    // tools that convert levels need.
+    void load(const std::string& file, bool loadMeshes = true);
+    void save(const std::string& file) const;
+
+private:
+    struct FloorCache
+    {
+        std::vector<uint32_t> indices;
+        bool valid = false;
+    };
+
+    mutable std::vector<FloorCache> mFloors;
+
+    void triangulateFloor(uint32_t sector) const;
+    float interpolateZ(uint32_t sector, const glm::vec2& pos, bool ceiling) const;
+
+    void loadText(const std::string& file, bool loadMeshes);
+    void saveText(const std::string& file) const;
+    void loadBinary(const std::string& file, bool loadMeshes);
+    void saveBinary(const std::string& file) const;
+    void validate() const;
+};
+
+#endif
@@ -25,6 +25,10 @@ GameScreen::~GameScreen()
 {
 }
 
-void GameScreen::run(double time, int width, int height)
+void GameScreen::update(double dt)
+{
+}
+
+void GameScreen::render(double alpha, int width, int height)
 {
 }
@@ -24,7 +24,11 @@ public:
     GameScreen();
     virtual ~GameScreen();
 
-    virtual void run(double time, int width, int height);
+    // Called at a fixed rate with a constant time step
+    virtual void update(double dt);
+
+    // Called once per frame; alpha is how far (0..1) the frame lies between the last two updates
+    virtual void render(double alpha, int width, int height);
 };
 
 #endif
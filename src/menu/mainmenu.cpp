@@ -35,7 +35,7 @@ MainMenu::~MainMenu()
 {
 }
 
-void MainMenu::run(double time, int width, int height)
+void MainMenu::render(double alpha, int width, int height)
 {
     if (ImGui::Button("PLAY GAME!")) {
         Level* level = new Level;
@@ -26,7 +26,7 @@ public:
     MainMenu();
     ~MainMenu();
 
-    void run(double time, int width, int height) override;
+    void render(double alpha, int width, int height) override;
 
 private:
     char mMeshFile[256];
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "levelmap.h"
+#include "engine/etc1.h"
+#include "engine/jobs.h"
+#include "engine/ktx.h"
+#include "engine/mesh.h"
+#include "engine/util.h"
+#include "engine/vfs.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <dirent.h>
+
+#define STBI_NO_STDIO
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+// Bump whenever the format of any prepared asset changes so that everything gets rebuilt.
+static const uint32_t ASSET_COMPILER_VERSION = 3;
+static const char MANIFEST_FILE[] = "assets.manifest";
+static const char PACK_FILE[] = "data.pak";
+
+namespace
+{
+    struct AssetType
+    {
+        const char* sourceExtension;
+        const char* preparedExtension;
+        void (*compile)(const std::string& source, const std::string& prepared);
+    };
+}
+
+static bool endsWith(const std::string& str, const char* suffix)
+{
+    size_t length = strlen(suffix);
+    return str.length() >= length && str.compare(str.length() - length, length, suffix) == 0;
+}
+
+static uint64_t contentHash(const std::string& data)
+{
+    uint64_t hash = 14695981039346656037ULL ^ ASSET_COMPILER_VERSION;
+    for (char ch : data) {
+        hash ^= uint8_t(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void compileMesh(const std::string& source, const std::string& prepared)
+{
+    Mesh mesh;
+    mesh.load(source);
+
+    MeshBakeStats stats;
+    mesh.bake(&stats);
+    logPrint(fmt() << "    " << stats.inputFaces << " => " << stats.outputFaces << " faces, " << stats.inputVertices << " => " << stats.uniqueVertices << " vertices, "
+        << mesh.lods[0].indexCount / 3 << " triangles, ACMR " << stats.acmrSoup << " => " << stats.acmrWelded << " (welded) => " << stats.acmrOptimized << " (optimized).");
+
+    std::stringstream ss;
+    for (const auto& lod : mesh.lods)
+        ss << (&lod == &mesh.lods[0] ? "" : ", ") << lod.indexCount / 3;
+    logPrint(fmt() << "    LOD triangles: " << ss.str() << ".");
+
+    mesh.saveBaked(prepared);
+}
+
+static void compileLevel(const std::string& source, const std::string& prepared)
+{
+    LevelMap map;
+    map.load(source, false);
+    map.save(prepared);
+}
+
+static std::vector<uint8_t> downsample(const std::vector<uint8_t>& pixels, int width, int height, int channels)
+{
+    int w = std::max(width / 2, 1);
+    int h = std::max(height / 2, 1);
+    std::vector<uint8_t> result(size_t(w * h * channels));
+
+    for (int y = 0; y < h; y++) {
+        int y1 = std::min(y * 2, height - 1);
+        int y2 = std::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < w; x++) {
+            int x1 = std::min(x * 2, width - 1);
+            int x2 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < channels; c++) {
+                int sum = pixels[size_t((y1 * width + x1) * channels + c)]
+                        + pixels[size_t((y1 * width + x2) * channels + c)]
+                        + pixels[size_t((y2 * width + x1) * channels + c)]
+                        + pixels[size_t((y2 * width + x2) * channels + c)];
+                result[size_t((y * w + x) * channels + c)] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+
+    return result;
+}
+
+static std::string padRows(const std::vector<uint8_t>& pixels, int width, int height, int channels)
+{
+    size_t rowSize = size_t(width * channels);
+    size_t stride = (rowSize + 3) & ~size_t(3);
+
+    std::string result(stride * size_t(height), 0);
+    for (int y = 0; y < height; y++)
+        memcpy(&result[size_t(y) * stride], &pixels[size_t(y) * rowSize], rowSize);
+
+    return result;
+}
+
+static bool isOpaque(const std::vector<uint8_t>& pixels, int channels)
+{
+    if (channels == 3)
+        return true;
+    if (channels != 4)
+        return false;
+
+    for (size_t i = 3; i < pixels.size(); i += 4) {
+        if (pixels[i] != 255)
+            return false;
+    }
+    return true;
+}
+
+static std::string encodeEtc1(const std::vector<uint8_t>& pixels, int width, int height, int channels)
+{
+    std::string result(etc1ImageSize(width, height), 0);
+    uint8_t* out = reinterpret_cast<uint8_t*>(&result[0]);
+
+    // Encoding is slow, rows of blocks are small enough pieces to keep all threads busy
+    jobParallelFor(size_t((height + 3) / 4), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+            etc1EncodeBlockRow(pixels.data(), width, height, channels, int(row), out);
+    }, 1);
+
+    return result;
+}
+
+static void compileTexture(const std::string& source, const std::string& prepared)
+{
+    std::string fileData = loadFile(source);
+
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()),
+        int(fileData.size()), &width, &height, &channels, 0);
+    if (!data)
+        fatalExit(fmt() << "Unable to decode image file \"" << source << "\": " << stbi_failure_reason());
+
+    std::vector<uint8_t> pixels(data, data + width * height * channels);
+    stbi_image_free(data);
+
+    // Opaque images are compressed, alpha is kept uncompressed because ETC1 has no alpha channel.
+    bool compress = isOpaque(pixels, channels);
+
+    KtxImage image;
+    image.glType = GL_UNSIGNED_BYTE;
+    switch (channels) {
+        case 1: image.glFormat = GL_LUMINANCE; break;
+        case 2: image.glFormat = GL_LUMINANCE_ALPHA; break;
+        case 3: image.glFormat = GL_RGB; break;
+        case 4: image.glFormat = GL_RGBA; break;
+        default: fatalExit(fmt() << "Image \"" << source << "\" has unsupported format.");
+    }
+    image.glInternalFormat = image.glFormat;
+    image.glBaseInternalFormat = image.glFormat;
+    image.width = uint32_t(width);
+    image.height = uint32_t(height);
+
+    if (compress) {
+        image.glType = 0;
+        image.glFormat = 0;
+        image.glInternalFormat = GL_ETC1_RGB8_OES;
+        image.glBaseInternalFormat = GL_RGB;
+    }
+
+    std::vector<std::string> levels;
+    for (;;) {
+        if (compress)
+            levels.emplace_back(encodeEtc1(pixels, width, height, channels));
+        else
+            levels.emplace_back(padRows(pixels, width, height, channels));
+        if (width == 1 && height == 1)
+            break;
+        pixels = downsample(pixels, width, height, channels);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    for (const auto& level : levels)
+        image.levels.push_back(KtxImage::Level{ level.data(), level.size() });
+
+    saveFile(prepared, ktxWrite(image));
+}
+
+static const AssetType assetTypes[] = {
+        { ".mesh", ".meshb", compileMesh },
+        { ".level", ".levelb", compileLevel },
+        { ".png", ".ktx", compileTexture },
+    };
+
+static std::map<std::string, uint64_t> loadManifest()
+{
+    std::map<std::string, uint64_t> manifest;
+    if (!fileExists(MANIFEST_FILE))
+        return manifest;
+
+    std::istringstream ss(loadFile(MANIFEST_FILE));
+    std::string name;
+    uint64_t hash;
+    while (ss >> std::hex >> hash >> name)
+        manifest[name] = hash;
+
+    return manifest;
+}
+
+static void saveManifest(const std::map<std::string, uint64_t>& manifest)
+{
+    std::stringstream ss;
+    for (const auto& it : manifest)
+        ss << std::hex << it.second << ' ' << it.first << std::endl;
+    saveFile(MANIFEST_FILE, ss.str());
+}
+
+static std::vector<std::string> listDataDirectory()
+{
+    DIR* dir = opendir("data");
+    if (!dir)
+        fatalExit("Unable to open the data directory.");
+
+    std::vector<std::string> files;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            files.emplace_back(entry->d_name);
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Images are stored as is so that the game can upload them straight out of the mapped pack.
+static void writePack()
+{
+    std::vector<PackInput> inputs;
+    for (const auto& file : listDataDirectory()) {
+        if (file == MANIFEST_FILE)
+            continue;
+        bool compress = !endsWith(file, ".png") && !endsWith(file, ".ktx");
+        inputs.emplace_back(PackInput{ file, loadFile(file), compress });
+    }
+
+    std::string pack = vfsBuildPack(inputs);
+
+    // The pack lives next to the data directory, outside of what saveFile() manages
+    FILE* f = fopen(PACK_FILE, "wb");
+    if (!f) {
+        const char* errorMessage = strerror(errno);
+        fatalExit(fmt() << "Unable to write file \"" << PACK_FILE << "\": " << errorMessage);
+    }
+    size_t bytesWritten = fwrite(pack.data(), 1, pack.size(), f);
+    bool failed = (ferror(f) != 0);
+    if (fclose(f) != 0 || failed || bytesWritten != pack.size())
+        fatalExit(fmt() << "Unable to write file \"" << PACK_FILE << "\".");
+
+    logPrint(fmt() << "Packed " << inputs.size() << " file(s) into \"" << PACK_FILE << "\" (" << pack.size() << " bytes).");
+}
+
+// Walks the data directory and converts every source asset into the form the game loads directly:
+// meshes are baked into vertex arrays, levels are converted to the binary format and images are
+// decoded into KTX textures with a full mip chain, ETC1 compressed when the image is opaque.
+// Assets whose contents did not change since the previous run are skipped. With --pack, the whole
+// data directory is then stored into a single pack file for the game to mount.
+int main(int argc, char** argv)
+{
+    bool force = false;
+    bool pack = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else if (strcmp(argv[i], "--pack") == 0)
+            pack = true;
+        else
+            fatalExit(fmt() << "Usage: " << argv[0] << " [--force] [--pack]");
+    }
+
+    jobInit();
+
+    std::vector<std::string> files = listDataDirectory();
+
+    auto manifest = loadManifest();
+    size_t compiled = 0, skipped = 0;
+
+    for (const auto& file : files) {
+        for (const auto& type : assetTypes) {
+            if (!endsWith(file, type.sourceExtension))
+                continue;
+
+            std::string prepared = changeFileExtension(file, type.preparedExtension);
+            uint64_t hash = contentHash(loadFile(file));
+
+            auto it = manifest.find(file);
+            // The game falls back to the source when it is newer than the prepared file, so skip only
+            // what the game is going to use
+            if (!force && it != manifest.end() && it->second == hash && preparedFileIsCurrent(prepared, file)) {
+                ++skipped;
+                break;
+            }
+
+            logPrint(fmt() << "Compiling \"" << file << "\" => \"" << prepared << "\".");
+            type.compile(file, prepared);
+            manifest[file] = hash;
+            ++compiled;
+            break;
+        }
+    }
+
+    saveManifest(manifest);
+    meshShutdownCache();
+    jobShutdown();
+
+    logPrint(fmt() << compiled << " asset(s) compiled, " << skipped << " up to date.");
+
+    if (pack)
+        writePack();
+
+    return 0;
+}
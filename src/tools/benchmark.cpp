@@ -0,0 +1,658 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "levelmap.h"
+#include "engine/jobs.h"
+#include "engine/memtrack.h"
+#include "engine/meshopt.h"
+#include "engine/parser.h"
+#include "engine/triangulate.h"
+#include "engine/util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+// Times engine code on large synthetic inputs. With no arguments every section runs,
+// otherwise only the named ones.
+
+static const int BENCHMARK_RUNS = 3;
+
+// Best time of a few runs, in milliseconds.
+template <typename FUNC> static double measure(FUNC&& func)
+{
+    double best = 0.0;
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = (i == 0 ? time : std::min(best, time));
+    }
+    return best;
+}
+
+static std::string formatTime(double milliseconds)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.2f ms", milliseconds);
+    return buffer;
+}
+
+static void benchmarkTriangulate()
+{
+    static const size_t POINT_COUNTS[] = { 1000, 10000, 50000, 100000 };
+
+    // Large sectors as they come out of an editor: a plain circle (convex, every vertex is an ear),
+    // a circle with waves along it (many reflex vertices) and a rough one (reflex vertices everywhere).
+    static const char* const SHAPES[] = { "circle", "waves", "rough" };
+
+    for (size_t shape = 0; shape < sizeof(SHAPES) / sizeof(SHAPES[0]); shape++) {
+        for (size_t count : POINT_COUNTS) {
+            std::vector<glm::vec2> points(count);
+            uint32_t random = 1;
+            for (size_t i = 0; i < count; i++) {
+                float angle = 6.2831853f * float(i) / float(count);
+                float radius = 1000.0f;
+                switch (shape) {
+                    case 1: radius *= 1.0f + 0.05f * sinf(50.0f * angle); break;
+                    case 2:
+                        random = random * 1664525u + 1013904223u;
+                        radius += float(random >> 8) / float(1 << 24) * 3.0f * 6283.0f / float(count);
+                        break;
+                }
+                points[i] = glm::vec2(cosf(angle), sinf(angle)) * radius;
+            }
+
+            std::vector<uint32_t> indices;
+            double time = measure([&points, &indices]() {
+                    indices.clear();
+                    triangulatePolygon(points.data(), points.size(), indices);
+                });
+
+            // Every triangle is counted with its absolute area, so overlaps and triangles outside of
+            // the polygon show up as well as missing ones
+            double area = 0.0, clippedArea = 0.0;
+            for (size_t i = 0, j = count - 1; i < count; j = i++)
+                area += double(points[j].x) * points[i].y - double(points[i].x) * points[j].y;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                glm::dvec2 a(points[indices[i]]), b(points[indices[i + 1]]), c(points[indices[i + 2]]);
+                clippedArea += fabs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x));
+            }
+            if (indices.size() != (count - 2) * 3 || fabs(clippedArea - fabs(area)) > fabs(area) * 1e-9) {
+                fatalExit(fmt() << "Triangulation of " << SHAPES[shape] << " with " << count << " points gave "
+                    << indices.size() / 3 << " triangles covering " << clippedArea * 0.5 << " instead of "
+                    << count - 2 << " covering " << fabs(area) * 0.5 << ".");
+            }
+
+            logPrint(fmt() << "triangulate " << SHAPES[shape] << ", " << count << " points: " << formatTime(time) << ", "
+                << indices.size() / 3 << " triangles");
+        }
+    }
+}
+
+namespace
+{
+    // Level topology as it was stored before LevelMap: every point is a heap object linked to its
+    // neighbours with weak pointers. Floor caches are left out here and below.
+    struct OldSector;
+
+    struct OldPoint
+    {
+        glm::vec2 pos;
+        float minZ;
+        float maxZ;
+        std::weak_ptr<OldSector> adjacentSector;
+        std::weak_ptr<OldPoint> adjacentPoint;
+        int extraWallTex = -1;
+    };
+
+    struct OldSector
+    {
+        std::vector<std::shared_ptr<OldPoint>> points;
+    };
+}
+
+static const uint32_t LEVEL_GRID_SIZE = 256;
+
+// Square rooms of a grid, connected to their neighbours by portals. Floors step up along x.
+static LevelMap::Point gridPoint(uint32_t x, uint32_t y, uint32_t corner)
+{
+    static const uint32_t CORNERS[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    glm::vec2 pos(float(x + CORNERS[corner][0]) * 100.0f, float(y + CORNERS[corner][1]) * 100.0f);
+    return LevelMap::Point(pos, float(x % 4) * 10.0f, 200.0f);
+}
+
+// Sector and corner on the other side of the wall starting at the corner of a room, or false for a solid wall.
+static bool gridNeighbour(uint32_t x, uint32_t y, uint32_t corner, uint32_t& sector, uint32_t& otherCorner)
+{
+    static const int OFFSETS[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+    static const uint32_t OPPOSITE[4] = { 3, 0, 1, 2 };     // the corner at the same position in the neighbour
+    int nx = int(x) + OFFSETS[corner][0];
+    int ny = int(y) + OFFSETS[corner][1];
+    if (nx < 0 || ny < 0 || nx >= int(LEVEL_GRID_SIZE) || ny >= int(LEVEL_GRID_SIZE))
+        return false;
+    sector = uint32_t(ny) * LEVEL_GRID_SIZE + uint32_t(nx);
+    otherCorner = OPPOSITE[corner];
+    return true;
+}
+
+// Walks all walls the way the wall pass of the renderer does, following portals to the floors behind them.
+static float traverseLevel(const LevelMap& map)
+{
+    float sum = 0.0f;
+    for (uint32_t s = 0; s < uint32_t(map.sectors.size()); s++) {
+        uint32_t first = map.sectors[s].firstPoint;
+        uint32_t n = map.sectors[s].pointCount;
+        for (uint32_t i = 0; i < n; i++) {
+            const auto& p1 = map.points[first + i];
+            const auto& p2 = map.points[first + (i + 1) % n];
+            sum += glm::length(p2.pos - p1.pos);
+
+            const auto& wall = map.walls[first + i];
+            if (wall.adjacentSector != LevelMap::NONE) {
+                uint32_t ap1 = wall.adjacentPoint;
+                uint32_t ap2 = map.walls[first + (i + 1) % n].adjacentPoint;
+                if (ap1 != LevelMap::NONE && ap2 != LevelMap::NONE)
+                    sum += map.points[ap1].minZ - p1.minZ + map.points[ap2].minZ - p2.minZ;
+            } else
+                sum += p1.maxZ - p1.minZ;
+        }
+    }
+    return sum;
+}
+
+static float traverseOldLevel(const std::vector<std::shared_ptr<OldSector>>& sectors)
+{
+    float sum = 0.0f;
+    for (const auto& sector : sectors) {
+        size_t n = sector->points.size();
+        for (size_t i = 0; i < n; i++) {
+            const auto& p1 = sector->points[i];
+            const auto& p2 = sector->points[(i + 1) % n];
+            sum += glm::length(p2->pos - p1->pos);
+
+            auto adjacentSector = p1->adjacentSector.lock();
+            if (adjacentSector) {
+                auto ap1 = p1->adjacentPoint.lock();
+                auto ap2 = p2->adjacentPoint.lock();
+                if (ap1 && ap2)
+                    sum += ap1->minZ - p1->minZ + ap2->minZ - p2->minZ;
+            } else
+                sum += p1->maxZ - p1->minZ;
+        }
+    }
+    return sum;
+}
+
+static void benchmarkLevelMap()
+{
+    const uint32_t sectorCount = LEVEL_GRID_SIZE * LEVEL_GRID_SIZE;
+
+    // Both layouts are built with exact reservations, so the bytes allocated are the bytes kept.
+    LevelMap map;
+    memtrackEndFrame();
+    {
+        MemTagScope tag(MemTag_Level);
+        map.points.reserve(sectorCount * 4);
+        map.walls.reserve(sectorCount * 4);
+        map.sectors.reserve(sectorCount);
+        for (uint32_t y = 0; y < LEVEL_GRID_SIZE; y++) {
+            for (uint32_t x = 0; x < LEVEL_GRID_SIZE; x++) {
+                LevelMap::Sector sector;
+                sector.firstPoint = uint32_t(map.points.size());
+                sector.pointCount = 4;
+                map.sectors.emplace_back(sector);
+
+                for (uint32_t corner = 0; corner < 4; corner++) {
+                    LevelMap::Wall wall;
+                    uint32_t adjacentSector, adjacentCorner;
+                    if (gridNeighbour(x, y, corner, adjacentSector, adjacentCorner)) {
+                        wall.adjacentSector = adjacentSector;
+                        wall.adjacentPoint = adjacentSector * 4 + adjacentCorner;
+                    }
+                    map.points.emplace_back(gridPoint(x, y, corner));
+                    map.walls.emplace_back(wall);
+                }
+            }
+        }
+    }
+    memtrackEndFrame();
+    MemStats newStats = memtrackFrameStats(MemTag_Level);
+
+    std::vector<std::shared_ptr<OldSector>> oldSectors;
+    {
+        MemTagScope tag(MemTag_Level);
+        oldSectors.reserve(sectorCount);
+        for (uint32_t s = 0; s < sectorCount; s++) {
+            oldSectors.emplace_back(std::make_shared<OldSector>());
+            oldSectors.back()->points.reserve(4);
+        }
+        for (uint32_t y = 0; y < LEVEL_GRID_SIZE; y++) {
+            for (uint32_t x = 0; x < LEVEL_GRID_SIZE; x++) {
+                for (uint32_t corner = 0; corner < 4; corner++) {
+                    auto point = std::make_shared<OldPoint>();
+                    auto p = gridPoint(x, y, corner);
+                    point->pos = p.pos;
+                    point->minZ = p.minZ;
+                    point->maxZ = p.maxZ;
+                    oldSectors[y * LEVEL_GRID_SIZE + x]->points.emplace_back(std::move(point));
+                }
+            }
+        }
+        for (uint32_t y = 0; y < LEVEL_GRID_SIZE; y++) {
+            for (uint32_t x = 0; x < LEVEL_GRID_SIZE; x++) {
+                for (uint32_t corner = 0; corner < 4; corner++) {
+                    uint32_t adjacentSector, adjacentCorner;
+                    if (gridNeighbour(x, y, corner, adjacentSector, adjacentCorner)) {
+                        auto& point = oldSectors[y * LEVEL_GRID_SIZE + x]->points[corner];
+                        point->adjacentSector = oldSectors[adjacentSector];
+                        point->adjacentPoint = oldSectors[adjacentSector]->points[adjacentCorner];
+                    }
+                }
+            }
+        }
+    }
+    memtrackEndFrame();
+    MemStats oldStats = memtrackFrameStats(MemTag_Level);
+
+    float newSum = 0.0f, oldSum = 0.0f;
+    double newTime = measure([&map, &newSum]() { newSum = traverseLevel(map); });
+    double oldTime = measure([&oldSectors, &oldSum]() { oldSum = traverseOldLevel(oldSectors); });
+    if (newSum != oldSum)
+        fatalExit(fmt() << "Level layouts disagree: " << newSum << " vs " << oldSum << ".");
+
+    logPrint(fmt() << "levelmap, " << sectorCount << " sectors of 4 points, wall traversal:");
+    logPrint(fmt() << "    flat arrays: " << formatTime(newTime) << ", " << newStats.bytes / sectorCount
+        << " bytes per sector in " << newStats.allocations << " allocations");
+    logPrint(fmt() << "    shared_ptr points: " << formatTime(oldTime) << ", " << oldStats.bytes / sectorCount
+        << " bytes per sector in " << oldStats.allocations << " allocations");
+}
+
+// Cubes with random coordinates, written by the same code as the mesh editor saves them with.
+static std::string generateMeshText(size_t count)
+{
+    uint32_t random = 1;
+    auto next = [&random]() -> float {
+            random = random * 1664525u + 1013904223u;
+            return float(random >> 8) / float(1 << 24) * 100.0f - 50.0f;
+        };
+
+    std::stringstream ss;
+    ss << count << std::endl;
+    for (size_t i = 0; i < count; i++) {
+        Mesh::Cube cube;
+        cube.position = glm::vec3(next(), next(), next());
+        cube.rotation = glm::vec3(next(), next(), next());
+        cube.scale = glm::vec3(next(), next(), next());
+        cube.color = glm::vec4(next(), next(), next(), next());
+        cube.p1 = glm::vec3(next(), next(), next());
+        cube.p2 = glm::vec3(next(), next(), next());
+        cube.save(ss);
+    }
+    return ss.str();
+}
+
+// The grid level of benchmarkLevelMap() in the .level text format, as LevelMap::save() writes it.
+static std::string generateLevelText()
+{
+    const uint32_t sectorCount = LEVEL_GRID_SIZE * LEVEL_GRID_SIZE;
+
+    std::stringstream ss;
+    ss << sectorCount << std::endl;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        ss << s + 1 << ' ' << 4 << std::endl;
+        for (uint32_t corner = 0; corner < 4; corner++) {
+            auto point = gridPoint(s % LEVEL_GRID_SIZE, s / LEVEL_GRID_SIZE, corner);
+            ss << s * 4 + corner + 1 << ' ' << point.pos.x << ' ' << point.pos.y << ' ' << point.minZ << ' '
+                << point.maxZ << std::endl;
+        }
+    }
+
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        ss << 4 << std::endl;
+        for (uint32_t corner = 0; corner < 4; corner++) {
+            uint32_t adjacentSector, adjacentCorner;
+            ss << s * 4 + corner + 1;
+            if (gridNeighbour(s % LEVEL_GRID_SIZE, s / LEVEL_GRID_SIZE, corner, adjacentSector, adjacentCorner))
+                ss << ' ' << adjacentSector + 1 << ' ' << adjacentSector * 4 + adjacentCorner + 1;
+            else
+                ss << " -1 -1";
+            ss << ' ' << -1 << std::endl;
+        }
+    }
+
+    ss << 0 << std::endl;
+    ss << 0 << std::endl;
+    return ss.str();
+}
+
+// Mesh::load() and Mesh::Cube::load() as they were before TextParser.
+static void parseMeshWithStream(const std::string& data, std::vector<Mesh::Cube>& cubes)
+{
+    std::istringstream ss(data);
+
+    size_t n = 0;
+    ss >> n;
+
+    cubes.clear();
+    cubes.reserve(n);
+
+    while (n--) {
+        std::string objectType;
+        ss >> objectType;
+        if (objectType != Mesh::Cube::staticTypeString())
+            fatalExit(fmt() << "Unsupported object type \"" << objectType << "\".");
+
+        cubes.emplace_back();
+        auto& cube = cubes.back();
+        ss >> cube.position.x >> cube.position.y >> cube.position.z;
+        ss >> cube.rotation.x >> cube.rotation.y >> cube.rotation.z;
+        ss >> cube.scale.x >> cube.scale.y >> cube.scale.z;
+        ss >> cube.color.r >> cube.color.g >> cube.color.b >> cube.color.a;
+        ss >> cube.p1.x >> cube.p1.y >> cube.p1.z;
+        ss >> cube.p2.x >> cube.p2.y >> cube.p2.z;
+    }
+}
+
+static void parseMesh(const std::string& data, std::vector<Mesh::Cube>& cubes)
+{
+    TextParser parser(data.data(), data.size(), "benchmark.mesh");
+
+    size_t n = parser.readSize();
+
+    cubes.clear();
+    cubes.reserve(n);
+
+    while (n--) {
+        auto objectType = parser.readToken();
+        if (objectType != Mesh::Cube::staticTypeString())
+            fatalExit(fmt() << "Unsupported object type \"" << objectType.toString() << "\".");
+
+        cubes.emplace_back();
+        cubes.back().load(parser);
+    }
+}
+
+// The topology part of LevelMap::loadText() as it was before TextParser.
+static void parseLevelWithStream(const std::string& data, LevelMap& map)
+{
+    std::istringstream ss(data);
+
+    size_t n = 0;
+    ss >> n;
+
+    map = LevelMap();
+    map.sectors.reserve(n);
+
+    std::map<int, uint32_t> sectorIds;
+    std::map<int, uint32_t> pointIds;
+
+    size_t j = n;
+    while (j--) {
+        int sectorId = -1;
+        size_t nn = 0;
+        ss >> sectorId >> nn;
+
+        uint32_t sector = map.addSector(uint32_t(nn));
+        sectorIds[sectorId] = sector;
+
+        for (uint32_t index = map.sectors[sector].firstPoint; nn--; ++index) {
+            int pointId = -1;
+            ss >> pointId;
+            pointIds[pointId] = index;
+
+            auto& point = map.points[index];
+            ss >> point.pos.x >> point.pos.y >> point.minZ >> point.maxZ;
+        }
+    }
+
+    auto lookup = [](const std::map<int, uint32_t>& ids, int id) -> uint32_t {
+            auto it = ids.find(id);
+            return (it != ids.end() ? it->second : LevelMap::NONE);
+        };
+
+    while (n--) {
+        size_t nn = 0;
+        ss >> nn;
+
+        while (nn--) {
+            int pointId = -1;
+            ss >> pointId;
+            uint32_t point = lookup(pointIds, pointId);
+            if (point == LevelMap::NONE)
+                fatalExit("Level file is corrupt.");
+
+            int adjacentPointId = -1, adjacentSectorId = -1;
+            ss >> adjacentSectorId >> adjacentPointId;
+
+            auto& wall = map.walls[point];
+            wall.adjacentSector = lookup(sectorIds, adjacentSectorId);
+            wall.adjacentPoint = lookup(pointIds, adjacentPointId);
+            ss >> wall.extraWallTex;
+        }
+    }
+}
+
+// The topology part of LevelMap::loadText().
+static void parseLevel(const std::string& data, LevelMap& map)
+{
+    TextParser parser(data.data(), data.size(), "benchmark.level");
+
+    size_t n = parser.readSize();
+
+    map = LevelMap();
+    map.sectors.reserve(n);
+
+    typedef std::pair<int, uint32_t> Id;
+    std::vector<Id> sectorIds;
+    std::vector<Id> pointIds;
+    sectorIds.reserve(n);
+
+    size_t j = n;
+    while (j--) {
+        int sectorId = parser.readInt();
+        size_t nn = parser.readSize();
+
+        uint32_t sector = map.addSector(uint32_t(nn));
+        sectorIds.emplace_back(sectorId, sector);
+
+        for (uint32_t index = map.sectors[sector].firstPoint; nn--; ++index) {
+            pointIds.emplace_back(parser.readInt(), index);
+
+            auto& point = map.points[index];
+            parser.read(point.pos.x, point.pos.y, point.minZ, point.maxZ);
+        }
+    }
+
+    std::sort(sectorIds.begin(), sectorIds.end());
+    std::sort(pointIds.begin(), pointIds.end());
+
+    auto lookup = [](const std::vector<Id>& ids, int id) -> uint32_t {
+            auto it = std::lower_bound(ids.begin(), ids.end(), Id(id, 0));
+            return (it != ids.end() && it->first == id ? it->second : LevelMap::NONE);
+        };
+
+    while (n--) {
+        size_t nn = parser.readSize();
+
+        while (nn--) {
+            uint32_t point = lookup(pointIds, parser.readInt());
+            if (point == LevelMap::NONE)
+                fatalExit("Level file is corrupt.");
+
+            int adjacentSectorId = parser.readInt();
+            int adjacentPointId = parser.readInt();
+
+            auto& wall = map.walls[point];
+            wall.adjacentSector = lookup(sectorIds, adjacentSectorId);
+            wall.adjacentPoint = lookup(pointIds, adjacentPointId);
+            wall.extraWallTex = parser.readInt();
+        }
+    }
+}
+
+static void benchmarkParser()
+{
+    static const size_t MESH_OBJECT_COUNT = 100000;
+
+    std::string meshText = generateMeshText(MESH_OBJECT_COUNT);
+    std::vector<Mesh::Cube> streamCubes, cubes;
+    double streamTime = measure([&meshText, &streamCubes]() { parseMeshWithStream(meshText, streamCubes); });
+    double time = measure([&meshText, &cubes]() { parseMesh(meshText, cubes); });
+
+    for (size_t i = 0; i < cubes.size(); i++) {
+        const auto& a = cubes[i];
+        const auto& b = streamCubes[i];
+        if (a.position != b.position || a.rotation != b.rotation || a.scale != b.scale || a.color != b.color
+                || a.p1 != b.p1 || a.p2 != b.p2)
+            fatalExit(fmt() << "Parsers disagree on mesh object " << i << ".");
+    }
+
+    logPrint(fmt() << "parser, .mesh with " << MESH_OBJECT_COUNT << " cubes (" << meshText.size() / 1024 << " KB):");
+    logPrint(fmt() << "    TextParser: " << formatTime(time));
+    logPrint(fmt() << "    istringstream: " << formatTime(streamTime));
+
+    std::string levelText = generateLevelText();
+    LevelMap streamMap, map;
+    streamTime = measure([&levelText, &streamMap]() { parseLevelWithStream(levelText, streamMap); });
+    time = measure([&levelText, &map]() { parseLevel(levelText, map); });
+
+    for (size_t i = 0; i < map.points.size(); i++) {
+        const auto& a = map.points[i];
+        const auto& b = streamMap.points[i];
+        const auto& wa = map.walls[i];
+        const auto& wb = streamMap.walls[i];
+        if (a.pos != b.pos || a.minZ != b.minZ || a.maxZ != b.maxZ || wa.adjacentSector != wb.adjacentSector
+                || wa.adjacentPoint != wb.adjacentPoint || wa.extraWallTex != wb.extraWallTex)
+            fatalExit(fmt() << "Parsers disagree on level point " << i << ".");
+    }
+
+    logPrint(fmt() << "parser, .level with " << map.sectors.size() << " sectors (" << levelText.size() / 1024 << " KB):");
+    logPrint(fmt() << "    TextParser: " << formatTime(time));
+    logPrint(fmt() << "    istringstream and std::map: " << formatTime(streamTime));
+}
+
+// Runs the function with the job system started for 1, 2, ... threads and prints how it scales.
+template <typename FUNC> static void measureScaling(const std::string& name, FUNC&& func)
+{
+    unsigned maxThreads = std::min(std::max(std::thread::hardware_concurrency(), 2u), 9u);
+
+    logPrint(fmt() << "jobs, " << name << ":");
+    double singleTime = 0.0;
+    for (unsigned threads = 1; threads <= maxThreads; threads++) {
+        jobInit(threads);
+        double time = measure(func);
+        jobShutdown();
+
+        if (threads == 1)
+            singleTime = time;
+
+        char speedup[32];
+        snprintf(speedup, sizeof(speedup), "%.2fx", singleTime / time);
+        logPrint(fmt() << "    " << threads << (threads == 1 ? " thread: " : " threads: ") << formatTime(time)
+            << ", " << speedup);
+    }
+}
+
+static void benchmarkJobs()
+{
+    logPrint(fmt() << "jobs, " << std::thread::hardware_concurrency() << " hardware thread(s)");
+
+    // Hidden face removal of a block of touching cubes, as a mesh with many objects is baked
+    static const int BLOCK_SIZE = 12;
+    std::vector<MeshFace> blockFaces;
+    std::vector<MeshSolid> blockSolids;
+    for (int i = 0; i < BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE; i++) {
+        glm::vec3 origin(float(i % BLOCK_SIZE), float(i / BLOCK_SIZE % BLOCK_SIZE), float(i / (BLOCK_SIZE * BLOCK_SIZE)));
+        glm::vec3 corners[8];
+        for (int j = 0; j < 8; j++)
+            corners[j] = origin + glm::vec3(float(j & 1), float((j >> 1) & 1), float((j >> 2) & 1));
+        meshAddBox(corners, 0xFFFFFFFF, blockFaces, blockSolids);
+    }
+
+    size_t visibleFaces = 0;
+    measureScaling(fmt() << "hidden faces of " << blockSolids.size() << " cubes", [&]() {
+            std::vector<MeshFace> faces = blockFaces;
+            meshRemoveHiddenFaces(faces, blockSolids);
+            visibleFaces = faces.size();
+        });
+    if (visibleFaces != size_t(6 * BLOCK_SIZE * BLOCK_SIZE))
+        fatalExit(fmt() << "Hidden face removal left " << visibleFaces << " faces.");
+
+    // Floors of a level with many detailed sectors, as after loading
+    static const uint32_t SECTOR_COUNT = 2048;
+    static const uint32_t SECTOR_POINTS = 512;
+    LevelMap map;
+    for (uint32_t s = 0; s < SECTOR_COUNT; s++) {
+        uint32_t sector = map.addSector(SECTOR_POINTS);
+        glm::vec2 center(float(s % 64) * 3000.0f, float(s / 64) * 3000.0f);
+        for (uint32_t i = 0; i < SECTOR_POINTS; i++) {
+            float angle = 6.2831853f * float(i) / float(SECTOR_POINTS);
+            float radius = 1000.0f * (1.0f + 0.1f * sinf(float(s % 16 + 4) * angle));
+            map.points[map.sectors[sector].firstPoint + i] =
+                LevelMap::Point(center + glm::vec2(cosf(angle), sinf(angle)) * radius, 0.0f, 200.0f);
+        }
+    }
+
+    measureScaling(fmt() << "floors of " << SECTOR_COUNT << " sectors of " << SECTOR_POINTS << " points", [&map]() {
+            for (uint32_t s = 0; s < SECTOR_COUNT; s++)
+                map.invalidateFloor(s);
+            map.buildFloors();
+        });
+}
+
+namespace
+{
+    struct Section
+    {
+        const char* name;
+        void (*run)();
+    };
+}
+
+static const Section sections[] = {
+        { "triangulate", benchmarkTriangulate },
+        { "levelmap", benchmarkLevelMap },
+        { "parser", benchmarkParser },
+        { "jobs", benchmarkJobs },
+    };
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        bool found = false;
+        for (const auto& section : sections)
+            found = found || strcmp(argv[i], section.name) == 0;
+        if (!found)
+            fatalExit(fmt() << "Unknown benchmark \"" << argv[i] << "\".");
+    }
+
+    for (const auto& section : sections) {
+        bool selected = (argc == 1);
+        for (int i = 1; i < argc; i++)
+            selected = selected || strcmp(argv[i], section.name) == 0;
+        if (selected)
+            section.run();
+    }
+
+    return 0;
+}
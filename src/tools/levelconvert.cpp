@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016 Nikolay Zapolnov (zapolnov@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "levelmap.h"
+#include "engine/jobs.h"
+#include "engine/util.h"
+#include <algorithm>
+#include <cmath>
+
+static bool sameFloat(float a, float b)
+{
+    // Text levels keep six significant digits
+    return std::fabs(a - b) <= 1e-5f * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+}
+
+static bool sameVec(const glm::vec3& a, const glm::vec3& b)
+{
+    return sameFloat(a.x, b.x) && sameFloat(a.y, b.y) && sameFloat(a.z, b.z);
+}
+
+// Reads the written file back and makes sure nothing was lost on the way
+static void verifyRoundTrip(const LevelMap& map, const LevelMap& copy)
+{
+    if (copy.points.size() != map.points.size()
+            || copy.walls.size() != map.walls.size()
+            || copy.sectors.size() != map.sectors.size()
+            || copy.meshes.size() != map.meshes.size()
+            || copy.sprites.size() != map.sprites.size())
+        fatalExit("Round trip check failed: element counts differ.");
+
+    for (size_t i = 0; i < map.points.size(); i++) {
+        const auto& a = map.points[i];
+        const auto& b = copy.points[i];
+        if (!sameFloat(a.pos.x, b.pos.x) || !sameFloat(a.pos.y, b.pos.y)
+                || !sameFloat(a.minZ, b.minZ) || !sameFloat(a.maxZ, b.maxZ))
+            fatalExit(fmt() << "Round trip check failed: point " << i << " differs.");
+    }
+
+    for (size_t i = 0; i < map.walls.size(); i++) {
+        const auto& a = map.walls[i];
+        const auto& b = copy.walls[i];
+        if (a.adjacentSector != b.adjacentSector || a.adjacentPoint != b.adjacentPoint || a.extraWallTex != b.extraWallTex)
+            fatalExit(fmt() << "Round trip check failed: wall " << i << " differs.");
+    }
+
+    for (size_t i = 0; i < map.sectors.size(); i++) {
+        const auto& a = map.sectors[i];
+        const auto& b = copy.sectors[i];
+        if (a.firstPoint != b.firstPoint || a.pointCount != b.pointCount)
+            fatalExit(fmt() << "Round trip check failed: sector " << i << " differs.");
+    }
+
+    for (size_t i = 0; i < map.meshes.size(); i++) {
+        const auto& a = *map.meshes[i];
+        const auto& b = *copy.meshes[i];
+        if (a.meshId != b.meshId || !sameVec(a.pos, b.pos) || !sameVec(a.rot, b.rot) || !sameVec(a.scale, b.scale))
+            fatalExit(fmt() << "Round trip check failed: mesh " << i << " differs.");
+    }
+
+    for (size_t i = 0; i < map.sprites.size(); i++) {
+        if (!sameVec(map.sprites[i]->pos, copy.sprites[i]->pos))
+            fatalExit(fmt() << "Round trip check failed: sprite " << i << " differs.");
+    }
+}
+
+// Converts levels between the text (".level") and binary (".levelb") formats.
+// File names are relative to the data directory, like everywhere else in the game.
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+        fatalExit("Usage: LDLevelConvert <input> <output>");
+
+    jobInit();
+
+    LevelMap map;
+    map.load(argv[1], false);
+    map.save(argv[2]);
+
+    LevelMap copy;
+    copy.load(argv[2], false);
+    verifyRoundTrip(map, copy);
+
+    meshShutdownCache();
+    jobShutdown();
+
+    return 0;
+}